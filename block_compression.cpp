@@ -0,0 +1,283 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+namespace
+{
+
+constexpr std::size_t MIN_MATCH = 4;
+constexpr std::size_t MAX_OFFSET = 65535;
+
+// Required by the block format: The last 5 bytes are always literals,
+// and the last match starts at least 12 bytes before the end
+constexpr std::size_t LAST_LITERALS = 5;
+constexpr std::size_t MATCH_START_LIMIT = 12;
+
+constexpr int HASH_BITS = 12;
+
+// After this many positions without finding a match, positions are
+// skipped at an increasing rate. Incompressible data is passed through
+// a lot faster that way, at a small cost for compressible data.
+constexpr int SKIP_TRIGGER = 6;
+
+
+std::uint32_t read32(const char* pData)
+{
+  std::uint32_t value;
+  std::memcpy(&value, pData, sizeof(value));
+  return value;
+}
+
+
+std::size_t hashSequence(const std::uint32_t sequence)
+{
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+// Lengths that don't fit into the token's 4 bits continue in extra
+// bytes, each adding up to 255
+void writeLength(std::string& output, std::size_t length)
+{
+  for (; length >= 255; length -= 255)
+  {
+    output.push_back(static_cast<char>(255));
+  }
+
+  output.push_back(static_cast<char>(length));
+}
+
+
+void writeSequence(
+  std::string& output,
+  const char* pLiterals,
+  const std::size_t literalCount,
+  const std::size_t offset,
+  const std::size_t matchLength)
+{
+  const auto extraMatchLength = matchLength - MIN_MATCH;
+  const auto token =
+    (std::min<std::size_t>(literalCount, 15) << 4) |
+    std::min<std::size_t>(extraMatchLength, 15);
+  output.push_back(static_cast<char>(token));
+
+  if (literalCount >= 15)
+  {
+    writeLength(output, literalCount - 15);
+  }
+
+  output.append(pLiterals, literalCount);
+
+  output.push_back(static_cast<char>(offset & 0xFF));
+  output.push_back(static_cast<char>(offset >> 8));
+
+  if (extraMatchLength >= 15)
+  {
+    writeLength(output, extraMatchLength - 15);
+  }
+}
+
+
+void writeLastLiterals(
+  std::string& output,
+  const char* pLiterals,
+  const std::size_t literalCount)
+{
+  output.push_back(
+    static_cast<char>(std::min<std::size_t>(literalCount, 15) << 4));
+
+  if (literalCount >= 15)
+  {
+    writeLength(output, literalCount - 15);
+  }
+
+  output.append(pLiterals, literalCount);
+}
+
+
+bool readLength(
+  const unsigned char*& pInput,
+  const unsigned char* pInputEnd,
+  std::size_t& length)
+{
+  unsigned char byte;
+  do
+  {
+    if (pInput == pInputEnd)
+    {
+      return false;
+    }
+
+    byte = *pInput++;
+    length += byte;
+  } while (byte == 255);
+
+  return true;
+}
+
+}
+
+
+std::string compressBlock(const std::string_view data)
+{
+  std::string output;
+  output.reserve(data.size() / 2 + 16);
+
+  // Positions are stored plus one, so that 0 means "none"
+  std::vector<std::uint32_t> table(std::size_t{1} << HASH_BITS, 0);
+
+  const auto pData = data.data();
+  const auto size = data.size();
+  std::size_t anchor = 0;
+
+  if (size > MATCH_START_LIMIT)
+  {
+    const auto matchStartLimit = size - MATCH_START_LIMIT;
+    const auto matchEndLimit = size - LAST_LITERALS;
+    auto position = std::size_t{0};
+    auto misses = 0u;
+
+    while (position < matchStartLimit)
+    {
+      const auto sequence = read32(pData + position);
+      auto& entry = table[hashSequence(sequence)];
+      const auto candidate = static_cast<std::size_t>(entry);
+      entry = static_cast<std::uint32_t>(position + 1);
+
+      if (
+        candidate == 0 ||
+        position - (candidate - 1) > MAX_OFFSET ||
+        read32(pData + candidate - 1) != sequence)
+      {
+        position += 1 + (misses++ >> SKIP_TRIGGER);
+        continue;
+      }
+
+      const auto matchStart = candidate - 1;
+      auto matchEnd = position + MIN_MATCH;
+      while (
+        matchEnd < matchEndLimit &&
+        pData[matchEnd] == pData[matchStart + matchEnd - position])
+      {
+        ++matchEnd;
+      }
+
+      writeSequence(
+        output,
+        pData + anchor,
+        position - anchor,
+        position - matchStart,
+        matchEnd - position);
+
+      position = matchEnd;
+      anchor = position;
+      misses = 0;
+    }
+  }
+
+  writeLastLiterals(output, pData + anchor, size - anchor);
+  return output;
+}
+
+
+bool decompressBlock(
+  const std::string_view compressed,
+  char* const pOutput,
+  const std::size_t size)
+{
+  auto pInput = reinterpret_cast<const unsigned char*>(compressed.data());
+  const auto pInputEnd = pInput + compressed.size();
+  std::size_t position = 0;
+
+  while (pInput != pInputEnd)
+  {
+    const auto token = *pInput++;
+
+    std::size_t literalCount = token >> 4;
+    if (literalCount == 15 && !readLength(pInput, pInputEnd, literalCount))
+    {
+      return false;
+    }
+
+    if (
+      literalCount > static_cast<std::size_t>(pInputEnd - pInput) ||
+      literalCount > size - position)
+    {
+      return false;
+    }
+
+    std::memcpy(pOutput + position, pInput, literalCount);
+    pInput += literalCount;
+    position += literalCount;
+
+    // The last sequence consists of literals only
+    if (pInput == pInputEnd)
+    {
+      break;
+    }
+
+    if (pInputEnd - pInput < 2)
+    {
+      return false;
+    }
+
+    const auto offset = static_cast<std::size_t>(pInput[0] | (pInput[1] << 8));
+    pInput += 2;
+
+    std::size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(pInput, pInputEnd, matchLength))
+    {
+      return false;
+    }
+    matchLength += MIN_MATCH;
+
+    if (offset == 0 || offset > position || matchLength > size - position)
+    {
+      return false;
+    }
+
+    // Matches may overlap with the bytes they produce, which repeats
+    // the last offset bytes. That needs to be copied byte by byte.
+    const auto pMatch = pOutput + position - offset;
+    if (offset >= matchLength)
+    {
+      std::memcpy(pOutput + position, pMatch, matchLength);
+    }
+    else
+    {
+      for (std::size_t i = 0; i < matchLength; ++i)
+      {
+        pOutput[position + i] = pMatch[i];
+      }
+    }
+
+    position += matchLength;
+  }
+
+  return position == size;
+}
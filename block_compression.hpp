@@ -0,0 +1,43 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+// A fast LZ77 compressor using the LZ4 block format: Each sequence is a
+// run of literal bytes, followed by a copy of at least 4 bytes from up to
+// 64 KiB before. Repeated matches are found via a small hash table of
+// recent 4-byte sequences, so compression speed is mostly bounded by
+// memory bandwidth, and decompression even more so.
+//
+// Meant for text that is kept in memory for a long time, but rarely
+// looked at, like old script output. Logs typically shrink to a
+// fifth of their size or less.
+std::string compressBlock(std::string_view data);
+
+// Decompresses data created by compressBlock() into the given buffer, which
+// must be exactly as large as the original data. Returns false if the
+// compressed data is damaged, or doesn't fit the given size.
+bool decompressBlock(std::string_view compressed, char* pOutput, std::size_t size);
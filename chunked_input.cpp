@@ -0,0 +1,102 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "chunked_input.hpp"
+
+#include <cstring>
+
+
+namespace
+{
+
+// A UTF-8 encoded character takes up to 4 bytes, so at most 3 of them
+// can be missing
+constexpr std::size_t MAX_HELD_BACK_SIZE = 3;
+
+}
+
+
+ChunkedInput::ChunkedInput(const std::size_t maxPieceSize)
+  : mBuffer(maxPieceSize + MAX_HELD_BACK_SIZE)
+  , mMaxPieceSize(maxPieceSize)
+{
+}
+
+
+bool ChunkedInput::appendPiece(const std::size_t size, Document& document)
+{
+  const auto pBegin = mBuffer.data();
+  const auto pEnd = pieceBuffer() + size;
+  const auto pComplete = pEnd - incompleteCharacterSize(pBegin, pEnd);
+  mHeldBackSize = pEnd - pComplete;
+
+  if (pComplete == pBegin)
+  {
+    return false;
+  }
+
+  document.append(pBegin, pComplete);
+
+  // Only a few bytes, but they might overlap with where they go when the
+  // piece was tiny
+  std::memmove(pBegin, pComplete, mHeldBackSize);
+  return true;
+}
+
+
+bool ChunkedInput::finish(Document& document)
+{
+  if (mHeldBackSize == 0)
+  {
+    return false;
+  }
+
+  document.append(mBuffer.data(), mBuffer.data() + mHeldBackSize);
+  mHeldBackSize = 0;
+  return true;
+}
+
+
+std::size_t incompleteCharacterSize(const char* pBegin, const char* pEnd)
+{
+  for (
+    std::size_t size = 1;
+    size <= MAX_HELD_BACK_SIZE && size <= std::size_t(pEnd - pBegin);
+    ++size)
+  {
+    const auto byte = static_cast<unsigned char>(*(pEnd - size));
+
+    // Continuation byte, the character starts further back
+    if ((byte & 0xC0) == 0x80)
+    {
+      continue;
+    }
+
+    const auto expectedSize =
+      (byte & 0xE0) == 0xC0 ? std::size_t{2} :
+      (byte & 0xF0) == 0xE0 ? 3 :
+      (byte & 0xF8) == 0xF0 ? 4 :
+      1;
+    return expectedSize > size ? size : 0;
+  }
+
+  return 0;
+}
@@ -0,0 +1,66 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "document.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+// Appends text that arrives in pieces of arbitrary size, like a script's
+// output read from a pipe, to a document. A UTF-8 encoded character that
+// is cut off at the end of a piece would be shown as garbage until the
+// rest of it arrives, so it is held back until then.
+//
+// Pieces are read straight into a buffer owned by this class, right behind
+// the bytes held back from the previous piece. That way, completing a
+// character doesn't need any copying.
+class ChunkedInput {
+public:
+  explicit ChunkedInput(std::size_t maxPieceSize);
+
+  // Where to read the next piece to, and how many bytes fit there
+  char* pieceBuffer() { return mBuffer.data() + mHeldBackSize; }
+  std::size_t maxPieceSize() const { return mMaxPieceSize; }
+
+  // Appends the complete characters of the piece that was just read into
+  // pieceBuffer(), including the ones it completed. Returns false if
+  // nothing was appended, because the piece didn't complete anything.
+  bool appendPiece(std::size_t size, Document& document);
+
+  // The input ended, so whatever is left of a cut off character won't be
+  // completed anymore. Appends it as it is. Returns false if there was
+  // nothing held back.
+  bool finish(Document& document);
+
+private:
+  std::vector<char> mBuffer;
+  std::size_t mMaxPieceSize;
+  std::size_t mHeldBackSize = 0;
+};
+
+
+// Returns how many bytes at the end of the given data belong to a UTF-8
+// encoded character that is cut off. Invalid sequences count as complete,
+// there's no point in waiting for more of them.
+std::size_t incompleteCharacterSize(const char* pBegin, const char* pEnd);
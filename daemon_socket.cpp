@@ -0,0 +1,378 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "daemon_socket.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+
+namespace
+{
+
+constexpr std::uint32_t PROTOCOL_MAGIC = 0x31445654; // "TVD1"
+
+// Anything larger than this is most likely not coming from a client
+constexpr std::uint32_t MAX_ARGUMENT_COUNT = 4096;
+constexpr std::uint32_t MAX_STRING_SIZE = 64 * 1024 * 1024;
+
+// A client sends its request right after connecting, so there's no reason
+// to wait for it any longer than this
+constexpr auto REQUEST_TIMEOUT = std::chrono::seconds(2);
+
+
+std::optional<sockaddr_un> socketAddress(const std::string& path)
+{
+  sockaddr_un address{};
+  if (path.empty() || path.size() >= sizeof(address.sun_path))
+  {
+    return {};
+  }
+
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+
+bool connectTo(const int fd, const sockaddr_un& address)
+{
+  while (
+    connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address))
+      == -1)
+  {
+    if (errno != EINTR)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+bool sendAll(const int fd, const void* pData, std::size_t size)
+{
+  auto pBytes = static_cast<const char*>(pData);
+  while (size > 0)
+  {
+    // MSG_NOSIGNAL: A peer that went away shouldn't kill us via SIGPIPE
+    const auto bytesSent = send(fd, pBytes, size, MSG_NOSIGNAL);
+    if (bytesSent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    pBytes += bytesSent;
+    size -= bytesSent;
+  }
+
+  return true;
+}
+
+
+bool receiveAll(const int fd, void* pData, std::size_t size)
+{
+  auto pBytes = static_cast<char*>(pData);
+  while (size > 0)
+  {
+    const auto bytesReceived = recv(fd, pBytes, size, 0);
+    if (bytesReceived < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (bytesReceived <= 0)
+    {
+      return false;
+    }
+
+    pBytes += bytesReceived;
+    size -= bytesReceived;
+  }
+
+  return true;
+}
+
+
+bool sendString(const int fd, const std::string& string)
+{
+  const auto size = static_cast<std::uint32_t>(string.size());
+  return
+    sendAll(fd, &size, sizeof(size)) &&
+    sendAll(fd, string.data(), string.size());
+}
+
+
+std::optional<std::string> receiveString(const int fd)
+{
+  std::uint32_t size;
+  if (!receiveAll(fd, &size, sizeof(size)) || size > MAX_STRING_SIZE)
+  {
+    return {};
+  }
+
+  std::string string(size, '\0');
+  if (!receiveAll(fd, string.data(), size))
+  {
+    return {};
+  }
+
+  return string;
+}
+
+
+bool isOwnUser(const int fd)
+{
+  ucred credentials{};
+  socklen_t size = sizeof(credentials);
+  return
+    getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+    credentials.uid == getuid();
+}
+
+
+// Both ends are on the same machine, so integers are sent in native
+// byte order
+std::optional<DaemonRequest> receiveRequest(const int fd)
+{
+  std::uint32_t magic;
+  std::uint32_t argumentCount;
+  if (
+    !receiveAll(fd, &magic, sizeof(magic)) ||
+    magic != PROTOCOL_MAGIC ||
+    !receiveAll(fd, &argumentCount, sizeof(argumentCount)) ||
+    argumentCount > MAX_ARGUMENT_COUNT)
+  {
+    return {};
+  }
+
+  DaemonRequest request;
+  auto workingDirectory = receiveString(fd);
+  if (!workingDirectory)
+  {
+    return {};
+  }
+
+  request.workingDirectory = std::move(*workingDirectory);
+
+  for (std::uint32_t i = 0; i < argumentCount; ++i)
+  {
+    auto argument = receiveString(fd);
+    if (!argument)
+    {
+      return {};
+    }
+
+    request.arguments.push_back(std::move(*argument));
+  }
+
+  return request;
+}
+
+}
+
+
+DaemonConnection::DaemonConnection(const int fd, DaemonRequest request)
+  : mFd(fd)
+  , mRequest(std::move(request))
+{
+}
+
+
+DaemonConnection::~DaemonConnection()
+{
+  close(mFd);
+}
+
+
+void DaemonConnection::reply(const int exitCode)
+{
+  const auto code = static_cast<std::int32_t>(exitCode);
+  sendAll(mFd, &code, sizeof(code));
+}
+
+
+std::unique_ptr<DaemonSocket> DaemonSocket::listen(const std::string& path)
+{
+  const auto address = socketAddress(path);
+  if (!address)
+  {
+    return nullptr;
+  }
+
+  const auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+  {
+    return nullptr;
+  }
+
+  // Requests can run scripts, so only our own user may connect. The
+  // socket file gets its permissions when binding, so restricting them
+  // via the umask leaves no window in which others could connect.
+  auto bindSocket = [&]()
+  {
+    const auto previousMask = umask(S_IRWXG | S_IRWXO);
+    const auto isBound = bind(
+      fd, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) == 0;
+    const auto error = errno;
+    umask(previousMask);
+    errno = error;
+    return isBound;
+  };
+
+  auto isBound = bindSocket();
+  if (!isBound && errno == EADDRINUSE)
+  {
+    // Nobody answering means the socket file is a leftover
+    const auto probeFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const auto isInUse = probeFd != -1 && connectTo(probeFd, *address);
+    if (probeFd != -1)
+    {
+      close(probeFd);
+    }
+
+    if (!isInUse)
+    {
+      unlink(path.c_str());
+      isBound = bindSocket();
+    }
+  }
+
+  if (!isBound || ::listen(fd, 16) == -1)
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  return std::unique_ptr<DaemonSocket>(new DaemonSocket(fd, path));
+}
+
+
+DaemonSocket::DaemonSocket(const int fd, std::string path)
+  : mFd(fd)
+  , mPath(std::move(path))
+{
+}
+
+
+DaemonSocket::~DaemonSocket()
+{
+  close(mFd);
+  unlink(mPath.c_str());
+}
+
+
+std::unique_ptr<DaemonConnection> DaemonSocket::accept(
+  const std::chrono::milliseconds timeout)
+{
+  pollfd pfd{mFd, POLLIN, 0};
+  if (poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0)
+  {
+    return nullptr;
+  }
+
+  const auto fd = accept4(mFd, nullptr, nullptr, SOCK_CLOEXEC);
+  if (fd == -1)
+  {
+    return nullptr;
+  }
+
+  // The socket's permissions already keep out other users, unless it was
+  // placed somewhere they can replace it, or its permissions were changed
+  if (!isOwnUser(fd))
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  // Don't let a client that never sends anything block the daemon
+  const auto seconds =
+    std::chrono::duration_cast<std::chrono::seconds>(REQUEST_TIMEOUT);
+  timeval receiveTimeout{static_cast<time_t>(seconds.count()), 0};
+  setsockopt(
+    fd, SOL_SOCKET, SO_RCVTIMEO, &receiveTimeout, sizeof(receiveTimeout));
+
+  auto request = receiveRequest(fd);
+  if (!request)
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  return std::unique_ptr<DaemonConnection>(
+    new DaemonConnection(fd, std::move(*request)));
+}
+
+
+std::optional<int> sendToDaemon(
+  const std::string& path,
+  const DaemonRequest& request)
+{
+  const auto address = socketAddress(path);
+  if (!address)
+  {
+    return {};
+  }
+
+  const auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+  {
+    return {};
+  }
+
+  const auto argumentCount =
+    static_cast<std::uint32_t>(request.arguments.size());
+  auto isSent =
+    connectTo(fd, *address) &&
+    sendAll(fd, &PROTOCOL_MAGIC, sizeof(PROTOCOL_MAGIC)) &&
+    sendAll(fd, &argumentCount, sizeof(argumentCount)) &&
+    sendString(fd, request.workingDirectory);
+
+  for (const auto& argument : request.arguments)
+  {
+    isSent = isSent && sendString(fd, argument);
+  }
+
+  // The reply only comes once the user is done, which can take a while
+  std::int32_t exitCode;
+  const auto isReplied = isSent && receiveAll(fd, &exitCode, sizeof(exitCode));
+  close(fd);
+
+  if (!isReplied)
+  {
+    return {};
+  }
+
+  return exitCode;
+}
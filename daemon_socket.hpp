@@ -0,0 +1,101 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Lets a viewer that is already running (see --daemon in main.cpp) show
+// text on behalf of other invocations, which saves them from setting up
+// SDL, OpenGL and the fonts each time.
+//
+// A request consists of a client's command line arguments, and the working
+// directory they are relative to. Once the user closed the resulting view,
+// the daemon replies with the exit code. Requests are exchanged over a Unix
+// domain socket that only the daemon's user can access, and connections
+// from processes of other users are refused.
+struct DaemonRequest
+{
+  std::string workingDirectory;
+  std::vector<std::string> arguments;
+};
+
+
+// A client connected to the daemon, waiting for the reply to its request
+class DaemonConnection {
+public:
+  ~DaemonConnection();
+
+  DaemonConnection(const DaemonConnection&) = delete;
+  DaemonConnection& operator=(const DaemonConnection&) = delete;
+
+  const DaemonRequest& request() const { return mRequest; }
+
+  // Sends the exit code to the client. Fails silently if the client
+  // went away in the meantime.
+  void reply(int exitCode);
+
+private:
+  friend class DaemonSocket;
+
+  DaemonConnection(int fd, DaemonRequest request);
+
+  int mFd;
+  DaemonRequest mRequest;
+};
+
+
+class DaemonSocket {
+public:
+  // Starts listening on a socket at the given path. A stale socket left
+  // behind by a daemon that didn't shut down cleanly is replaced. Returns
+  // nullptr if that fails, or if another daemon is using the path.
+  static std::unique_ptr<DaemonSocket> listen(const std::string& path);
+
+  // Stops listening, and removes the socket file
+  ~DaemonSocket();
+
+  DaemonSocket(const DaemonSocket&) = delete;
+  DaemonSocket& operator=(const DaemonSocket&) = delete;
+
+  // Waits up to the given time for a client to connect, and reads its
+  // request. Returns nullptr if there was none, or it sent garbage.
+  std::unique_ptr<DaemonConnection> accept(std::chrono::milliseconds timeout);
+
+private:
+  DaemonSocket(int fd, std::string path);
+
+  int mFd;
+  std::string mPath;
+};
+
+
+// Sends the request to the daemon listening at the given path, and waits
+// for the reply. Returns an empty optional if there is no daemon, or
+// the connection broke before a reply arrived.
+std::optional<int> sendToDaemon(
+  const std::string& path,
+  const DaemonRequest& request);
@@ -0,0 +1,470 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "diff_view.hpp"
+
+#include "font_manager.hpp"
+
+#include "imgui_internal.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+
+// Rows shown above a change when jumping to it, for context
+constexpr std::size_t JUMP_CONTEXT_ROWS = 3;
+
+// Row backgrounds. The markers next to the text use the same colors,
+// but opaque.
+constexpr ImU32 REMOVED_COLOR = IM_COL32(150, 35, 35, 150);
+constexpr ImU32 ADDED_COLOR = IM_COL32(35, 130, 35, 150);
+constexpr ImU32 MODIFIED_COLOR = IM_COL32(160, 120, 20, 150);
+
+// Changes that are only a single row high would be invisible in the
+// marker strip for large documents
+constexpr float MIN_MARKER_HEIGHT = 2.0f;
+
+
+ImU32 hunkColor(const LineDiff::Hunk& hunk)
+{
+  if (hunk.leftCount == 0)
+  {
+    return ADDED_COLOR;
+  }
+  else if (hunk.rightCount == 0)
+  {
+    return REMOVED_COLOR;
+  }
+  else
+  {
+    return MODIFIED_COLOR;
+  }
+}
+
+}
+
+
+DiffView::DiffView(
+  std::string windowTitle,
+  std::string leftTitle,
+  std::string rightTitle,
+  Document leftDocument,
+  Document rightDocument,
+  LineDiff diff,
+  FontManager& fontManager)
+  : mTitle(std::move(windowTitle))
+  , mLeft{std::move(leftTitle), std::move(leftDocument), {}}
+  , mRight{std::move(rightTitle), std::move(rightDocument), {}}
+  , mDiff(std::move(diff))
+  , mFontManager(fontManager)
+{
+}
+
+
+std::optional<int> DiffView::draw(
+  const ImVec2& windowPos,
+  const ImVec2& windowSize)
+{
+  ImGui::SetNextWindowSize(windowSize);
+  ImGui::SetNextWindowPos(windowPos);
+
+  auto running = true;
+  ImGui::Begin(
+    mTitle.c_str(),
+    &running,
+    ImGuiWindowFlags_NoCollapse |
+    ImGuiWindowFlags_NoResize);
+
+  // When zooming, keep the same row at the top of the screen
+  if (ImGui::GetFontSize() != mLastFontSize)
+  {
+    handleFontSizeChange();
+  }
+
+  const auto& style = ImGui::GetStyle();
+  const auto markerStripWidth = ImGui::GetFontSize();
+  const auto textWidth =
+    ImGui::GetContentRegionAvail().x - markerStripWidth - style.ItemSpacing.x;
+
+  // The names of the documents, above the middle of each side
+  ImGui::TextUnformatted(mLeft.title.c_str());
+  ImGui::SameLine(style.WindowPadding.x + textWidth / 2.0f);
+  ImGui::TextUnformatted(mRight.title.c_str());
+  mFontManager.requestGlyphs(mLeft.title);
+  mFontManager.requestGlyphs(mRight.title);
+
+  // Same as in View::draw(), leaving room for the buttons
+  const auto buttonSpaceRequired =
+    ImGui::CalcTextSize("Close", nullptr, true).y +
+    style.FramePadding.y * 2.0f;
+  const auto textHeight = ImGui::GetContentRegionAvail().y -
+    (style.ItemSpacing.y + buttonSpaceRequired);
+
+  if (mPendingTopRow && mpTextWindow)
+  {
+    ImGui::SetScrollY(mpTextWindow, *mPendingTopRow * ImGui::GetTextLineHeight());
+    mPendingTopRow.reset();
+  }
+
+  // Focus the text initially, so that it can be scrolled right away
+  if (ImGui::IsWindowAppearing())
+  {
+    ImGui::SetNextWindowFocus();
+  }
+
+  // Both sides share the text window, and with it the scroll position.
+  // Scrolling horizontally by the width of the widest line minus that of
+  // one side is enough to reveal the end of any line.
+  ImGui::SetNextWindowContentSize({
+    mMaxLineWidth + textWidth / 2.0f,
+    mDiff.rowCount() * ImGui::GetTextLineHeight()});
+
+  ImGui::BeginChild(
+    "#scroll_area",
+    {textWidth, textHeight},
+    true,
+    ImGuiWindowFlags_HorizontalScrollbar);
+  drawRows();
+  ImGui::EndChild();
+
+  ImGui::SameLine();
+  drawMarkerStrip({markerStripWidth, textHeight});
+
+  // Draw the buttons, the close button centered like in the regular view
+  const auto buttonWidth = windowSize.x / 3.0f;
+  ImGui::SetCursorPosX((windowSize.x - buttonWidth) / 2.0f);
+  if (ImGui::Button("Close", {buttonWidth, 0.0f}))
+  {
+    running = false;
+  }
+
+  // The changes can also be jumped to by clicking the sticks, see main.cpp
+  const auto changeCount = mDiff.hunks().size();
+  if (changeCount > 0)
+  {
+    ImGui::SameLine();
+    if (ImGui::Button("Previous change"))
+    {
+      jumpToPreviousChange();
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Next change"))
+    {
+      jumpToNextChange();
+    }
+  }
+
+  ImGui::SameLine();
+  ImGui::AlignTextToFramePadding();
+  if (changeCount == 0)
+  {
+    ImGui::TextDisabled("No differences");
+  }
+  else
+  {
+    ImGui::TextDisabled(
+      "%zu %s", changeCount, changeCount == 1 ? "change" : "changes");
+  }
+
+  ImGui::End();
+
+  return running ? std::nullopt : std::optional<int>{0};
+}
+
+
+void DiffView::jumpToNextChange()
+{
+  const auto topRow = mPendingTopRow.value_or(mTopRow);
+  const auto& hunks = mDiff.hunks();
+
+  // Jump targets are in the same order as the hunks
+  const auto iHunk = std::partition_point(
+    hunks.begin(),
+    hunks.end(),
+    [&](const LineDiff::Hunk& hunk) { return jumpTarget(hunk) <= topRow; });
+  if (iHunk != hunks.end())
+  {
+    mPendingTopRow = jumpTarget(*iHunk);
+  }
+}
+
+
+void DiffView::jumpToPreviousChange()
+{
+  const auto topRow = mPendingTopRow.value_or(mTopRow);
+  const auto& hunks = mDiff.hunks();
+
+  const auto iHunk = std::partition_point(
+    hunks.begin(),
+    hunks.end(),
+    [&](const LineDiff::Hunk& hunk) { return jumpTarget(hunk) < topRow; });
+  if (iHunk != hunks.begin())
+  {
+    mPendingTopRow = jumpTarget(*std::prev(iHunk));
+  }
+}
+
+
+float DiffView::jumpTarget(const LineDiff::Hunk& hunk) const
+{
+  return static_cast<float>(
+    hunk.firstRow - std::min(hunk.firstRow, JUMP_CONTEXT_ROWS));
+}
+
+
+void DiffView::handleFontSizeChange()
+{
+  // The widest line depends on the font, and needs to be determined anew
+  mMaxLineWidth = 0.0f;
+
+  if (mLastFontSize != 0.0f && !mPendingTopRow)
+  {
+    mPendingTopRow = mTopRow;
+  }
+
+  mLastFontSize = ImGui::GetFontSize();
+}
+
+
+void DiffView::drawRows()
+{
+  mpTextWindow = ImGui::GetCurrentWindow();
+  const auto lineHeight = ImGui::GetTextLineHeight();
+
+  // Only the visible rows are submitted, as placeholders of the height of
+  // a line. The text is drawn afterwards, one side at a time, so that
+  // each side only needs a single clip rect.
+  ImGui::PushStyleVar(
+    ImGuiStyleVar_ItemSpacing, {ImGui::GetStyle().ItemSpacing.x, 0.0f});
+
+  mVisibleRows.clear();
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(mDiff.rowCount()), lineHeight);
+  while (clipper.Step())
+  {
+    for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+    {
+      mVisibleRows.push_back({
+        static_cast<std::size_t>(row), ImGui::GetCursorScreenPos().y});
+      ImGui::Dummy({0.0f, lineHeight});
+    }
+  }
+  clipper.End();
+
+  ImGui::PopStyleVar();
+
+  const auto& clipRect = mpTextWindow->InnerClipRect;
+  const auto middle = std::floor((clipRect.Min.x + clipRect.Max.x) / 2.0f);
+  drawSide(mLeft, true, clipRect.Min.x, middle, mVisibleRows);
+  drawSide(mRight, false, middle + 1.0f, clipRect.Max.x, mVisibleRows);
+
+  ImGui::GetWindowDrawList()->AddLine(
+    {middle + 0.5f, clipRect.Min.y},
+    {middle + 0.5f, clipRect.Max.y},
+    ImGui::GetColorU32(ImGuiCol_Border));
+
+  // On the very first frame, the text window didn't exist yet when
+  // draw() looked at the pending row
+  if (mPendingTopRow)
+  {
+    ImGui::SetScrollY(*mPendingTopRow * lineHeight);
+    mPendingTopRow.reset();
+  }
+
+  mTopRow = ImGui::GetScrollY() / lineHeight;
+}
+
+
+void DiffView::drawSide(
+  Side& side,
+  const bool isLeft,
+  const float left,
+  const float right,
+  const std::vector<VisibleRow>& rows)
+{
+  const auto pDrawList = ImGui::GetWindowDrawList();
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  const auto textColor = ImGui::GetColorU32(ImGuiCol_Text);
+  const auto fillerColor = ImGui::GetColorU32(ImGuiCol_FrameBg);
+
+  // In double precision, like View::textOriginX()
+  const auto originX =
+    static_cast<double>(left) +
+    mpTextWindow->WindowPadding.x -
+    mpTextWindow->Scroll.x;
+
+  pDrawList->PushClipRect(
+    {left, mpTextWindow->InnerClipRect.Min.y},
+    {right, mpTextWindow->InnerClipRect.Max.y},
+    true);
+
+  for (const auto& visibleRow : rows)
+  {
+    const auto row = mDiff.row(visibleRow.row);
+    const auto line = isLeft ? row.leftLine : row.rightLine;
+    const auto top = visibleRow.top;
+
+    // Lines that only exist on one side are shown as removed or added,
+    // with an empty row on the other side. Lines that exist on both sides
+    // of a change were modified.
+    if (row.isChanged)
+    {
+      const auto color =
+        !line ? fillerColor :
+        row.leftLine && row.rightLine ? MODIFIED_COLOR :
+        isLeft ? REMOVED_COLOR :
+        ADDED_COLOR;
+      pDrawList->AddRectFilled({left, top}, {right, top + lineHeight}, color);
+    }
+
+    if (!line)
+    {
+      continue;
+    }
+
+    const auto text = side.document.line(*line);
+    if (text.size() > LongLineLayout::MIN_LINE_SIZE)
+    {
+      const auto span =
+        side.longLines.visibleSpan(*line, text, left - originX, right - originX);
+      pDrawList->AddText(
+        {static_cast<float>(originX + span.x), top},
+        textColor,
+        span.text.data(),
+        span.text.data() + span.text.size());
+      mFontManager.requestGlyphs(span.text);
+
+      mMaxLineWidth = std::max(
+        mMaxLineWidth, static_cast<float>(side.longLines.width(*line, text)));
+    }
+    else
+    {
+      pDrawList->AddText(
+        {static_cast<float>(originX), top},
+        textColor,
+        text.data(),
+        text.data() + text.size());
+      mFontManager.requestGlyphs(text);
+
+      mMaxLineWidth = std::max(
+        mMaxLineWidth,
+        ImGui::CalcTextSize(text.data(), text.data() + text.size()).x);
+    }
+  }
+
+  pDrawList->PopClipRect();
+}
+
+
+void DiffView::drawMarkerStrip(const ImVec2& size)
+{
+  const auto pos = ImGui::GetCursorScreenPos();
+  const auto rowCount = static_cast<float>(mDiff.rowCount());
+  const auto visibleRowCount = mpTextWindow
+    ? mpTextWindow->InnerRect.GetHeight() / ImGui::GetTextLineHeight()
+    : 0.0f;
+
+  // Clicking or dragging scrolls the row under the mouse to the middle of
+  // the screen. Activating the strip via gamepad doesn't do anything.
+  ImGui::InvisibleButton("##changes", size);
+  if (
+    ImGui::IsItemActive() &&
+    ImGui::IsMouseDown(ImGuiMouseButton_Left) &&
+    rowCount > 0.0f)
+  {
+    const auto fraction =
+      std::clamp((ImGui::GetIO().MousePos.y - pos.y) / size.y, 0.0f, 1.0f);
+    mPendingTopRow =
+      std::max(0.0f, fraction * rowCount - visibleRowCount / 2.0f);
+  }
+
+  if (size.y != mMarkerStripHeight)
+  {
+    updateMarkers(size.y);
+  }
+
+  const auto pDrawList = ImGui::GetWindowDrawList();
+  pDrawList->AddRectFilled(
+    pos, {pos.x + size.x, pos.y + size.y}, ImGui::GetColorU32(ImGuiCol_FrameBg));
+
+  for (const auto& marker : mMarkers)
+  {
+    pDrawList->AddRectFilled(
+      {pos.x, pos.y + marker.top},
+      {pos.x + size.x, pos.y + marker.bottom},
+      marker.color | IM_COL32_A_MASK);
+  }
+
+  // Outline the part that's currently visible
+  if (rowCount > 0.0f)
+  {
+    const auto top = pos.y + mTopRow / rowCount * size.y;
+    const auto height = std::max(
+      MIN_MARKER_HEIGHT,
+      std::min(visibleRowCount, rowCount) / rowCount * size.y);
+    pDrawList->AddRect(
+      {pos.x, top},
+      {pos.x + size.x, top + height},
+      ImGui::GetColorU32(ImGuiCol_Text, 0.6f));
+  }
+}
+
+
+void DiffView::updateMarkers(const float height)
+{
+  mMarkers.clear();
+  mMarkerStripHeight = height;
+
+  if (mDiff.rowCount() == 0)
+  {
+    return;
+  }
+
+  const auto scale = static_cast<double>(height) / mDiff.rowCount();
+  for (const auto& hunk : mDiff.hunks())
+  {
+    const auto top = static_cast<float>(std::floor(hunk.firstRow * scale));
+    const auto bottom = std::max(
+      top + MIN_MARKER_HEIGHT,
+      static_cast<float>(
+        std::ceil((hunk.firstRow + hunk.rowCount()) * scale)));
+    const auto color = hunkColor(hunk);
+
+    // Overlapping changes of different kinds show up as modified
+    if (!mMarkers.empty() && top <= mMarkers.back().bottom)
+    {
+      auto& previous = mMarkers.back();
+      previous.bottom = std::max(previous.bottom, bottom);
+      if (previous.color != color)
+      {
+        previous.color = MODIFIED_COLOR;
+      }
+
+      continue;
+    }
+
+    mMarkers.push_back({top, bottom, color});
+  }
+}
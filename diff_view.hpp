@@ -0,0 +1,130 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "document.hpp"
+#include "line_diff.hpp"
+#include "long_line_layout.hpp"
+
+#include "imgui.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+class FontManager;
+struct ImGuiWindow;
+
+
+// Shows two documents next to each other, with the lines that the diff
+// considers equal on the same row. Changed rows are highlighted, and a
+// strip next to the text marks where the changes are, for jumping to them.
+//
+// Both sides scroll together, in both directions. Like the regular view,
+// only the visible rows are laid out, so the size of the documents
+// doesn't matter once the diff has been computed.
+//
+// Doesn't touch ImGui or GL until drawn, so it can be created on
+// a background thread.
+class DiffView {
+public:
+  DiffView(
+    std::string windowTitle,
+    std::string leftTitle,
+    std::string rightTitle,
+    Document leftDocument,
+    Document rightDocument,
+    LineDiff diff,
+    FontManager& fontManager);
+
+  std::optional<int> draw(const ImVec2& windowPos, const ImVec2& windowSize);
+
+  // Scrolls the next/previous change to near the top of the screen
+  void jumpToNextChange();
+  void jumpToPreviousChange();
+
+private:
+  struct Side
+  {
+    std::string title;
+    Document document;
+
+    // Very long lines are only drawn where they're visible
+    LongLineLayout longLines;
+  };
+
+  struct VisibleRow
+  {
+    std::size_t row;
+    float top;
+  };
+
+  // A change as shown in the marker strip, in pixels from its top
+  struct Marker
+  {
+    float top;
+    float bottom;
+    ImU32 color;
+  };
+
+  void handleFontSizeChange();
+  void drawRows();
+  void drawSide(
+    Side& side,
+    bool isLeft,
+    float left,
+    float right,
+    const std::vector<VisibleRow>& rows);
+  void drawMarkerStrip(const ImVec2& size);
+  void updateMarkers(float height);
+  float jumpTarget(const LineDiff::Hunk& hunk) const;
+
+  std::string mTitle;
+  Side mLeft;
+  Side mRight;
+  LineDiff mDiff;
+  FontManager& mFontManager;
+
+  ImGuiWindow* mpTextWindow = nullptr;
+
+  // Width of the widest line seen so far, on either side. Only grows, so
+  // that the horizontal scroll range doesn't change while scrolling.
+  float mMaxLineWidth = 0.0f;
+  float mLastFontSize = 0.0f;
+
+  // Index of the row at the top of the text window. Fractional when the
+  // top row is only partially visible.
+  float mTopRow = 0.0f;
+
+  // Row that should be scrolled to the top of the text window
+  std::optional<float> mPendingTopRow;
+
+  // Reused every frame, to avoid allocating
+  std::vector<VisibleRow> mVisibleRows;
+
+  // Recomputed when the strip's height changes. Changes that are too
+  // close together to tell apart share a marker.
+  std::vector<Marker> mMarkers;
+  float mMarkerStripHeight = 0.0f;
+};
@@ -0,0 +1,465 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "document.hpp"
+
+#include "hash.hpp"
+#include "paths.hpp"
+#include "position_store.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <thread>
+
+
+namespace
+{
+
+// Scanning smaller files is fast enough that a cache wouldn't make
+// a noticeable difference, so we don't clutter the cache directory
+// with index files for these.
+constexpr std::size_t MIN_CACHED_FILE_SIZE = 4 * 1024 * 1024;
+
+// Not worth starting a thread for hashing fewer lines than this
+constexpr std::size_t MIN_LINES_PER_HASHING_THREAD = 64 * 1024;
+
+// Files are checked for binary data at their start and end, which catches
+// both binary formats with a text header, and logs that were cut off
+// by a crash, leaving a run of NUL bytes at the end
+constexpr std::size_t BINARY_DETECTION_SIZE = 64 * 1024;
+
+
+// Text doesn't contain NUL bytes, and only a few control characters
+// besides whitespace and escape sequences (for colors)
+bool looksBinary(const std::string_view data)
+{
+  std::size_t controlCharacterCount = 0;
+  for (const auto c : data)
+  {
+    const auto byte = static_cast<unsigned char>(c);
+    if (byte == 0)
+    {
+      return true;
+    }
+
+    if (byte < 0x20 && !std::strchr("\t\n\r\f\v\b\x1b", c))
+    {
+      ++controlCharacterCount;
+    }
+  }
+
+  return controlCharacterCount > data.size() / 8;
+}
+
+
+std::optional<std::string> indexCacheFile(const std::string& path)
+{
+  // The cache file is named after the file's canonical path, so that
+  // different ways of referring to the same file share a cache entry.
+  char canonicalPath[PATH_MAX];
+  if (!realpath(path.c_str(), canonicalPath))
+  {
+    return {};
+  }
+
+  const auto directory = cacheDirectory();
+  if (directory.empty() || !makeDirectories(directory))
+  {
+    return {};
+  }
+
+  char name[17];
+  std::snprintf(
+    name,
+    sizeof(name),
+    "%016llx",
+    static_cast<unsigned long long>(
+      hashBytes(canonicalPath, std::strlen(canonicalPath))));
+
+  return directory + "/" + name + ".idx";
+}
+
+
+std::uint64_t hashLine(const std::string_view line, const bool ignoreNumbers)
+{
+  auto hash = FNV_OFFSET_BASIS;
+
+  if (!ignoreNumbers)
+  {
+    hash = hashWords(line.data(), line.size());
+  }
+  else
+  {
+    // Each run of digits counts as a single '0', so that numbers of
+    // different lengths don't make a difference either
+    auto previousWasDigit = false;
+    for (const auto c : line)
+    {
+      const auto isDigit = c >= '0' && c <= '9';
+      if (!(isDigit && previousWasDigit))
+      {
+        hash ^= static_cast<unsigned char>(isDigit ? '0' : c);
+        hash *= FNV_PRIME;
+      }
+
+      previousWasDigit = isDigit;
+    }
+  }
+
+  // Diffing compares lines across entire files, up to billions of pairs
+  // of them. With fewer bits, two different lines would end up looking
+  // equal every now and then.
+  return hash;
+}
+
+}
+
+
+Document::Document() = default;
+
+
+Document::Document(std::string text)
+{
+  append(text.data(), text.data() + text.size());
+}
+
+
+Document Document::fromFile(const std::string& path)
+{
+  Document document;
+  document.mpMappedText = MappedFile::open(path);
+  if (!document.mpMappedText)
+  {
+    return document;
+  }
+
+  // Binary data isn't split into lines, it's shown as a hex dump instead.
+  // That also saves scanning the whole file.
+  const auto& file = *document.mpMappedText;
+  const auto detectionSize = std::min(file.size(), BINARY_DETECTION_SIZE);
+  document.mIsBinary =
+    looksBinary({file.data(), detectionSize}) ||
+    looksBinary({file.data() + file.size() - detectionSize, detectionSize});
+  if (document.mIsBinary)
+  {
+    return document;
+  }
+
+  const auto useCache = document.mpMappedText->size() >= MIN_CACHED_FILE_SIZE;
+  const auto identity = useCache ? identifyFile(path) : std::nullopt;
+  const auto cacheFile = identity ? indexCacheFile(path) : std::nullopt;
+
+  if (cacheFile)
+  {
+    if (auto cachedIndex = LineIndex::load(*cacheFile, *identity))
+    {
+      document.mLineIndex = std::move(*cachedIndex);
+      return document;
+    }
+  }
+
+  document.indexLines(
+    document.mpMappedText->data(),
+    document.mpMappedText->data() + document.mpMappedText->size(),
+    0);
+
+  if (cacheFile)
+  {
+    // Failing to write the cache isn't a problem, we'll just have to
+    // scan the file again next time.
+    document.mLineIndex.save(*cacheFile, *identity);
+  }
+
+  return document;
+}
+
+
+Document Document::withChunkSize(const std::size_t chunkSize)
+{
+  Document document;
+  document.mScrollback = Scrollback{chunkSize};
+  return document;
+}
+
+
+void Document::append(const char* pBegin, const char* pEnd)
+{
+  if (!mLineHashes)
+  {
+    indexLines(pBegin, pEnd, mScrollback.size());
+    mScrollback.append(pBegin, pEnd);
+    mScrollback.update();
+    return;
+  }
+
+  // Take in one line at a time, so that a repeated line can be dropped
+  // before the next one is appended after it. That way, repeated lines
+  // never take up more than a single line's worth of memory.
+  while (pBegin != pEnd)
+  {
+    const auto pNewline = static_cast<const char*>(
+      std::memchr(pBegin, '\n', pEnd - pBegin));
+    const auto pLineEnd = pNewline ? pNewline + 1 : pEnd;
+
+    mScrollback.append(pBegin, pLineEnd);
+    if (pNewline)
+    {
+      completeLastLine();
+    }
+
+    pBegin = pLineEnd;
+  }
+
+  // Only now, since dropping a line requires it to be at the very end
+  mScrollback.update();
+}
+
+
+void Document::update()
+{
+  mScrollback.update();
+}
+
+
+void Document::waitForCompression()
+{
+  mScrollback.waitForCompression();
+}
+
+
+void Document::completeLastLine()
+{
+  // The last line's linebreak was just appended
+  const auto lastLine = mLineIndex.lineCount() - 1;
+  const auto start = mLineIndex.lineStart(lastLine);
+  const auto end = mScrollback.size();
+  const auto content = mScrollback.read(start, end - 1 - start);
+
+  if (lastLine > 0 && content == line(lastLine - 1))
+  {
+    mScrollback.truncate(start);
+    ++mDroppedRepeats[lastLine - 1];
+    return;
+  }
+
+  mLineHashes->push_back(hashLine(content, mHashIgnoresNumbers));
+  mLineIndex.addLineStart(end);
+}
+
+
+void Document::hashLines(const bool ignoreNumbers)
+{
+  mHashIgnoresNumbers = ignoreNumbers;
+
+  const auto count = mLineIndex.lineCount() - 1;
+  mLineHashes.emplace(count);
+
+  auto hashRange = [this, ignoreNumbers](
+    const std::size_t first,
+    const std::size_t end)
+  {
+    for (auto i = first; i < end; ++i)
+    {
+      (*mLineHashes)[i] = hashLine(line(i), ignoreNumbers);
+    }
+  };
+
+  // Large files are hashed on several threads, each taking an equal share
+  // of the lines. Reading lines of a mapped file is thread safe, unlike
+  // reading from the scrollback, which decompresses blocks as needed.
+  const auto threadCount = !mpMappedText
+    ? std::size_t{1}
+    : std::max(
+        std::size_t{1},
+        std::min<std::size_t>(
+          std::thread::hardware_concurrency(),
+          count / MIN_LINES_PER_HASHING_THREAD));
+
+  std::vector<std::future<void>> otherThreads;
+  for (std::size_t i = 1; i < threadCount; ++i)
+  {
+    otherThreads.push_back(std::async(
+      std::launch::async,
+      hashRange,
+      count * i / threadCount,
+      count * (i + 1) / threadCount));
+  }
+
+  hashRange(0, count / threadCount);
+
+  for (auto& thread : otherThreads)
+  {
+    thread.get();
+  }
+}
+
+
+std::size_t Document::hashedLineCount() const
+{
+  return mLineHashes ? mLineHashes->size() : 0;
+}
+
+
+std::uint64_t Document::lineHash(const std::size_t index) const
+{
+  return index < mLineHashes->size()
+    ? (*mLineHashes)[index]
+    : hashLine(line(index), mHashIgnoresNumbers);
+}
+
+
+std::size_t Document::repeatCount(const std::size_t index) const
+{
+  const auto iDropped = mDroppedRepeats.find(index);
+  return iDropped != mDroppedRepeats.end() ? iDropped->second + 1 : 1;
+}
+
+
+void Document::indexLines(
+  const char* pBegin,
+  const char* pEnd,
+  const std::uint64_t offset)
+{
+  // Record the start of each new line. memchr is a lot faster than
+  // looking at each character individually for large inputs.
+  for (auto pChar = pBegin; pChar != pEnd; )
+  {
+    const auto pNewline = static_cast<const char*>(
+      std::memchr(pChar, '\n', pEnd - pChar));
+    if (!pNewline)
+    {
+      break;
+    }
+
+    mLineIndex.addLineStart(offset + (pNewline - pBegin) + 1);
+    pChar = pNewline + 1;
+  }
+}
+
+
+std::size_t Document::lineCount() const
+{
+  return mLineIndex.lineCount();
+}
+
+
+std::string_view Document::line(const std::size_t index) const
+{
+  const auto start = mLineIndex.lineStart(index);
+  return read(start, lineEnd(index) - start);
+}
+
+
+std::vector<TextPart> Document::textParts(
+  const std::size_t first,
+  const std::size_t last,
+  const std::size_t maxPartSize) const
+{
+  const auto begin = mLineIndex.lineStart(first);
+  const auto end = lineEnd(last);
+  std::vector<TextPart> parts;
+
+  if (!mpMappedText)
+  {
+    // Already split into chunks, which are small enough
+    mScrollback.getParts(begin, end, parts);
+    return parts;
+  }
+
+  // The line index tells where the line containing the part's last byte
+  // ends, without having to look at the text
+  for (auto partBegin = begin; partBegin < end; )
+  {
+    auto partEnd = end;
+    if (end - partBegin > maxPartSize)
+    {
+      const auto line = lineContaining(partBegin + maxPartSize - 1);
+      partEnd = std::min(lineEnd(line) + 1, end);
+    }
+
+    parts.emplace_back(partBegin, read(partBegin, partEnd - partBegin));
+    partBegin = partEnd;
+  }
+
+  return parts;
+}
+
+
+std::string Document::copyLines(
+  const std::size_t first,
+  const std::size_t last) const
+{
+  std::string text;
+  std::string buffer;
+  for (const auto& part : textParts(first, last, SIZE_MAX))
+  {
+    text += part.read(buffer);
+  }
+
+  return text;
+}
+
+
+std::uint64_t Document::textSize() const
+{
+  return mpMappedText ? mpMappedText->size() : mScrollback.size();
+}
+
+
+std::size_t Document::lineContaining(const std::uint64_t offset) const
+{
+  return mLineIndex.lineContaining(offset);
+}
+
+
+std::string_view Document::bytes(
+  const std::uint64_t offset,
+  const std::size_t size) const
+{
+  return read(offset, size);
+}
+
+
+std::string_view Document::read(
+  const std::uint64_t offset,
+  const std::size_t size) const
+{
+  if (mpMappedText)
+  {
+    return {mpMappedText->data() + offset, size};
+  }
+
+  return mScrollback.read(offset, size);
+}
+
+
+std::uint64_t Document::lineEnd(const std::size_t index) const
+{
+  // Without the linebreak
+  return index + 1 < mLineIndex.lineCount()
+    ? mLineIndex.lineStart(index + 1) - 1
+    : textSize();
+}
@@ -0,0 +1,149 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "line_index.hpp"
+#include "mapped_file.hpp"
+#include "scrollback.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// Holds the text shown by the viewer, together with an index of where
+// each line starts. The index allows the view to only look at the lines
+// that are actually visible, instead of walking the entire text
+// every frame.
+//
+// Files are mapped into memory as a whole. Other text is kept in a
+// Scrollback, which compresses older parts of it. The line index always
+// stays uncompressed.
+class Document {
+public:
+  Document();
+  explicit Document(std::string text);
+
+  // Maps the given file into memory instead of reading it. For large files,
+  // the line index is cached on disk, so that opening the same file again
+  // doesn't require scanning it. Falls back to an empty document if the
+  // file can't be opened. Binary files aren't indexed (see isBinary()).
+  static Document fromFile(const std::string& path);
+
+  // An empty document whose text is moved into chunks of the given size
+  // (see Scrollback). Meant for tests.
+  static Document withChunkSize(std::size_t chunkSize);
+
+  // Appends the given bytes to the end of the document, updating the
+  // line index accordingly. Used when receiving output from a script.
+  // Must not be used on documents created via fromFile().
+  void append(const char* pBegin, const char* pEnd);
+
+  // Picks up older text that was compressed in the background, and starts
+  // compressing more (see Scrollback::update()). Meant to be called once
+  // per frame, so that compression continues after the output stops.
+  void update();
+
+  // Blocks until all text that can be compressed is
+  void waitForCompression();
+
+  // Number of lines in the document. An empty document, or text
+  // that ends with a linebreak, still has one (empty) last line.
+  std::size_t lineCount() const;
+
+  // Returns the content of the line with the given index, without
+  // the terminating linebreak. The returned view is invalidated
+  // by the next call to append(), and possibly by reading lines
+  // that are far away (see Scrollback::read()).
+  std::string_view line(std::size_t index) const;
+
+  // Returns the text of the lines from first to last (inclusive), split
+  // into parts that can be read independently, e.g. by several threads.
+  // Parts end at line boundaries, and are split after about maxPartSize
+  // bytes, or earlier. The last line's linebreak is not included.
+  // Parts referring to text that hasn't been compressed yet are
+  // invalidated by the next call to append().
+  std::vector<TextPart> textParts(
+    std::size_t first,
+    std::size_t last,
+    std::size_t maxPartSize) const;
+
+  // Returns the lines from first to last (inclusive) as a single string,
+  // separated by linebreaks. The last line's linebreak is not included.
+  std::string copyLines(std::size_t first, std::size_t last) const;
+
+  // Size of the entire text, in bytes
+  std::uint64_t textSize() const;
+
+  // Returns the index of the line containing the given byte offset
+  std::size_t lineContaining(std::uint64_t offset) const;
+
+  // True for files that look like binary data rather than text, e.g.
+  // because they contain NUL bytes. These aren't split into lines, the
+  // entire file is a single line. They're meant to be read via bytes()
+  // instead (see HexView).
+  bool isBinary() const { return mIsBinary; }
+
+  // Returns the given range of the text, regardless of lines
+  std::string_view bytes(std::uint64_t offset, std::size_t size) const;
+
+  // Starts keeping a hash of each line, which is used to recognize
+  // repeated lines (see LineFolding). With ignoreNumbers, lines that only
+  // differ in their digits, like timestamps or counters, hash the same.
+  // From then on, appended lines that are identical to the line before
+  // them are dropped right away, and only counted (see repeatCount()).
+  // For documents created via fromFile(), this hashes the entire file.
+  void hashLines(bool ignoreNumbers);
+  bool hasLineHashes() const { return mLineHashes.has_value(); }
+
+  // Only complete lines, i.e. ones followed by a linebreak, are hashed.
+  // That's all lines except the last one. Asking for the last line's
+  // hash computes it on the spot.
+  std::size_t hashedLineCount() const;
+  std::uint64_t lineHash(std::size_t index) const;
+
+  // How many times the given line was appended in a row, including
+  // the copies that were dropped. 1 for lines that weren't repeated.
+  std::size_t repeatCount(std::size_t index) const;
+
+private:
+  std::string_view read(std::uint64_t offset, std::size_t size) const;
+  std::uint64_t lineEnd(std::size_t index) const;
+  void indexLines(const char* pBegin, const char* pEnd, std::uint64_t offset);
+  void completeLastLine();
+
+  Scrollback mScrollback;
+  std::unique_ptr<MappedFile> mpMappedText;
+  LineIndex mLineIndex;
+
+  // Kept next to the line index instead of inside it, since they are
+  // optional and not part of the cached index (see LineIndex::save())
+  std::optional<std::vector<std::uint64_t>> mLineHashes;
+  std::unordered_map<std::size_t, std::size_t> mDroppedRepeats;
+  bool mHashIgnoresNumbers = false;
+  bool mIsBinary = false;
+};
@@ -0,0 +1,58 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "escape_sequences.hpp"
+
+#include <iterator>
+
+
+// Compare https://github.com/wertarbyte/coreutils/blob/f70c7b785b93dd436788d34827b209453157a6f2/src/echo.c#L203
+std::string replaceEscapeSequences(const std::string& original)
+{
+  std::string result;
+  result.reserve(original.size());
+
+  for (auto iChar = original.begin(); iChar != original.end(); ++iChar)
+  {
+    if (*iChar == '\\' && std::next(iChar) != original.end())
+    {
+      switch (*std::next(iChar))
+      {
+        case 'f': result.push_back('\f'); ++iChar; break;
+        case 'n': result.push_back('\n'); ++iChar; break;
+        case 'r': result.push_back('\r'); ++iChar; break;
+        case 't': result.push_back('\t'); ++iChar; break;
+        case 'v': result.push_back('\v'); ++iChar; break;
+        case '\\': result.push_back('\\'); ++iChar; break;
+
+        default:
+          result.push_back(*iChar);
+          break;
+      }
+    }
+    else
+    {
+      result.push_back(*iChar);
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,368 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "font_manager.hpp"
+
+#include "imgui_internal.h"
+
+#include <GLES2/gl2.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+
+namespace
+{
+
+// 13 pixels is the size of ImGui's built-in font
+constexpr auto DEFAULT_FONT_SIZE = 13.0f;
+
+// Available zoom levels, relative to the font size given on the command line
+constexpr float ZOOM_FACTORS[] = {0.75f, 1.0f, 1.25f, 1.5f, 2.0f, 2.5f, 3.0f};
+constexpr std::size_t DEFAULT_ZOOM_LEVEL = 1;
+
+// Basic Latin and Latin-1 supplement, same as
+// ImFontAtlas::GetGlyphRangesDefault()
+constexpr ImWchar DEFAULT_GLYPH_RANGES[] = {0x0020, 0x00FF, 0};
+
+
+// Reads the entire content of the given file into memory.
+// Returns an empty vector if the file can't be read.
+std::vector<char> loadFile(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+  {
+    return {};
+  }
+
+  const auto fileSize = file.tellg();
+  file.seekg(0);
+
+  std::vector<char> data(fileSize);
+  file.read(data.data(), fileSize);
+  return data;
+}
+
+
+// Uploads the atlas' pixels into a new texture and assigns it to the
+// atlas. The CPU-side copy of the pixels is not needed anymore afterwards.
+GLuint uploadTexture(ImFontAtlas& atlas)
+{
+  unsigned char* pPixels = nullptr;
+  int width = 0;
+  int height = 0;
+  atlas.GetTexDataAsRGBA32(&pPixels, &width, &height);
+
+  GLint lastTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &lastTexture);
+
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(
+    GL_TEXTURE_2D,
+    0,
+    GL_RGBA,
+    width,
+    height,
+    0,
+    GL_RGBA,
+    GL_UNSIGNED_BYTE,
+    pPixels);
+
+  glBindTexture(GL_TEXTURE_2D, lastTexture);
+
+  atlas.SetTexID(reinterpret_cast<ImTextureID>(static_cast<std::intptr_t>(texture)));
+  atlas.ClearTexData();
+
+  return texture;
+}
+
+}
+
+
+FontManager::FontManager(
+  std::optional<std::string> fontFile,
+  std::optional<float> fontSize)
+  : mActiveLevel(DEFAULT_ZOOM_LEVEL)
+  , mRequestedLevel(DEFAULT_ZOOM_LEVEL)
+{
+  if (fontFile)
+  {
+    mFontData = loadFile(*fontFile);
+    if (mFontData.empty())
+    {
+      std::cerr
+        << "Could not load font file '" << *fontFile
+        << "', using default font\n";
+    }
+  }
+
+  const auto baseSize = fontSize.value_or(DEFAULT_FONT_SIZE);
+  for (const auto factor : ZOOM_FACTORS)
+  {
+    mZoomLevels.push_back({std::round(baseSize * factor), nullptr, {}});
+  }
+
+  mRequestedGlyphs.AddRanges(DEFAULT_GLYPH_RANGES);
+
+  // We need an atlas to show the first frame, so the initial one is
+  // built right away.
+  startBuild(mZoomLevels[mActiveLevel]);
+  mZoomLevels[mActiveLevel].pAtlas =
+    mZoomLevels[mActiveLevel].pendingBuild.get();
+
+  prepareNeighbours(mActiveLevel);
+}
+
+
+FontManager::~FontManager()
+{
+  // Wait for any builds that are still running, they refer to our
+  // font data.
+  for (auto& level : mZoomLevels)
+  {
+    if (level.pendingBuild.valid())
+    {
+      level.pendingBuild.wait();
+    }
+  }
+}
+
+
+ImFontAtlas* FontManager::atlas()
+{
+  return mZoomLevels[mActiveLevel].pAtlas->pAtlas.get();
+}
+
+
+void FontManager::requestGlyphs(const std::string_view text)
+{
+  // The built-in font doesn't have anything beyond the default range,
+  // no point in looking for missing glyphs.
+  if (mFontData.empty())
+  {
+    return;
+  }
+
+  const auto pEnd = text.data() + text.size();
+  for (auto pChar = text.data(); pChar != pEnd; )
+  {
+    // Plain ASCII is always part of the default range, skip it quickly
+    if (static_cast<unsigned char>(*pChar) < 0x80)
+    {
+      ++pChar;
+      continue;
+    }
+
+    // Stray continuation bytes aren't consumed by ImTextCharFromUtf8,
+    // those are skipped one at a time
+    unsigned int codepoint = 0;
+    pChar += std::max(ImTextCharFromUtf8(&codepoint, pChar, pEnd), 1);
+
+    // ImWchar is 16 bits wide unless IMGUI_USE_WCHAR32 is defined,
+    // code points outside the BMP can't be put into the atlas.
+    if (codepoint == 0 || codepoint > IM_UNICODE_CODEPOINT_MAX)
+    {
+      continue;
+    }
+
+    if (!mRequestedGlyphs.GetBit(codepoint))
+    {
+      mRequestedGlyphs.AddChar(static_cast<ImWchar>(codepoint));
+      ++mGlyphGeneration;
+    }
+  }
+}
+
+
+void FontManager::zoomIn()
+{
+  if (mRequestedLevel + 1 < mZoomLevels.size())
+  {
+    ++mRequestedLevel;
+  }
+}
+
+
+void FontManager::zoomOut()
+{
+  if (mRequestedLevel > 0)
+  {
+    --mRequestedLevel;
+  }
+}
+
+
+void FontManager::updateAtlas()
+{
+  // Pick up finished builds
+  for (auto& level : mZoomLevels)
+  {
+    using namespace std::chrono_literals;
+
+    if (
+      level.pendingBuild.valid() &&
+      level.pendingBuild.wait_for(0s) == std::future_status::ready)
+    {
+      auto pNewAtlas = level.pendingBuild.get();
+      pNewAtlas->texture = uploadTexture(*pNewAtlas->pAtlas);
+
+      if (level.pAtlas)
+      {
+        glDeleteTextures(1, &level.pAtlas->texture);
+      }
+
+      level.pAtlas = std::move(pNewAtlas);
+    }
+  }
+
+  // Switch zoom levels once the requested one is available
+  if (mRequestedLevel != mActiveLevel)
+  {
+    auto& requested = mZoomLevels[mRequestedLevel];
+    if (requested.pAtlas)
+    {
+      mActiveLevel = mRequestedLevel;
+      prepareNeighbours(mActiveLevel);
+    }
+    else if (!requested.pendingBuild.valid())
+    {
+      startBuild(requested);
+    }
+  }
+
+  // Bring the active atlas up to date with the glyphs that have been
+  // requested in the meantime
+  auto& active = mZoomLevels[mActiveLevel];
+  if (
+    active.pAtlas->glyphGeneration != mGlyphGeneration &&
+    !active.pendingBuild.valid())
+  {
+    startBuild(active);
+  }
+
+  // The texture of the initial atlas is created here as well, since
+  // the GL context doesn't exist yet when we are constructed.
+  if (!active.pAtlas->texture)
+  {
+    active.pAtlas->texture = uploadTexture(*active.pAtlas->pAtlas);
+  }
+
+  ImGui::GetIO().Fonts = active.pAtlas->pAtlas.get();
+}
+
+
+void FontManager::destroyTextures()
+{
+  for (auto& level : mZoomLevels)
+  {
+    if (level.pAtlas && level.pAtlas->texture)
+    {
+      glDeleteTextures(1, &level.pAtlas->texture);
+      level.pAtlas->texture = 0;
+      level.pAtlas->pAtlas->SetTexID(nullptr);
+    }
+  }
+}
+
+
+void FontManager::startBuild(ZoomLevel& level)
+{
+  ImVector<ImWchar> ranges;
+  mRequestedGlyphs.BuildRanges(&ranges);
+
+  // Building an atlas doesn't depend on the ImGui context, so it can be
+  // done on another thread. Everything needed by the build is handed over
+  // by value, except for the font data, which is never modified after
+  // construction.
+  level.pendingBuild = std::async(
+    std::launch::async,
+    [
+      &fontData = mFontData,
+      fontSize = level.fontSize,
+      glyphRanges = std::vector<ImWchar>(ranges.begin(), ranges.end()),
+      glyphGeneration = mGlyphGeneration
+    ]() mutable
+    {
+      auto pResult = std::make_unique<BakedAtlas>();
+      pResult->pAtlas = std::make_unique<ImFontAtlas>();
+      pResult->glyphRanges = std::move(glyphRanges);
+      pResult->glyphGeneration = glyphGeneration;
+
+      auto& atlas = *pResult->pAtlas;
+
+      ImFontConfig config;
+      config.SizePixels = fontSize;
+
+      if (fontData.empty())
+      {
+        atlas.AddFontDefault(&config);
+      }
+      else
+      {
+        // The font data is kept alive by the FontManager, so that atlases
+        // can be built without reading the file again.
+        config.FontDataOwnedByAtlas = false;
+        atlas.AddFontFromMemoryTTF(
+          const_cast<char*>(fontData.data()),
+          static_cast<int>(fontData.size()),
+          fontSize,
+          &config,
+          pResult->glyphRanges.data());
+      }
+
+      // Rasterize the glyphs and convert them into the texture format right
+      // away, so that only the upload remains to be done on the main thread.
+      unsigned char* pPixels = nullptr;
+      int width = 0;
+      int height = 0;
+      atlas.GetTexDataAsRGBA32(&pPixels, &width, &height);
+
+      return pResult;
+    });
+}
+
+
+void FontManager::prepareNeighbours(const std::size_t levelIndex)
+{
+  // Build the adjacent zoom levels ahead of time, so that zooming in
+  // or out by one step is instant. For level 0, the index of the lower
+  // neighbour wraps around and is skipped by the range check.
+  for (const auto neighbour : {levelIndex - 1, levelIndex + 1})
+  {
+    if (neighbour < mZoomLevels.size())
+    {
+      auto& level = mZoomLevels[neighbour];
+      if (!level.pAtlas && !level.pendingBuild.valid())
+      {
+        startBuild(level);
+      }
+    }
+  }
+}
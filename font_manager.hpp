@@ -0,0 +1,113 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Manages the font atlases used by ImGui.
+//
+// When a TTF font file is given, atlases initially only contain the
+// default (Latin) glyph range. As text is displayed, the view reports it
+// via requestGlyphs(), and any code points that are missing are added
+// to the atlas. This keeps memory usage and startup time proportional to
+// the glyphs that are actually shown, instead of baking the font's entire
+// coverage (e.g. all of CJK) into the atlas up front.
+//
+// Without a TTF file, ImGui's built-in font is used, which only covers
+// Latin-1, so there is nothing to load on demand in that case.
+//
+// To support zooming, there is one atlas per zoom level. Atlases are
+// built on a background thread when first needed and kept around
+// afterwards, so that switching between zoom levels is instant. Until a
+// requested atlas is ready, the previous one stays in use, so building
+// never stalls a frame.
+class FontManager {
+public:
+  FontManager(
+    std::optional<std::string> fontFile,
+    std::optional<float> fontSize);
+  ~FontManager();
+
+  // The atlas that is currently in use. ImGui must be set up to use
+  // this atlas (see ImGui::CreateContext()).
+  ImFontAtlas* atlas();
+
+  // Looks for code points in the given UTF-8 text which are not yet
+  // part of the atlas, and remembers them for the next atlas update.
+  void requestGlyphs(std::string_view text);
+
+  void zoomIn();
+  void zoomOut();
+
+  // Uploads atlases that have finished building in the background,
+  // switches to the requested zoom level once its atlas is ready, and
+  // starts new builds as needed. Must be called outside of an ImGui frame,
+  // i.e. before ImGui::NewFrame().
+  void updateAtlas();
+
+  // Deletes all font textures. Must be called while the GL context
+  // is still alive.
+  void destroyTextures();
+
+private:
+  struct BakedAtlas
+  {
+    std::unique_ptr<ImFontAtlas> pAtlas;
+
+    // Referenced by the atlas' font config, so it must live as
+    // long as the atlas itself.
+    std::vector<ImWchar> glyphRanges;
+
+    int glyphGeneration = 0;
+    unsigned int texture = 0;
+  };
+
+  struct ZoomLevel
+  {
+    float fontSize;
+    std::unique_ptr<BakedAtlas> pAtlas;
+    std::future<std::unique_ptr<BakedAtlas>> pendingBuild;
+  };
+
+  void startBuild(ZoomLevel& level);
+  void prepareNeighbours(std::size_t levelIndex);
+
+  std::vector<char> mFontData;
+  std::vector<ZoomLevel> mZoomLevels;
+  std::size_t mActiveLevel;
+  std::size_t mRequestedLevel;
+
+  // Tracks all code points that have been requested so far. The generation
+  // counter is increased whenever something is added, atlases built from
+  // an older generation are missing some glyphs.
+  ImFontGlyphRangesBuilder mRequestedGlyphs;
+  int mGlyphGeneration = 0;
+};
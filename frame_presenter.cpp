@@ -0,0 +1,420 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "frame_presenter.hpp"
+
+#include "hash.hpp"
+
+#include "imgui_impl_opengl3.h"
+
+#include <GLES2/gl2.h>
+
+// We don't need any of the native platform types, and the X11 headers
+// would pollute the global namespace with lots of macros
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+
+namespace
+{
+
+// Most drivers use double or triple buffering. If the back buffer is
+// older than this, we redraw everything.
+constexpr std::size_t MAX_BUFFER_AGE = 4;
+
+
+bool hasExtension(EGLDisplay display, const char* name)
+{
+  const auto pExtensions = eglQueryString(display, EGL_EXTENSIONS);
+  if (!pExtensions)
+  {
+    return false;
+  }
+
+  // Extension names are separated by spaces. Padding both sides makes
+  // sure that we don't match a prefix of some other extension.
+  const auto extensions = " " + std::string{pExtensions} + " ";
+  return extensions.find(" " + std::string{name} + " ") != std::string::npos;
+}
+
+
+bool isEmpty(const ImVec4& rect)
+{
+  return rect.x >= rect.z || rect.y >= rect.w;
+}
+
+
+ImVec4 intersection(const ImVec4& a, const ImVec4& b)
+{
+  return {
+    std::max(a.x, b.x),
+    std::max(a.y, b.y),
+    std::min(a.z, b.z),
+    std::min(a.w, b.w)};
+}
+
+
+void extend(std::optional<ImVec4>& region, const ImVec4& rect)
+{
+  if (isEmpty(rect))
+  {
+    return;
+  }
+
+  if (!region)
+  {
+    region = rect;
+    return;
+  }
+
+  region->x = std::min(region->x, rect.x);
+  region->y = std::min(region->y, rect.y);
+  region->z = std::max(region->z, rect.z);
+  region->w = std::max(region->w, rect.w);
+}
+
+
+ImVec4 screenRect(const ImDrawData& drawData)
+{
+  return {
+    drawData.DisplayPos.x,
+    drawData.DisplayPos.y,
+    drawData.DisplayPos.x + drawData.DisplaySize.x,
+    drawData.DisplayPos.y + drawData.DisplaySize.y};
+}
+
+
+// Converts a rect in ImGui's coordinates into framebuffer pixels, with the
+// origin at the bottom left like OpenGL and EGL expect it. Partially
+// covered pixels are included.
+std::array<int, 4> framebufferRect(
+  const ImVec4& rect,
+  const ImDrawData& drawData)
+{
+  const auto& scale = drawData.FramebufferScale;
+  const auto framebufferHeight =
+    static_cast<int>(drawData.DisplaySize.y * scale.y);
+
+  const auto left = static_cast<int>(
+    std::floor((rect.x - drawData.DisplayPos.x) * scale.x));
+  const auto top = static_cast<int>(
+    std::floor((rect.y - drawData.DisplayPos.y) * scale.y));
+  const auto right = static_cast<int>(
+    std::ceil((rect.z - drawData.DisplayPos.x) * scale.x));
+  const auto bottom = static_cast<int>(
+    std::ceil((rect.w - drawData.DisplayPos.y) * scale.y));
+
+  return {left, framebufferHeight - bottom, right - left, bottom - top};
+}
+
+}
+
+
+FramePresenter::FramePresenter(
+  SDL_Window* pWindow,
+  LatencyProbe* pLatencyProbe)
+  : mpWindow(pWindow)
+  , mpLatencyProbe(pLatencyProbe)
+{
+  // There's no way to ask SDL whether it uses EGL, but if it does, the
+  // context it created is current now.
+  const auto display = eglGetCurrentDisplay();
+  const auto surface = eglGetCurrentSurface(EGL_DRAW);
+  if (display == EGL_NO_DISPLAY || surface == EGL_NO_SURFACE)
+  {
+    return;
+  }
+
+  mpEglDisplay = display;
+  mpEglSurface = surface;
+  mHasBufferAge = hasExtension(display, "EGL_EXT_buffer_age");
+
+  // Swapping the buffers ourselves is only safe when SDL doesn't do
+  // anything beyond eglSwapBuffers() in SDL_GL_SwapWindow(). That's not
+  // the case for KMSDRM (page flipping) or Wayland (frame callbacks).
+  const auto pVideoDriver = SDL_GetCurrentVideoDriver();
+  if (!pVideoDriver || std::strcmp(pVideoDriver, "x11") != 0)
+  {
+    return;
+  }
+
+  if (hasExtension(display, "EGL_KHR_swap_buffers_with_damage"))
+  {
+    mpSwapBuffersWithDamage = reinterpret_cast<void*>(
+      eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+  }
+  else if (hasExtension(display, "EGL_EXT_swap_buffers_with_damage"))
+  {
+    mpSwapBuffersWithDamage = reinterpret_cast<void*>(
+      eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+  }
+}
+
+
+void FramePresenter::invalidate()
+{
+  mIsInvalidated = true;
+}
+
+
+bool FramePresenter::present(ImDrawData& drawData)
+{
+  const auto damage = findDamage(drawData);
+  if (!damage)
+  {
+    return false;
+  }
+
+  // The back buffer still shows the frame from <age> frames ago. Besides
+  // what changed in this frame, we need to redraw everything that changed
+  // in the frames presented since then.
+  const auto screen = screenRect(drawData);
+  const auto age = static_cast<std::size_t>(backBufferAge());
+
+  auto region = std::optional<ImVec4>{*damage};
+  if (age == 0 || age - 1 > mDamageHistory.size())
+  {
+    region = screen;
+  }
+  else
+  {
+    for (std::size_t i = 0; i < age - 1; ++i)
+    {
+      extend(region, mDamageHistory[i]);
+    }
+  }
+
+  const auto isFullScreen =
+    region->x <= screen.x && region->y <= screen.y &&
+    region->z >= screen.z && region->w >= screen.w;
+
+  const auto& io = ImGui::GetIO();
+  glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  if (isFullScreen)
+  {
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderDrawData(drawData);
+  }
+  else
+  {
+    // The renderer sets its own scissor rect for each draw command, so
+    // restricting rendering to the damaged region means restricting each
+    // command's clip rect. Commands outside of the region are skipped
+    // by the renderer.
+    for (auto i = 0; i < drawData.CmdListsCount; ++i)
+    {
+      for (auto& command : drawData.CmdLists[i]->CmdBuffer)
+      {
+        command.ClipRect = intersection(command.ClipRect, *region);
+        if (isEmpty(command.ClipRect))
+        {
+          command.ClipRect = {
+            screen.x - 1.0f, screen.y - 1.0f, screen.x - 1.0f, screen.y - 1.0f};
+        }
+      }
+    }
+
+    const auto scissorRect = framebufferRect(*region, drawData);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(
+      scissorRect[0], scissorRect[1], scissorRect[2], scissorRect[3]);
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderDrawData(drawData);
+    glDisable(GL_SCISSOR_TEST);
+  }
+
+  if (mpLatencyProbe)
+  {
+    if (mpLatencyProbe->waitsForCompletion())
+    {
+      glFinish();
+    }
+
+    mpLatencyProbe->mark(LatencyProbe::Point::Render);
+  }
+
+  if (isFullScreen || !mpSwapBuffersWithDamage)
+  {
+    SDL_GL_SwapWindow(mpWindow);
+  }
+  else
+  {
+    swapBuffersWithDamage(framebufferRect(*region, drawData));
+  }
+
+  if (mpLatencyProbe)
+  {
+    mpLatencyProbe->mark(LatencyProbe::Point::Swap);
+
+    if (mpLatencyProbe->waitsForCompletion())
+    {
+      glFinish();
+      mpLatencyProbe->mark(LatencyProbe::Point::Finish);
+    }
+  }
+
+  mDamageHistory.push_front(*damage);
+  if (mDamageHistory.size() > MAX_BUFFER_AGE)
+  {
+    mDamageHistory.pop_back();
+  }
+
+  return true;
+}
+
+
+std::optional<ImVec4> FramePresenter::findDamage(const ImDrawData& drawData)
+{
+  const auto screen = screenRect(drawData);
+
+  std::optional<ImVec4> damage;
+  if (
+    mIsInvalidated ||
+    drawData.DisplaySize.x != mPreviousDisplaySize.x ||
+    drawData.DisplaySize.y != mPreviousDisplaySize.y)
+  {
+    damage = screen;
+  }
+
+  mIsInvalidated = false;
+  mPreviousDisplaySize = drawData.DisplaySize;
+
+  // Each window has its own draw list, so comparing them one by one tells
+  // us which windows changed. The draw list's position is part of the hash,
+  // since a change in draw order can change what's visible as well.
+  std::unordered_map<const ImDrawList*, DrawListState> drawLists;
+  for (auto i = 0; i < drawData.CmdListsCount; ++i)
+  {
+    const auto pDrawList = drawData.CmdLists[i];
+
+    auto hash = hashWords(&i, sizeof(i));
+    hash = hashWords(
+      pDrawList->VtxBuffer.Data,
+      pDrawList->VtxBuffer.size_in_bytes(),
+      hash);
+    hash = hashWords(
+      pDrawList->IdxBuffer.Data,
+      pDrawList->IdxBuffer.size_in_bytes(),
+      hash);
+    hash = hashWords(
+      pDrawList->CmdBuffer.Data,
+      pDrawList->CmdBuffer.size_in_bytes(),
+      hash);
+
+    std::optional<ImVec4> bounds;
+    for (const auto& command : pDrawList->CmdBuffer)
+    {
+      extend(bounds, intersection(command.ClipRect, screen));
+    }
+
+    const auto state = DrawListState{hash, bounds.value_or(ImVec4{})};
+    const auto iPrevious = mPreviousDrawLists.find(pDrawList);
+    if (iPrevious == mPreviousDrawLists.end())
+    {
+      extend(damage, state.bounds);
+    }
+    else
+    {
+      if (iPrevious->second.hash != hash)
+      {
+        extend(damage, state.bounds);
+        extend(damage, iPrevious->second.bounds);
+      }
+
+      mPreviousDrawLists.erase(iPrevious);
+    }
+
+    drawLists.emplace(pDrawList, state);
+  }
+
+  // Whatever remains was drawn in the previous frame, but not anymore
+  for (const auto& [pDrawList, state] : mPreviousDrawLists)
+  {
+    extend(damage, state.bounds);
+  }
+
+  mPreviousDrawLists = std::move(drawLists);
+  return damage;
+}
+
+
+int FramePresenter::backBufferAge() const
+{
+  if (!mHasBufferAge)
+  {
+    return 0;
+  }
+
+  EGLint age = 0;
+  if (!eglQuerySurface(
+    mpEglDisplay, mpEglSurface, EGL_BUFFER_AGE_EXT, &age))
+  {
+    return 0;
+  }
+
+  return age;
+}
+
+
+void FramePresenter::swapBuffersWithDamage(const std::array<int, 4>& rect)
+{
+  const auto swapBuffers =
+    reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(
+      mpSwapBuffersWithDamage);
+
+  EGLint rects[] = {rect[0], rect[1], rect[2], rect[3]};
+  if (!swapBuffers(mpEglDisplay, mpEglSurface, rects, 1))
+  {
+    SDL_GL_SwapWindow(mpWindow);
+  }
+}
+
+
+void FramePresenter::renderDrawData(ImDrawData& drawData)
+{
+  if (!mRenderer.isValid())
+  {
+    ImGui_ImplOpenGL3_RenderDrawData(&drawData);
+    return;
+  }
+
+  mRenderer.render(drawData);
+
+  if (mpLatencyProbe)
+  {
+    const auto& stats = mRenderer.lastFrameStats();
+    mpLatencyProbe->countRenderWork(
+      stats.commandCount,
+      stats.drawCallCount,
+      stats.uploadCount,
+      stats.uploadSize);
+  }
+}
@@ -0,0 +1,89 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+#include "latency_probe.hpp"
+#include "streaming_renderer.hpp"
+
+#include <SDL.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+
+
+// Renders ImGui's draw data to the window and presents it, doing as little
+// work as possible: Frames that look exactly like the previous one are
+// neither rendered nor presented. When only a part of the screen changed,
+// and the platform tells us what the back buffer contains (via
+// EGL_EXT_buffer_age), only that part is redrawn.
+//
+// Rendering goes through a StreamingRenderer, or through ImGui's own
+// renderer in case that can't be set up.
+class FramePresenter {
+public:
+  // Must be created while the window's GL context is current. When given a
+  // latency probe, rendering and swapping are timed.
+  explicit FramePresenter(
+    SDL_Window* pWindow,
+    LatencyProbe* pLatencyProbe = nullptr);
+
+  // Makes the next frame be redrawn entirely. Needed for changes that
+  // aren't visible in the draw data, like updated texture contents.
+  void invalidate();
+
+  // Returns false if the frame didn't change, and wasn't presented.
+  // May modify the draw data's clip rects.
+  bool present(ImDrawData& drawData);
+
+private:
+  struct DrawListState
+  {
+    std::uint64_t hash;
+    ImVec4 bounds;
+  };
+
+  std::optional<ImVec4> findDamage(const ImDrawData& drawData);
+  int backBufferAge() const;
+  void swapBuffersWithDamage(const std::array<int, 4>& rect);
+  void renderDrawData(ImDrawData& drawData);
+
+  SDL_Window* mpWindow;
+  LatencyProbe* mpLatencyProbe;
+  StreamingRenderer mRenderer;
+  std::unordered_map<const ImDrawList*, DrawListState> mPreviousDrawLists;
+  ImVec2 mPreviousDisplaySize;
+
+  // Damaged regions of the most recently presented frames, newest first
+  std::deque<ImVec4> mDamageHistory;
+  bool mIsInvalidated = true;
+
+  // Only set when SDL is using EGL. Stored as untyped pointers to keep
+  // the EGL headers out of this one.
+  void* mpEglDisplay = nullptr;
+  void* mpEglSurface = nullptr;
+  void* mpSwapBuffersWithDamage = nullptr;
+  bool mHasBufferAge = false;
+};
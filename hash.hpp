@@ -0,0 +1,76 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+constexpr auto FNV_OFFSET_BASIS = std::uint64_t{14695981039346656037ull};
+constexpr auto FNV_PRIME = std::uint64_t{1099511628211ull};
+
+
+// 64-bit FNV-1a. Not suitable for anything security related, but simple
+// and good enough for identifying files and cache entries.
+inline std::uint64_t hashBytes(const char* pData, const std::size_t size)
+{
+  auto hash = FNV_OFFSET_BASIS;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= static_cast<unsigned char>(pData[i]);
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+
+// Same idea as hashBytes(), but consuming 8 bytes per step. Meant for
+// noticing changes in larger amounts of data, like a frame's vertices,
+// where hashing byte by byte would be too slow. Pass the result of
+// a previous call as seed to hash multiple buffers together.
+inline std::uint64_t hashWords(
+  const void* pData,
+  const std::size_t size,
+  std::uint64_t seed = FNV_OFFSET_BASIS)
+{
+  const auto pBytes = static_cast<const unsigned char*>(pData);
+  auto hash = seed;
+
+  std::size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+  {
+    std::uint64_t word;
+    std::memcpy(&word, pBytes + i, sizeof(word));
+    hash ^= word;
+    hash *= FNV_PRIME;
+  }
+
+  for (; i < size; ++i)
+  {
+    hash ^= pBytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
@@ -0,0 +1,453 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "hex_view.hpp"
+
+#include "imgui_internal.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cstdlib>
+
+
+namespace
+{
+
+// Rows covered by the text window. Small enough that float scroll
+// positions are exact to a fraction of a pixel.
+constexpr std::uint64_t SCROLL_WINDOW_ROWS = 64 * 1024;
+
+// Once the top of the screen comes this close to either end of the text
+// window, the window is moved so that the top is in its middle again
+constexpr std::uint64_t SCROLL_WINDOW_MARGIN = 16 * 1024;
+
+// Bytes are grouped in eights, with rows of 8 bytes used when 16 don't fit
+constexpr std::size_t BYTES_PER_GROUP = 8;
+constexpr std::size_t MAX_BYTES_PER_ROW = 16;
+
+// Keeps the visible part recognizable in the overview strip, even for
+// very large files
+constexpr float MIN_THUMB_HEIGHT = 4.0f;
+
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+}
+
+
+HexView::HexView(std::string windowTitle, Document document)
+  : mTitle(std::move(windowTitle))
+  , mDocument(std::move(document))
+  , mOffsetDigits(8)
+{
+  // At least 8 digits, like hexdump
+  for (
+    auto largestOffset = mDocument.textSize() >> 32;
+    largestOffset != 0;
+    largestOffset >>= 4)
+  {
+    ++mOffsetDigits;
+  }
+}
+
+
+std::optional<int> HexView::draw(
+  const ImVec2& windowPos,
+  const ImVec2& windowSize)
+{
+  ImGui::SetNextWindowSize(windowSize);
+  ImGui::SetNextWindowPos(windowPos);
+
+  auto running = true;
+  ImGui::Begin(
+    mTitle.c_str(),
+    &running,
+    ImGuiWindowFlags_NoCollapse |
+    ImGuiWindowFlags_NoResize);
+
+  const auto& style = ImGui::GetStyle();
+  const auto stripWidth = ImGui::GetFontSize();
+  const auto textWidth =
+    ImGui::GetContentRegionAvail().x - stripWidth - style.ItemSpacing.x;
+
+  // Same as in View::draw(), leaving room for the buttons
+  const auto buttonSpaceRequired =
+    ImGui::CalcTextSize("Close", nullptr, true).y +
+    style.FramePadding.y * 2.0f;
+  const auto textHeight = ImGui::GetContentRegionAvail().y -
+    (style.ItemSpacing.y + buttonSpaceRequired);
+
+  // When zooming, keep the same row at the top of the screen
+  if (ImGui::GetFontSize() != mLastFontSize)
+  {
+    if (mLastFontSize != 0.0f && !mPendingTopRow)
+    {
+      mPendingTopRow = mTopRow;
+    }
+
+    mLastFontSize = ImGui::GetFontSize();
+  }
+
+  updateBytesPerRow(
+    textWidth - style.WindowPadding.x * 2.0f - style.ScrollbarSize);
+  moveScrollWindow();
+
+  // Focus the text initially, so that it can be scrolled right away
+  if (ImGui::IsWindowAppearing())
+  {
+    ImGui::SetNextWindowFocus();
+  }
+
+  ImGui::SetNextWindowContentSize({
+    0.0f, windowRowCount() * ImGui::GetTextLineHeight()});
+  ImGui::BeginChild(
+    "#scroll_area",
+    {textWidth, textHeight},
+    true,
+    ImGuiWindowFlags_HorizontalScrollbar);
+  drawRows();
+  ImGui::EndChild();
+
+  ImGui::SameLine();
+  drawOverviewStrip({stripWidth, textHeight});
+
+  // Draw the buttons, the close button centered like in the regular view
+  const auto buttonWidth = windowSize.x / 3.0f;
+  ImGui::SetCursorPosX((windowSize.x - buttonWidth) / 2.0f);
+  if (ImGui::Button("Close", {buttonWidth, 0.0f}))
+  {
+    running = false;
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Go to offset"))
+  {
+    mOffsetInputIsInvalid = false;
+    ImGui::OpenPopup("Go to offset");
+  }
+
+  drawOffsetDialog();
+
+  ImGui::SameLine();
+  ImGui::AlignTextToFramePadding();
+  ImGui::TextDisabled(
+    "Binary data, %llu bytes",
+    static_cast<unsigned long long>(mDocument.textSize()));
+
+  ImGui::End();
+
+  return running ? std::nullopt : std::optional<int>{0};
+}
+
+
+std::uint64_t HexView::rowCount() const
+{
+  return (mDocument.textSize() + mBytesPerRow - 1) / mBytesPerRow;
+}
+
+
+std::uint64_t HexView::windowRowCount() const
+{
+  return std::min(rowCount(), SCROLL_WINDOW_ROWS);
+}
+
+
+std::size_t HexView::rowTextSize(const std::size_t bytesPerRow) const
+{
+  // See formatRow()
+  return
+    mOffsetDigits + 2 +
+    bytesPerRow * 3 + (bytesPerRow / BYTES_PER_GROUP - 1) +
+    2 + bytesPerRow + 1;
+}
+
+
+void HexView::updateBytesPerRow(const float availableWidth)
+{
+  // Measured with a row of zeros, which is as wide as any other row when
+  // using the built-in font. Other fonts might not be monospaced, but
+  // usually have digits of the same width.
+  mRowText.assign(rowTextSize(MAX_BYTES_PER_ROW), '0');
+  const auto bytesPerRow =
+    ImGui::CalcTextSize(mRowText.data(), mRowText.data() + mRowText.size()).x
+      <= availableWidth
+    ? MAX_BYTES_PER_ROW
+    : BYTES_PER_GROUP;
+
+  if (bytesPerRow != mBytesPerRow)
+  {
+    // Keep the same bytes at the top of the screen
+    if (!mPendingTopRow)
+    {
+      mPendingTopRow = mTopRow * mBytesPerRow / bytesPerRow;
+    }
+
+    mBytesPerRow = bytesPerRow;
+  }
+}
+
+
+void HexView::moveScrollWindow()
+{
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  const auto windowRows = windowRowCount();
+  const auto maxFirstRow = rowCount() - windowRows;
+
+  // Jumps put the row in the middle of the text window, leaving room to
+  // scroll either way. On the very first frame, the text window doesn't
+  // exist yet, scrolling then happens in drawRows().
+  if (mPendingTopRow)
+  {
+    const auto topRow = std::min(*mPendingTopRow, rowCount() - 1);
+    mFirstWindowRow =
+      std::min(maxFirstRow, topRow - std::min(topRow, windowRows / 2));
+
+    if (mpTextWindow)
+    {
+      ImGui::SetScrollY(mpTextWindow, (topRow - mFirstWindowRow) * lineHeight);
+      mPendingTopRow.reset();
+    }
+
+    return;
+  }
+
+  // While the scrollbar is dragged, moving the window would make the
+  // scrollbar jump away from under the mouse
+  if (
+    !mpTextWindow ||
+    ImGui::GetActiveID() == ImGui::GetWindowScrollbarID(mpTextWindow, ImGuiAxis_Y))
+  {
+    return;
+  }
+
+  const auto windowTopRow =
+    static_cast<std::uint64_t>(mpTextWindow->Scroll.y / lineHeight);
+  const auto isNearTop =
+    windowTopRow < SCROLL_WINDOW_MARGIN && mFirstWindowRow > 0;
+  const auto isNearBottom =
+    windowTopRow + SCROLL_WINDOW_MARGIN > windowRows &&
+    mFirstWindowRow < maxFirstRow;
+  if (!isNearTop && !isNearBottom)
+  {
+    return;
+  }
+
+  // Moving by whole rows keeps the text in place on screen. Scrolling
+  // that is about to happen (e.g. via mouse wheel) moves along.
+  const auto topRow = mFirstWindowRow + windowTopRow;
+  const auto firstRow =
+    std::min(maxFirstRow, topRow - std::min(topRow, windowRows / 2));
+  const auto shift =
+    (static_cast<double>(firstRow) - static_cast<double>(mFirstWindowRow)) *
+    lineHeight;
+
+  mpTextWindow->Scroll.y -= static_cast<float>(shift);
+  if (mpTextWindow->ScrollTarget.y != FLT_MAX)
+  {
+    mpTextWindow->ScrollTarget.y -= static_cast<float>(shift);
+  }
+
+  mFirstWindowRow = firstRow;
+}
+
+
+void HexView::drawRows()
+{
+  mpTextWindow = ImGui::GetCurrentWindow();
+  const auto lineHeight = ImGui::GetTextLineHeight();
+
+  // Like in View::drawVisibleLines(), only the visible rows are submitted
+  ImGui::PushStyleVar(
+    ImGuiStyleVar_ItemSpacing, {ImGui::GetStyle().ItemSpacing.x, 0.0f});
+
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(windowRowCount()), lineHeight);
+  while (clipper.Step())
+  {
+    for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+    {
+      formatRow(mFirstWindowRow + row);
+      ImGui::TextUnformatted(mRowText.data(), mRowText.data() + mRowText.size());
+    }
+  }
+  clipper.End();
+
+  ImGui::PopStyleVar();
+
+  if (mPendingTopRow)
+  {
+    ImGui::SetScrollY((*mPendingTopRow - mFirstWindowRow) * lineHeight);
+    mPendingTopRow.reset();
+  }
+
+  mTopRow =
+    mFirstWindowRow + static_cast<std::uint64_t>(ImGui::GetScrollY() / lineHeight);
+}
+
+
+void HexView::formatRow(const std::uint64_t row)
+{
+  const auto offset = row * mBytesPerRow;
+  const auto bytes = mDocument.bytes(
+    offset,
+    static_cast<std::size_t>(
+      std::min<std::uint64_t>(mBytesPerRow, mDocument.textSize() - offset)));
+
+  mRowText.clear();
+
+  for (auto shift = (mOffsetDigits - 1) * 4; shift >= 0; shift -= 4)
+  {
+    mRowText.push_back(HEX_DIGITS[(offset >> shift) & 0xF]);
+  }
+
+  mRowText += "  ";
+
+  // The last row is padded, so that its ASCII column lines up
+  for (std::size_t i = 0; i < mBytesPerRow; ++i)
+  {
+    if (i > 0 && i % BYTES_PER_GROUP == 0)
+    {
+      mRowText.push_back(' ');
+    }
+
+    if (i < bytes.size())
+    {
+      const auto byte = static_cast<unsigned char>(bytes[i]);
+      mRowText.push_back(HEX_DIGITS[byte >> 4]);
+      mRowText.push_back(HEX_DIGITS[byte & 0xF]);
+    }
+    else
+    {
+      mRowText += "  ";
+    }
+
+    mRowText.push_back(' ');
+  }
+
+  mRowText += " |";
+  for (const auto c : bytes)
+  {
+    mRowText.push_back(c >= 0x20 && c < 0x7F ? c : '.');
+  }
+  mRowText.push_back('|');
+}
+
+
+void HexView::drawOverviewStrip(const ImVec2& size)
+{
+  const auto pos = ImGui::GetCursorScreenPos();
+  const auto rowCount = static_cast<double>(this->rowCount());
+  const auto visibleRowCount = mpTextWindow
+    ? static_cast<double>(
+        mpTextWindow->InnerRect.GetHeight() / ImGui::GetTextLineHeight())
+    : 0.0;
+
+  // Like the marker strip of the diff view, clicking or dragging scrolls
+  // the part under the mouse to the middle of the screen
+  ImGui::InvisibleButton("##overview", size);
+  if (ImGui::IsItemActive() && ImGui::IsMouseDown(ImGuiMouseButton_Left))
+  {
+    const auto fraction =
+      std::clamp((ImGui::GetIO().MousePos.y - pos.y) / size.y, 0.0f, 1.0f);
+    mPendingTopRow = static_cast<std::uint64_t>(
+      std::max(0.0, fraction * rowCount - visibleRowCount / 2.0));
+  }
+
+  const auto pDrawList = ImGui::GetWindowDrawList();
+  pDrawList->AddRectFilled(
+    pos, {pos.x + size.x, pos.y + size.y}, ImGui::GetColorU32(ImGuiCol_FrameBg));
+
+  const auto top =
+    pos.y + static_cast<float>(mTopRow / rowCount * size.y);
+  const auto height = std::max(
+    MIN_THUMB_HEIGHT,
+    static_cast<float>(std::min(visibleRowCount / rowCount, 1.0) * size.y));
+  pDrawList->AddRectFilled(
+    {pos.x, top},
+    {pos.x + size.x, top + height},
+    ImGui::GetColorU32(ImGuiCol_ScrollbarGrab));
+}
+
+
+void HexView::drawOffsetDialog()
+{
+  if (!ImGui::BeginPopupModal(
+    "Go to offset", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+  {
+    return;
+  }
+
+  if (ImGui::IsWindowAppearing())
+  {
+    ImGui::SetKeyboardFocusHere();
+  }
+
+  ImGui::SetNextItemWidth(ImGui::CalcTextSize("0x0000000000").x * 1.5f);
+  const auto confirmed = ImGui::InputTextWithHint(
+    "##offset",
+    "0x1f400 or 128000",
+    mOffsetInput.data(),
+    mOffsetInput.size(),
+    ImGuiInputTextFlags_EnterReturnsTrue);
+
+  if ((ImGui::Button("Go") || confirmed) && jumpToOffset())
+  {
+    ImGui::CloseCurrentPopup();
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Cancel"))
+  {
+    ImGui::CloseCurrentPopup();
+  }
+
+  if (mOffsetInputIsInvalid)
+  {
+    ImGui::TextUnformatted("Invalid offset");
+  }
+
+  ImGui::EndPopup();
+}
+
+
+bool HexView::jumpToOffset()
+{
+  // Hex with a 0x prefix, decimal otherwise. Base 0 would read a leading
+  // 0 as octal, so the base is chosen here. Signs and whitespace, which
+  // strtoull() would skip, aren't accepted. Offsets past the end go to
+  // the last row.
+  const auto pInput = mOffsetInput.data();
+  const auto isHex = pInput[0] == '0' && (pInput[1] == 'x' || pInput[1] == 'X');
+  const auto pDigits = isHex ? pInput + 2 : pInput;
+
+  char* pEnd = nullptr;
+  const auto offset = std::strtoull(pDigits, &pEnd, isHex ? 16 : 10);
+  mOffsetInputIsInvalid =
+    !std::isxdigit(static_cast<unsigned char>(*pDigits)) ||
+    pEnd == pDigits || *pEnd != '\0';
+  if (mOffsetInputIsInvalid)
+  {
+    return false;
+  }
+
+  mPendingTopRow = offset / mBytesPerRow;
+  return true;
+}
@@ -0,0 +1,91 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "document.hpp"
+
+#include "imgui.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+
+struct ImGuiWindow;
+
+
+// Shows binary data as a hex dump, with the offset, the bytes in hex, and
+// the bytes as ASCII on each row, like `hexdump -C`. Rows are formatted
+// straight from the document's bytes as they become visible, so there's
+// nothing to prepare up front, whatever the size of the data. Only
+// printable ASCII is shown as is, so no glyphs need to be loaded.
+//
+// ImGui scroll positions are floats, which can't address individual rows
+// of a file that has hundreds of millions of them. The text window
+// therefore only covers a range of rows around the visible ones, which
+// moves along while scrolling. The strip next to the text shows where in
+// the file that is, and allows jumping anywhere by clicking it.
+class HexView {
+public:
+  HexView(std::string windowTitle, Document document);
+
+  std::optional<int> draw(const ImVec2& windowPos, const ImVec2& windowSize);
+
+private:
+  std::uint64_t rowCount() const;
+  std::uint64_t windowRowCount() const;
+  std::size_t rowTextSize(std::size_t bytesPerRow) const;
+  void updateBytesPerRow(float availableWidth);
+  void moveScrollWindow();
+  void drawRows();
+  void formatRow(std::uint64_t row);
+  void drawOverviewStrip(const ImVec2& size);
+  void drawOffsetDialog();
+  bool jumpToOffset();
+
+  std::string mTitle;
+  Document mDocument;
+
+  ImGuiWindow* mpTextWindow = nullptr;
+  float mLastFontSize = 0.0f;
+  std::size_t mBytesPerRow = 16;
+
+  // Number of hex digits needed for the largest offset
+  int mOffsetDigits;
+
+  // The row at the top of the text window's content, and the one at
+  // the top of the screen
+  std::uint64_t mFirstWindowRow = 0;
+  std::uint64_t mTopRow = 0;
+
+  // Row that should be scrolled to the top of the text window
+  std::optional<std::uint64_t> mPendingTopRow;
+
+  // Each visible row is formatted into this, one after another, so that
+  // drawing doesn't need to allocate
+  std::string mRowText;
+
+  std::array<char, 32> mOffsetInput{};
+  bool mOffsetInputIsInvalid = false;
+};
@@ -48,6 +48,7 @@
 #include "imgui_impl_sdl.h"
 
 #include <algorithm>
+#include <unordered_map>
 
 // SDL
 #include <SDL.h>
@@ -67,6 +68,60 @@ static SDL_Cursor*  g_MouseCursors[ImGuiMouseCursor_COUNT] = {};
 static char*        g_ClipboardTextData = NULL;
 static bool         g_MouseCanUseGlobalState = true;
 
+// Patch for TvTextViewer: Game controllers are opened when plugged in and closed when removed,
+// one at a time. Their buttons and axes are tracked via events instead of being queried each frame,
+// and the resulting nav inputs are only recomputed when one of them changed.
+struct ImGui_ImplSDL2_GameController
+{
+    SDL_GameController* Controller;
+    bool                Buttons[SDL_CONTROLLER_BUTTON_MAX];
+    Sint16              Axes[SDL_CONTROLLER_AXIS_MAX];
+};
+
+static std::unordered_map<SDL_JoystickID, ImGui_ImplSDL2_GameController> g_GameControllers;
+static float        g_GamepadNavInputs[ImGuiNavInput_COUNT] = {};
+static bool         g_GamepadNavInputsDirty = true;
+
+static void ImGui_ImplSDL2_OpenGameController(int device_index)
+{
+    if (!SDL_IsGameController(device_index))
+        return;
+
+    // Controllers present at startup are reported by SDL_CONTROLLERDEVICEADDED as well,
+    // so we might see them twice. Opening an open controller again only adds a reference.
+    SDL_GameController* controller = SDL_GameControllerOpen(device_index);
+    if (!controller)
+        return;
+
+    const SDL_JoystickID instance_id = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller));
+    if (g_GameControllers.count(instance_id))
+    {
+        SDL_GameControllerClose(controller);
+        return;
+    }
+
+    // Buttons might already be held down, later changes arrive as events
+    ImGui_ImplSDL2_GameController& state = g_GameControllers[instance_id];
+    state.Controller = controller;
+    for (int button = 0; button < SDL_CONTROLLER_BUTTON_MAX; button++)
+        state.Buttons[button] = SDL_GameControllerGetButton(controller, (SDL_GameControllerButton)button) != 0;
+    for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++)
+        state.Axes[axis] = SDL_GameControllerGetAxis(controller, (SDL_GameControllerAxis)axis);
+
+    g_GamepadNavInputsDirty = true;
+}
+
+static void ImGui_ImplSDL2_CloseGameController(SDL_JoystickID instance_id)
+{
+    auto it = g_GameControllers.find(instance_id);
+    if (it == g_GameControllers.end())
+        return;
+
+    SDL_GameControllerClose(it->second.Controller);
+    g_GameControllers.erase(it);
+    g_GamepadNavInputsDirty = true;
+}
+
 static const char* ImGui_ImplSDL2_GetClipboardText(void*)
 {
     if (g_ClipboardTextData)
@@ -126,6 +181,35 @@ bool ImGui_ImplSDL2_ProcessEvent(const SDL_Event* event)
 #endif
             return true;
         }
+    case SDL_CONTROLLERDEVICEADDED:
+        {
+            ImGui_ImplSDL2_OpenGameController(event->cdevice.which); // Device index
+            return true;
+        }
+    case SDL_CONTROLLERDEVICEREMOVED:
+        {
+            ImGui_ImplSDL2_CloseGameController(event->cdevice.which); // Instance ID
+            return true;
+        }
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+        {
+            auto it = g_GameControllers.find(event->cbutton.which);
+            if (it == g_GameControllers.end() || event->cbutton.button >= SDL_CONTROLLER_BUTTON_MAX)
+                return false;
+            it->second.Buttons[event->cbutton.button] = (event->type == SDL_CONTROLLERBUTTONDOWN);
+            g_GamepadNavInputsDirty = true;
+            return true;
+        }
+    case SDL_CONTROLLERAXISMOTION:
+        {
+            auto it = g_GameControllers.find(event->caxis.which);
+            if (it == g_GameControllers.end() || event->caxis.axis >= SDL_CONTROLLER_AXIS_MAX)
+                return false;
+            it->second.Axes[event->caxis.axis] = event->caxis.value;
+            g_GamepadNavInputsDirty = true;
+            return true;
+        }
     }
     return false;
 }
@@ -182,6 +266,10 @@ static bool ImGui_ImplSDL2_Init(SDL_Window* window)
     g_MouseCursors[ImGuiMouseCursor_Hand] = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_HAND);
     g_MouseCursors[ImGuiMouseCursor_NotAllowed] = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_NO);
 
+    // Open the controllers that are already plugged in
+    for (int device_index = 0; device_index < SDL_NumJoysticks(); device_index++)
+        ImGui_ImplSDL2_OpenGameController(device_index);
+
     // Check and store if we are on Wayland
     g_MouseCanUseGlobalState = strncmp(SDL_GetCurrentVideoDriver(), "wayland", 7) != 0;
 
@@ -237,6 +325,12 @@ void ImGui_ImplSDL2_Shutdown()
     for (ImGuiMouseCursor cursor_n = 0; cursor_n < ImGuiMouseCursor_COUNT; cursor_n++)
         SDL_FreeCursor(g_MouseCursors[cursor_n]);
     memset(g_MouseCursors, 0, sizeof(g_MouseCursors));
+
+    // Close game controllers
+    for (auto& entry : g_GameControllers)
+        SDL_GameControllerClose(entry.second.Controller);
+    g_GameControllers.clear();
+    g_GamepadNavInputsDirty = true;
 }
 
 static void ImGui_ImplSDL2_UpdateMousePosAndButtons()
@@ -304,22 +398,30 @@ static void ImGui_ImplSDL2_UpdateMouseCursor()
     }
 }
 
-static void ImGui_ImplSDL2_UpdateGamepads(const std::vector<SDL_GameController*>& game_controllers)
+static void ImGui_ImplSDL2_UpdateGamepads()
 {
     ImGuiIO& io = ImGui::GetIO();
     memset(io.NavInputs, 0, sizeof(io.NavInputs));
     if ((io.ConfigFlags & ImGuiConfigFlags_NavEnableGamepad) == 0)
         return;
 
+    // ImGui expects the nav inputs to be set every frame, but they only
+    // change when one of the controllers sent an event
+    if (!g_GamepadNavInputsDirty)
+    {
+        memcpy(io.NavInputs, g_GamepadNavInputs, sizeof(g_GamepadNavInputs));
+        return;
+    }
+
     // Update gamepad inputs
     //
-    for (const auto game_controller : game_controllers)
+    for (const auto& entry : g_GameControllers)
     {
+      const auto& state = entry.second;
+
       auto mapButton = [&](const auto nav_no, const auto button_no)
       {
-        const auto is_pressed =
-          SDL_GameControllerGetButton(game_controller, button_no) != 0;
-        const auto value = (is_pressed) ? 1.0f : 0.0f;
+        const auto value = (state.Buttons[button_no]) ? 1.0f : 0.0f;
 
         io.NavInputs[nav_no] = std::clamp(
           io.NavInputs[nav_no] + value, 0.0f, 1.0f);
@@ -328,7 +430,7 @@ static void ImGui_ImplSDL2_UpdateGamepads(const std::vector<SDL_GameController*>
       auto mapAnalog = [&](const auto nav_no, const auto axis_no, const auto v0, const auto v1)
       {
         float vn =
-          (float)(SDL_GameControllerGetAxis(game_controller, axis_no) - v0) /
+          (float)(state.Axes[axis_no] - v0) /
           (float)(v1 - v0);
 
         if (vn > 1.0f) vn = 1.0f;
@@ -358,9 +460,12 @@ static void ImGui_ImplSDL2_UpdateGamepads(const std::vector<SDL_GameController*>
       mapAnalog(ImGuiNavInput_LStickUp,      SDL_CONTROLLER_AXIS_LEFTY, -thumb_dead_zone, -32767);
       mapAnalog(ImGuiNavInput_LStickDown,    SDL_CONTROLLER_AXIS_LEFTY, +thumb_dead_zone, +32767);
     }
+
+    memcpy(g_GamepadNavInputs, io.NavInputs, sizeof(g_GamepadNavInputs));
+    g_GamepadNavInputsDirty = false;
 }
 
-void ImGui_ImplSDL2_NewFrame(SDL_Window* window, const std::vector<SDL_GameController*>& game_controllers)
+void ImGui_ImplSDL2_NewFrame(SDL_Window* window)
 {
     ImGuiIO& io = ImGui::GetIO();
     IM_ASSERT(io.Fonts->IsBuilt() && "Font atlas not built! It is generally built by the renderer backend. Missing call to renderer _NewFrame() function? e.g. ImGui_ImplOpenGL3_NewFrame().");
@@ -386,5 +491,5 @@ void ImGui_ImplSDL2_NewFrame(SDL_Window* window, const std::vector<SDL_GameContr
     ImGui_ImplSDL2_UpdateMouseCursor();
 
     // Update game controllers (if enabled and available)
-    ImGui_ImplSDL2_UpdateGamepads(game_controllers);
+    ImGui_ImplSDL2_UpdateGamepads();
 }
@@ -17,10 +17,6 @@
 #pragma once
 #include "imgui.h"      // IMGUI_IMPL_API
 
-#include <SDL_gamecontroller.h>
-
-#include <vector>
-
 struct SDL_Window;
 typedef union SDL_Event SDL_Event;
 
@@ -29,5 +25,5 @@ IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForVulkan(SDL_Window* window);
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForD3D(SDL_Window* window);
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForMetal(SDL_Window* window);
 IMGUI_IMPL_API void     ImGui_ImplSDL2_Shutdown();
-IMGUI_IMPL_API void     ImGui_ImplSDL2_NewFrame(SDL_Window* window, const std::vector<SDL_GameController*>& game_controllers);
+IMGUI_IMPL_API void     ImGui_ImplSDL2_NewFrame(SDL_Window* window);
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_ProcessEvent(const SDL_Event* event);
@@ -0,0 +1,455 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "json_lines.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+
+// How many lines looksLikeJsonLines() checks
+constexpr std::size_t DETECTION_LINE_COUNT = 16;
+
+
+// A minimal JSON reader, which only needs to understand enough of the
+// syntax to find the top-level fields of an object. Values are validated
+// only as far as needed to skip over them.
+class JsonReader {
+public:
+  explicit JsonReader(const std::string_view text)
+    : mpPosition(text.data())
+    , mpEnd(text.data() + text.size())
+  {
+  }
+
+  bool atEnd()
+  {
+    skipWhitespace();
+    return mpPosition == mpEnd;
+  }
+
+  bool consume(const char c)
+  {
+    skipWhitespace();
+    if (mpPosition != mpEnd && *mpPosition == c)
+    {
+      ++mpPosition;
+      return true;
+    }
+
+    return false;
+  }
+
+  // Expects the opening quote to be consumed already. Returns the raw,
+  // still escaped content of the string.
+  std::optional<std::string_view> readRawString()
+  {
+    const auto pBegin = mpPosition;
+    while (true)
+    {
+      const auto pQuote = static_cast<const char*>(
+        std::memchr(mpPosition, '"', mpEnd - mpPosition));
+      if (!pQuote)
+      {
+        return {};
+      }
+
+      mpPosition = pQuote + 1;
+
+      // The quote is escaped if preceded by an odd number of backslashes
+      auto backslashCount = std::size_t{0};
+      for (auto pChar = pQuote; pChar != pBegin && pChar[-1] == '\\'; --pChar)
+      {
+        ++backslashCount;
+      }
+
+      if (backslashCount % 2 == 0)
+      {
+        return std::string_view(pBegin, pQuote - pBegin);
+      }
+    }
+  }
+
+  // Skips a value of any type, and returns the text it was made of
+  std::optional<std::string_view> skipValue()
+  {
+    skipWhitespace();
+    const auto pBegin = mpPosition;
+
+    if (consume('"'))
+    {
+      if (!readRawString())
+      {
+        return {};
+      }
+    }
+    else if (consume('{') || consume('['))
+    {
+      // Nested objects and arrays aren't looked into, we only need
+      // to find their end
+      auto depth = 1;
+      while (depth > 0)
+      {
+        if (mpPosition == mpEnd)
+        {
+          return {};
+        }
+
+        const auto c = *mpPosition++;
+        if (c == '"')
+        {
+          if (!readRawString())
+          {
+            return {};
+          }
+        }
+        else if (c == '{' || c == '[')
+        {
+          ++depth;
+        }
+        else if (c == '}' || c == ']')
+        {
+          --depth;
+        }
+      }
+    }
+    else
+    {
+      // Numbers, true, false, null
+      while (
+        mpPosition != mpEnd &&
+        *mpPosition != ',' &&
+        *mpPosition != '}' &&
+        *mpPosition != ']' &&
+        !isWhitespace(*mpPosition))
+      {
+        ++mpPosition;
+      }
+
+      if (mpPosition == pBegin)
+      {
+        return {};
+      }
+    }
+
+    return std::string_view(pBegin, mpPosition - pBegin);
+  }
+
+private:
+  static bool isWhitespace(const char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  void skipWhitespace()
+  {
+    while (mpPosition != mpEnd && isWhitespace(*mpPosition))
+    {
+      ++mpPosition;
+    }
+  }
+
+  const char* mpPosition;
+  const char* mpEnd;
+};
+
+
+void appendUtf8(std::string& output, const unsigned codePoint)
+{
+  if (codePoint < 0x80)
+  {
+    output.push_back(static_cast<char>(codePoint));
+  }
+  else if (codePoint < 0x800)
+  {
+    output.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+    output.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+  }
+  else if (codePoint < 0x10000)
+  {
+    output.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+    output.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+    output.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+  }
+  else
+  {
+    output.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+    output.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+    output.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+    output.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+  }
+}
+
+
+std::optional<unsigned> parseHex4(const std::string_view text, const std::size_t offset)
+{
+  if (offset + 4 > text.size())
+  {
+    return {};
+  }
+
+  auto value = 0u;
+  for (auto i = offset; i < offset + 4; ++i)
+  {
+    const auto c = text[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9')
+    {
+      value |= c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+      value |= c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+      value |= c - 'A' + 10;
+    }
+    else
+    {
+      return {};
+    }
+  }
+
+  return value;
+}
+
+
+// Decodes the escape sequences of a JSON string. Invalid escapes are
+// kept as they are, since showing something is more useful than
+// rejecting the whole line.
+std::string unescape(const std::string_view raw)
+{
+  std::string result;
+  result.reserve(raw.size());
+
+  for (std::size_t i = 0; i < raw.size(); ++i)
+  {
+    if (raw[i] != '\\' || i + 1 == raw.size())
+    {
+      result.push_back(raw[i]);
+      continue;
+    }
+
+    const auto c = raw[++i];
+    switch (c)
+    {
+      // Each line of the document is shown as a single row, so
+      // linebreaks and tabs within values become spaces
+      case 'n':
+      case 't':
+      case 'r':
+        result.push_back(' ');
+        break;
+
+      case 'b': result.push_back('\b'); break;
+      case 'f': result.push_back('\f'); break;
+
+      case 'u':
+        {
+          auto codePoint = parseHex4(raw, i + 1);
+          if (!codePoint)
+          {
+            result += "\\u";
+            break;
+          }
+
+          i += 4;
+
+          // Characters outside the BMP are encoded as surrogate pairs
+          if (*codePoint >= 0xD800 && *codePoint < 0xDC00)
+          {
+            const auto low = i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u'
+              ? parseHex4(raw, i + 3)
+              : std::nullopt;
+            if (low && *low >= 0xDC00 && *low < 0xE000)
+            {
+              codePoint = 0x10000 + ((*codePoint - 0xD800) << 10) + (*low - 0xDC00);
+              i += 6;
+            }
+            else
+            {
+              codePoint = 0xFFFD;
+            }
+          }
+          else if (*codePoint >= 0xDC00 && *codePoint < 0xE000)
+          {
+            codePoint = 0xFFFD;
+          }
+
+          appendUtf8(result, *codePoint);
+        }
+        break;
+
+      default:
+        // \" \\ \/ and anything unknown
+        result.push_back(c);
+        break;
+    }
+  }
+
+  return result;
+}
+
+}
+
+
+std::optional<std::vector<std::string>> extractJsonFields(
+  const std::string_view line,
+  const std::vector<std::string>& fieldNames)
+{
+  JsonReader reader{line};
+  if (!reader.consume('{'))
+  {
+    return {};
+  }
+
+  std::vector<std::string> fields(fieldNames.size());
+  if (reader.consume('}'))
+  {
+    return reader.atEnd() ? std::optional{fields} : std::nullopt;
+  }
+
+  do
+  {
+    if (!reader.consume('"'))
+    {
+      return {};
+    }
+
+    const auto name = reader.readRawString();
+    if (!name || !reader.consume(':'))
+    {
+      return {};
+    }
+
+    const auto value = reader.skipValue();
+    if (!value)
+    {
+      return {};
+    }
+
+    // Field names rarely contain escapes, so we compare them raw
+    const auto iField = std::find(fieldNames.begin(), fieldNames.end(), *name);
+    if (iField != fieldNames.end())
+    {
+      auto& field = fields[iField - fieldNames.begin()];
+      field = value->front() == '"'
+        ? unescape(value->substr(1, value->size() - 2))
+        : std::string{*value};
+    }
+  }
+  while (reader.consume(','));
+
+  if (!reader.consume('}') || !reader.atEnd())
+  {
+    return {};
+  }
+
+  return fields;
+}
+
+
+bool looksLikeJsonLines(const Document& document)
+{
+  auto checkedLines = std::size_t{0};
+  for (
+    std::size_t i = 0;
+    i < document.lineCount() && checkedLines < DETECTION_LINE_COUNT;
+    ++i)
+  {
+    const auto line = document.line(i);
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+    {
+      continue;
+    }
+
+    if (!extractJsonFields(line, {}))
+    {
+      return false;
+    }
+
+    ++checkedLines;
+  }
+
+  return checkedLines > 0;
+}
+
+
+JsonFieldCache::JsonFieldCache(
+  std::vector<std::string> fieldNames,
+  const std::size_t capacity)
+  : mFieldNames(std::move(fieldNames))
+  , mCapacity(capacity)
+{
+}
+
+
+const std::vector<std::string>& JsonFieldCache::fieldNames() const
+{
+  return mFieldNames;
+}
+
+
+const std::vector<std::string>& JsonFieldCache::fields(
+  const std::size_t line,
+  const std::string_view text)
+{
+  const auto iEntry = mEntryByLine.find(line);
+  if (iEntry != mEntryByLine.end())
+  {
+    // Move to the front, so that it's dropped last
+    mEntries.splice(mEntries.begin(), mEntries, iEntry->second);
+    if (iEntry->second->textSize == text.size())
+    {
+      return iEntry->second->fields;
+    }
+  }
+  else
+  {
+    if (mEntries.size() >= mCapacity)
+    {
+      mEntryByLine.erase(mEntries.back().line);
+      mEntries.pop_back();
+    }
+
+    mEntries.push_front({line, 0, {}});
+    mEntryByLine.emplace(line, mEntries.begin());
+  }
+
+  auto& entry = mEntries.front();
+  entry.textSize = text.size();
+
+  if (auto fields = extractJsonFields(text, mFieldNames))
+  {
+    entry.fields = std::move(*fields);
+  }
+  else
+  {
+    entry.fields.assign(mFieldNames.size(), {});
+    entry.fields.back() = text;
+  }
+
+  return entry.fields;
+}
@@ -0,0 +1,82 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "document.hpp"
+
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// Extracts the values of the given top-level fields from a line holding
+// a JSON object. Strings are unescaped, other values are returned as they
+// appear in the line (nested objects and arrays included). Missing fields
+// are empty. Returns an empty optional if the line isn't a JSON object.
+//
+// Only the requested fields are decoded. Everything else is skipped,
+// looking for the end of strings with memchr instead of byte by byte.
+std::optional<std::vector<std::string>> extractJsonFields(
+  std::string_view line,
+  const std::vector<std::string>& fieldNames);
+
+// True if the document starts with lines holding JSON objects. Only looks
+// at the first few non-empty lines, so this is cheap for any document size.
+bool looksLikeJsonLines(const Document& document);
+
+
+// Remembers the fields extracted from recently shown lines, so that
+// scrolling through a document parses each line only once. The number of
+// cached lines is bounded: The least recently used ones are dropped first.
+class JsonFieldCache {
+public:
+  JsonFieldCache(std::vector<std::string> fieldNames, std::size_t capacity);
+
+  const std::vector<std::string>& fieldNames() const;
+
+  // Returns the fields of the given line. Lines that aren't JSON objects
+  // are shown in full, in the last field.
+  const std::vector<std::string>& fields(std::size_t line, std::string_view text);
+
+private:
+  struct Entry
+  {
+    std::size_t line;
+
+    // The last line of a script's output can still grow, in which case
+    // it needs to be parsed again
+    std::size_t textSize;
+
+    std::vector<std::string> fields;
+  };
+
+  std::vector<std::string> mFieldNames;
+  std::size_t mCapacity;
+
+  // Most recently used first
+  std::list<Entry> mEntries;
+  std::unordered_map<std::size_t, std::list<Entry>::iterator> mEntryByLine;
+};
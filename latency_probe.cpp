@@ -0,0 +1,385 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "latency_probe.hpp"
+
+#include <GLES2/gl2.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+
+namespace
+{
+
+// Late rendering leaves this much room for frames that take longer than
+// the recent ones
+constexpr auto FRAME_START_MARGIN = std::chrono::microseconds(2000);
+
+// How many frames to look at when estimating how long the next one takes
+constexpr std::size_t RECENT_FRAME_COUNT = 30;
+
+constexpr auto DEFAULT_REFRESH_RATE = 60;
+
+
+// Name of the stage that ends at the given point
+const char* stageName(const LatencyProbe::Point end)
+{
+  switch (end)
+  {
+    case LatencyProbe::Point::Start: return "input queued";
+    case LatencyProbe::Point::NewFrame: return "events + new frame";
+    case LatencyProbe::Point::Draw: return "draw";
+    case LatencyProbe::Point::Render: return "render";
+    case LatencyProbe::Point::Swap: return "swap";
+    case LatencyProbe::Point::Finish: return "swap completion";
+    default: return "";
+  }
+}
+
+
+bool isInputEvent(const SDL_Event& event)
+{
+  switch (event.type)
+  {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+    case SDL_TEXTINPUT:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEMOTION:
+    case SDL_MOUSEWHEEL:
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+    case SDL_CONTROLLERAXISMOTION:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+
+std::chrono::steady_clock::duration frameInterval(SDL_Window* pWindow)
+{
+  SDL_DisplayMode mode;
+  const auto refreshRate =
+    SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(pWindow), &mode) == 0 &&
+    mode.refresh_rate > 0
+      ? mode.refresh_rate
+      : DEFAULT_REFRESH_RATE;
+
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(1.0 / refreshRate));
+}
+
+
+double toMilliseconds(const std::chrono::steady_clock::duration duration)
+{
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}
+
+
+void LatencyProbe::Histogram::add(const Clock::duration duration)
+{
+  const auto bucket = std::min(
+    static_cast<std::size_t>(
+      std::max<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(duration).count(),
+        0) / 250),
+    BUCKET_COUNT);
+
+  ++mBuckets[bucket];
+  ++mCount;
+  mMax = std::max(mMax, duration);
+}
+
+
+double LatencyProbe::Histogram::percentile(const double fraction) const
+{
+  const auto rank = static_cast<std::size_t>(fraction * mCount);
+
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+  {
+    count += mBuckets[i];
+    if (count > rank)
+    {
+      return std::min((i + 1) / 4.0, max());
+    }
+  }
+
+  return max();
+}
+
+
+double LatencyProbe::Histogram::max() const
+{
+  return toMilliseconds(mMax);
+}
+
+
+std::string LatencyProbe::Histogram::format(const std::string& label) const
+{
+  char line[128];
+  std::snprintf(
+    line,
+    sizeof(line),
+    "%-20s %8zu %8.2f %8.2f %8.2f %8.2f\n",
+    label.c_str(),
+    mCount,
+    percentile(0.5),
+    percentile(0.9),
+    percentile(0.99),
+    max());
+
+  std::string result = line;
+
+  // The fine-grained buckets are summarized into a few coarse ones, which
+  // roughly correspond to frames at 60 Hz beyond 16 ms
+  const std::size_t upperLimitsMs[] = {1, 2, 4, 8, 16, 33, 50, 100, 250};
+
+  std::size_t firstBucket = 0;
+  for (std::size_t i = 0; i <= std::size(upperLimitsMs); ++i)
+  {
+    const auto endBucket = i < std::size(upperLimitsMs)
+      ? upperLimitsMs[i] * 4
+      : mBuckets.size();
+
+    std::size_t count = 0;
+    for (auto bucket = firstBucket; bucket < endBucket; ++bucket)
+    {
+      count += mBuckets[bucket];
+    }
+
+    if (count > 0)
+    {
+      char range[32];
+      if (i < std::size(upperLimitsMs))
+      {
+        std::snprintf(range, sizeof(range), "< %zu ms", upperLimitsMs[i]);
+      }
+      else
+      {
+        std::snprintf(range, sizeof(range), ">= %zu ms", upperLimitsMs[i - 1]);
+      }
+
+      const auto barLength = (count * 40 + mCount - 1) / mCount;
+      std::snprintf(
+        line,
+        sizeof(line),
+        "  %10s %8zu %s\n",
+        range,
+        count,
+        std::string(barLength, '#').c_str());
+      result += line;
+    }
+
+    firstBucket = endBucket;
+  }
+
+  return result;
+}
+
+
+LatencyProbe::LatencyProbe(
+  SDL_Window* pWindow,
+  const bool waitForCompletion,
+  const bool renderLate)
+  : mWaitForCompletion(waitForCompletion)
+  , mRenderLate(renderLate)
+  , mFrameInterval(frameInterval(pWindow))
+{
+}
+
+
+void LatencyProbe::waitForFrameStart()
+{
+  if (mRenderLate && mLastPresentTime && !mRecentFrameDurations.empty())
+  {
+    const auto expectedDuration = *std::max_element(
+      mRecentFrameDurations.begin(), mRecentFrameDurations.end());
+    const auto startTime =
+      *mLastPresentTime + mFrameInterval - expectedDuration - FRAME_START_MARGIN;
+
+    // SDL only timestamps events once it picks them up. Doing that
+    // regularly keeps the time spent waiting here visible.
+    while (Clock::now() < startTime)
+    {
+      SDL_PumpEvents();
+      std::this_thread::sleep_for(std::min<Clock::duration>(
+        std::chrono::milliseconds(1), startTime - Clock::now()));
+    }
+  }
+
+  mark(Point::Start);
+}
+
+
+void LatencyProbe::eventReceived(const SDL_Event& event)
+{
+  if (!isInputEvent(event))
+  {
+    return;
+  }
+
+  // Event timestamps come from SDL_GetTicks()
+  const auto age = std::chrono::milliseconds(SDL_GetTicks() - event.common.timestamp);
+  const auto time = Clock::now() - age;
+
+  auto& input = mPoints[static_cast<std::size_t>(Point::Input)];
+  if (!input || time < *input)
+  {
+    input = time;
+  }
+}
+
+
+void LatencyProbe::mark(const Point point)
+{
+  mPoints[static_cast<std::size_t>(point)] = Clock::now();
+}
+
+
+void LatencyProbe::countRenderWork(
+  const std::size_t commandCount,
+  const std::size_t drawCallCount,
+  const std::size_t uploadCount,
+  const std::size_t uploadSize)
+{
+  ++mRenderedFrameCount;
+  mCommandCount += commandCount;
+  mDrawCallCount += drawCallCount;
+  mMaxDrawCallCount = std::max(mMaxDrawCallCount, drawCallCount);
+  mUploadCount += uploadCount;
+  mUploadSize += uploadSize;
+}
+
+
+void LatencyProbe::frameFinished(const bool wasPresented)
+{
+  const auto& input = mPoints[static_cast<std::size_t>(Point::Input)];
+
+  if (!wasPresented)
+  {
+    if (input)
+    {
+      ++mDiscardedInputCount;
+    }
+
+    mPoints = {};
+    return;
+  }
+
+  ++mFrameCount;
+
+  for (std::size_t i = 1; i < POINT_COUNT; ++i)
+  {
+    if (mPoints[i - 1] && mPoints[i])
+    {
+      mStages[i - 1].add(*mPoints[i] - *mPoints[i - 1]);
+    }
+  }
+
+  const auto& start = mPoints[static_cast<std::size_t>(Point::Start)];
+  const auto& render = mPoints[static_cast<std::size_t>(Point::Render)];
+  const auto& finish = mPoints[static_cast<std::size_t>(Point::Finish)];
+  const auto presentTime =
+    finish ? finish : mPoints[static_cast<std::size_t>(Point::Swap)];
+
+  if (input && presentTime)
+  {
+    mEndToEnd.add(*presentTime - *input);
+  }
+
+  if (start && render && presentTime)
+  {
+    mLastPresentTime = presentTime;
+    mRecentFrameDurations.push_back(*render - *start);
+    if (mRecentFrameDurations.size() > RECENT_FRAME_COUNT)
+    {
+      mRecentFrameDurations.pop_front();
+    }
+  }
+
+  mPoints = {};
+}
+
+
+std::string LatencyProbe::report() const
+{
+  char line[160];
+  std::snprintf(
+    line,
+    sizeof(line),
+    "Latency probe: %zu frames presented, %zu inputs without visible change\n"
+    "(rendering %s, %s)\n\n",
+    mFrameCount,
+    mDiscardedInputCount,
+    mWaitForCompletion ? "waiting for completion" : "not waiting for completion",
+    mRenderLate ? "starting frames late" : "starting frames right away");
+
+  std::string result = line;
+
+  std::snprintf(
+    line,
+    sizeof(line),
+    "%-20s %8s %8s %8s %8s %8s\n",
+    "stage (ms)",
+    "count",
+    "p50",
+    "p90",
+    "p99",
+    "max");
+  result += line;
+
+  for (std::size_t i = 0; i < mStages.size(); ++i)
+  {
+    if (mStages[i].count() > 0)
+    {
+      result += mStages[i].format(stageName(static_cast<Point>(i + 1)));
+    }
+  }
+
+  result += mEndToEnd.format("end to end");
+
+  if (mRenderedFrameCount > 0)
+  {
+    const auto frameCount = static_cast<double>(mRenderedFrameCount);
+    std::snprintf(
+      line,
+      sizeof(line),
+      "\nPer rendered frame: %.1f ImGui draw commands, %.1f draw calls "
+      "(max %zu),\n%.1f buffer uploads totalling %.1f KB\n",
+      mCommandCount / frameCount,
+      mDrawCallCount / frameCount,
+      mMaxDrawCallCount,
+      mUploadCount / frameCount,
+      mUploadSize / frameCount / 1024.0);
+    result += line;
+  }
+
+  return result;
+}
+
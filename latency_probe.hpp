@@ -0,0 +1,150 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <SDL.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+
+
+// Measures how long it takes for user input to show up on screen, to find
+// out where the time goes on devices where scrolling feels sluggish.
+//
+// Each frame is timed at a few points along the way, from picking up input
+// events to presenting the result. The time between two consecutive points
+// is a stage, and the time from the oldest input event of a frame until
+// presenting it is the end to end latency. Both are collected in
+// histograms, which report() turns into a human readable summary.
+//
+// GL calls return before the GPU is done, and swapping buffers usually
+// only queues the frame. Waiting for completion (via glFinish) after
+// rendering and swapping shows how long these really take, at the cost of
+// losing some parallelism between CPU and GPU.
+//
+// The renderer also reports how much work it submitted to the GPU for each
+// frame, to tell apart frames that are slow due to the number of draw calls
+// or the amount of geometry uploaded from ones that are slow elsewhere.
+//
+// Optionally, frames are started as late as possible before the next
+// vertical blank, instead of right after the previous one was presented.
+// Input that arrives in the meantime then makes it into the upcoming frame,
+// instead of waiting for a full frame.
+class LatencyProbe {
+public:
+  // Points in time at which a frame is timed, in the order they occur
+  enum class Point
+  {
+    Input,    // Oldest input event handled during the frame
+    Start,    // Started handling events
+    NewFrame, // ImGui::NewFrame() returned
+    Draw,     // The UI was drawn (View::draw())
+    Render,   // Draw data was rendered
+    Swap,     // Buffers were swapped
+    Finish    // The GPU completed the swap (when waiting for completion)
+  };
+
+  LatencyProbe(
+    SDL_Window* pWindow,
+    bool waitForCompletion,
+    bool renderLate);
+
+  bool waitsForCompletion() const { return mWaitForCompletion; }
+
+  // With late rendering, waits until it's time to start the next frame.
+  // Events are still picked up by SDL in the meantime, so that their
+  // timestamps stay accurate.
+  void waitForFrameStart();
+
+  // Must be called for every event handled during the frame
+  void eventReceived(const SDL_Event& event);
+
+  void mark(Point point);
+
+  // Called by the renderer for every frame it renders. Upload size is in
+  // bytes.
+  void countRenderWork(
+    std::size_t commandCount,
+    std::size_t drawCallCount,
+    std::size_t uploadCount,
+    std::size_t uploadSize);
+
+  // Completes the current frame. Frames that weren't presented because
+  // nothing changed are left out of the statistics, and so is the input
+  // that went into them.
+  void frameFinished(bool wasPresented);
+
+  std::string report() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr auto POINT_COUNT = static_cast<std::size_t>(Point::Finish) + 1;
+
+  // Collects durations in buckets of a quarter of a millisecond. That's a
+  // lot finer than what's needed to tell frames apart, but allows for
+  // precise percentiles without keeping every sample around.
+  class Histogram {
+  public:
+    void add(Clock::duration duration);
+
+    std::size_t count() const { return mCount; }
+    double percentile(double fraction) const;
+    double max() const;
+    std::string format(const std::string& label) const;
+
+  private:
+    static constexpr std::size_t BUCKET_COUNT = 4 * 250;
+
+    std::array<std::uint32_t, BUCKET_COUNT + 1> mBuckets{};
+    std::size_t mCount = 0;
+    Clock::duration mMax{};
+  };
+
+  bool mWaitForCompletion;
+  bool mRenderLate;
+
+  std::array<std::optional<Clock::time_point>, POINT_COUNT> mPoints;
+  std::array<Histogram, POINT_COUNT - 1> mStages;
+  Histogram mEndToEnd;
+  std::size_t mFrameCount = 0;
+  std::size_t mDiscardedInputCount = 0;
+
+  // Totals over all rendered frames, from countRenderWork()
+  std::size_t mRenderedFrameCount = 0;
+  std::size_t mCommandCount = 0;
+  std::size_t mDrawCallCount = 0;
+  std::size_t mMaxDrawCallCount = 0;
+  std::size_t mUploadCount = 0;
+  std::size_t mUploadSize = 0;
+
+  // For late rendering: When the last frame was presented, and how long
+  // the most recent frames took from start to presenting
+  Clock::duration mFrameInterval;
+  std::optional<Clock::time_point> mLastPresentTime;
+  std::deque<Clock::duration> mRecentFrameDurations;
+};
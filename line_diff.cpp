@@ -0,0 +1,620 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "line_diff.hpp"
+
+#include "document.hpp"
+
+#include <cstdint>
+#include <limits>
+
+
+namespace
+{
+
+// Regions with more lines than this are split with Myers' algorithm first,
+// which keeps the memory used for indexing them bounded
+constexpr std::size_t MAX_INDEXED_LINES = 4 * 1024 * 1024;
+
+// Myers' algorithm stops looking for the minimal diff once it has
+// compared about this many lines, but looks at least this many edits deep.
+// For inputs that are different throughout, like shuffled lines, it stops
+// splitting regions altogether once the total comparisons reach the
+// second limit, showing the remaining regions as changed entirely.
+constexpr std::uint64_t MAX_SPLIT_WORK = 64 * 1024 * 1024;
+constexpr std::uint64_t MAX_TOTAL_SPLIT_WORK = 1024 * 1024 * 1024;
+constexpr std::ptrdiff_t MIN_SPLIT_COST = 256;
+
+constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+
+// Half-open ranges of lines on both sides
+struct Region
+{
+  std::size_t leftBegin;
+  std::size_t leftEnd;
+  std::size_t rightBegin;
+  std::size_t rightEnd;
+};
+
+
+struct Match
+{
+  std::size_t left;
+  std::size_t right;
+  std::size_t length;
+};
+
+
+class Differ {
+public:
+  Differ(std::vector<std::uint64_t> left, std::vector<std::uint64_t> right)
+    : mLeft(std::move(left))
+    , mRight(std::move(right))
+  {
+  }
+
+  // Returns the equal parts of both sides, in document order
+  std::vector<Match> run()
+  {
+    // Processed depth first, in no particular order. Regions are
+    // independent of each other, and matches are sorted in the end.
+    std::vector<Region> pending{{0, mLeft.size(), 0, mRight.size()}};
+
+    while (!pending.empty())
+    {
+      auto region = pending.back();
+      pending.pop_back();
+
+      trimEqualLines(region);
+      if (
+        region.leftBegin == region.leftEnd ||
+        region.rightBegin == region.rightEnd)
+      {
+        continue;
+      }
+
+      auto hasCommonLines = true;
+      const auto lineCount =
+        (region.leftEnd - region.leftBegin) +
+        (region.rightEnd - region.rightBegin);
+      if (lineCount <= MAX_INDEXED_LINES)
+      {
+        const auto anchors = findAnchors(region, hasCommonLines);
+        if (!anchors.empty())
+        {
+          // Lines between anchors are diffed on their own. Equal lines
+          // next to an anchor are picked up by trimming them.
+          auto leftBegin = region.leftBegin;
+          auto rightBegin = region.rightBegin;
+          for (const auto& anchor : anchors)
+          {
+            mMatches.push_back(anchor);
+            pending.push_back({leftBegin, anchor.left, rightBegin, anchor.right});
+            leftBegin = anchor.left + 1;
+            rightBegin = anchor.right + 1;
+          }
+
+          pending.push_back(
+            {leftBegin, region.leftEnd, rightBegin, region.rightEnd});
+          continue;
+        }
+      }
+
+      // Without any lines in common, the whole region is one change
+      if (!hasCommonLines)
+      {
+        continue;
+      }
+
+      const auto split = mTotalSplitWork < MAX_TOTAL_SPLIT_WORK
+        ? findSplit(region)
+        : std::nullopt;
+      if (split)
+      {
+        pending.push_back({
+          region.leftBegin, split->first, region.rightBegin, split->second});
+        pending.push_back({
+          split->first, region.leftEnd, split->second, region.rightEnd});
+      }
+    }
+
+    std::sort(
+      mMatches.begin(),
+      mMatches.end(),
+      [](const Match& a, const Match& b) { return a.left < b.left; });
+    return std::move(mMatches);
+  }
+
+private:
+  void trimEqualLines(Region& region)
+  {
+    const auto begin = region;
+    while (
+      region.leftBegin < region.leftEnd &&
+      region.rightBegin < region.rightEnd &&
+      mLeft[region.leftBegin] == mRight[region.rightBegin])
+    {
+      ++region.leftBegin;
+      ++region.rightBegin;
+    }
+
+    if (region.leftBegin > begin.leftBegin)
+    {
+      mMatches.push_back({
+        begin.leftBegin,
+        begin.rightBegin,
+        region.leftBegin - begin.leftBegin});
+    }
+
+    while (
+      region.leftBegin < region.leftEnd &&
+      region.rightBegin < region.rightEnd &&
+      mLeft[region.leftEnd - 1] == mRight[region.rightEnd - 1])
+    {
+      --region.leftEnd;
+      --region.rightEnd;
+    }
+
+    if (region.leftEnd < begin.leftEnd)
+    {
+      mMatches.push_back({
+        region.leftEnd, region.rightEnd, begin.leftEnd - region.leftEnd});
+    }
+  }
+
+
+  // Finds the lines that occur exactly once on both sides, and returns the
+  // longest sequence of them that is in the same order on both sides.
+  // hasCommonLines tells whether there were any equal lines at all, even
+  // if not unique.
+  std::vector<Match> findAnchors(const Region& region, bool& hasCommonLines)
+  {
+    struct Entry
+    {
+      std::uint64_t hash;
+      std::uint32_t leftCount;
+      std::uint32_t rightCount;
+      std::size_t leftLine;
+      std::size_t rightLine;
+    };
+
+    // Counts occurrences on both sides, using open addressing
+    const auto lineCount =
+      (region.leftEnd - region.leftBegin) + (region.rightEnd - region.rightBegin);
+    std::size_t tableSize = 16;
+    while (tableSize < lineCount * 2)
+    {
+      tableSize *= 2;
+    }
+
+    std::vector<std::uint32_t> table(tableSize, NONE);
+    std::vector<Entry> entries;
+
+    auto findEntry = [&](const std::uint64_t hash) -> Entry&
+    {
+      // The hashes are FNV based, mixing them once more spreads runs of
+      // similar values across the table
+      auto slot = static_cast<std::size_t>(
+        (hash * std::uint64_t{0x9e3779b97f4a7c15}) >> 32) & (tableSize - 1);
+      while (table[slot] != NONE && entries[table[slot]].hash != hash)
+      {
+        slot = (slot + 1) & (tableSize - 1);
+      }
+
+      if (table[slot] == NONE)
+      {
+        table[slot] = static_cast<std::uint32_t>(entries.size());
+        entries.push_back({hash, 0, 0, 0, 0});
+      }
+
+      return entries[table[slot]];
+    };
+
+    for (auto line = region.leftBegin; line < region.leftEnd; ++line)
+    {
+      auto& entry = findEntry(mLeft[line]);
+      ++entry.leftCount;
+      entry.leftLine = line;
+    }
+
+    for (auto line = region.rightBegin; line < region.rightEnd; ++line)
+    {
+      auto& entry = findEntry(mRight[line]);
+      ++entry.rightCount;
+      entry.rightLine = line;
+    }
+
+    // Unique lines in left order. Their right lines are what needs to be
+    // in increasing order.
+    hasCommonLines = false;
+    std::vector<Match> candidates;
+    for (auto line = region.leftBegin; line < region.leftEnd; ++line)
+    {
+      const auto& entry = findEntry(mLeft[line]);
+      hasCommonLines = hasCommonLines || entry.rightCount > 0;
+
+      if (entry.leftCount == 1 && entry.rightCount == 1)
+      {
+        candidates.push_back({entry.leftLine, entry.rightLine, 1});
+      }
+    }
+
+    // Longest increasing subsequence via patience sorting: Each pile's top
+    // is the smallest right line that ends an increasing sequence of
+    // that length. Each candidate remembers the top of the pile to its
+    // left at the time it was placed, which is its predecessor.
+    std::vector<std::size_t> pileTops;
+    std::vector<std::size_t> predecessors(candidates.size(), NONE);
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+    {
+      const auto iPile = std::lower_bound(
+        pileTops.begin(),
+        pileTops.end(),
+        candidates[i].right,
+        [&](const std::size_t candidate, const std::size_t right)
+        {
+          return candidates[candidate].right < right;
+        });
+
+      if (iPile != pileTops.begin())
+      {
+        predecessors[i] = *std::prev(iPile);
+      }
+
+      if (iPile == pileTops.end())
+      {
+        pileTops.push_back(i);
+      }
+      else
+      {
+        *iPile = i;
+      }
+    }
+
+    std::vector<Match> anchors;
+    if (!pileTops.empty())
+    {
+      for (auto i = pileTops.back(); i != NONE; i = predecessors[i])
+      {
+        anchors.push_back(candidates[i]);
+      }
+
+      std::reverse(anchors.begin(), anchors.end());
+    }
+
+    return anchors;
+  }
+
+
+  // Finds a point that the (close to) minimal diff of the region passes
+  // through, using Myers' algorithm from both ends until the paths meet.
+  // This is a port of Git's xdl_split(), which works with diagonals in
+  // region coordinates: Diagonal d contains the points with left - right
+  // equal to d. Returns an empty optional if the region can't be split,
+  // which shouldn't happen after trimming equal lines.
+  std::optional<std::pair<std::size_t, std::size_t>> findSplit(
+    const Region& region)
+  {
+    using Index = std::ptrdiff_t;
+
+    const auto leftBegin = static_cast<Index>(region.leftBegin);
+    const auto leftEnd = static_cast<Index>(region.leftEnd);
+    const auto rightBegin = static_cast<Index>(region.rightBegin);
+    const auto rightEnd = static_cast<Index>(region.rightEnd);
+
+    const auto minDiagonal = leftBegin - rightEnd;
+    const auto maxDiagonal = leftEnd - rightBegin;
+    const auto forwardMid = leftBegin - rightBegin;
+    const auto backwardMid = leftEnd - rightEnd;
+    const auto isOdd = ((forwardMid - backwardMid) & 1) != 0;
+
+    // Lines compared so far, including each diagonal looked at
+    std::uint64_t work = 0;
+
+    // Furthest left line reached on each diagonal, going forward and
+    // backward. Indices are offset so that all diagonals, plus one on
+    // each side, fit.
+    const auto offset = -minDiagonal + 1;
+    std::vector<Index> forwardStorage(maxDiagonal - minDiagonal + 3);
+    std::vector<Index> backwardStorage(maxDiagonal - minDiagonal + 3);
+    const auto forward = forwardStorage.data() + offset;
+    const auto backward = backwardStorage.data() + offset;
+
+    auto forwardMin = forwardMid;
+    auto forwardMax = forwardMid;
+    auto backwardMin = backwardMid;
+    auto backwardMax = backwardMid;
+    forward[forwardMid] = leftBegin;
+    backward[backwardMid] = leftEnd;
+
+    for (Index cost = 1; ; ++cost)
+    {
+      if (forwardMin > minDiagonal)
+      {
+        forward[--forwardMin - 1] = -1;
+      }
+      else
+      {
+        ++forwardMin;
+      }
+
+      if (forwardMax < maxDiagonal)
+      {
+        forward[++forwardMax + 1] = -1;
+      }
+      else
+      {
+        --forwardMax;
+      }
+
+      for (auto d = forwardMax; d >= forwardMin; d -= 2)
+      {
+        auto left = forward[d - 1] >= forward[d + 1]
+          ? forward[d - 1] + 1
+          : forward[d + 1];
+        auto right = left - d;
+        const auto snakeBegin = left;
+
+        while (
+          left < leftEnd &&
+          right < rightEnd &&
+          mLeft[left] == mRight[right])
+        {
+          ++left;
+          ++right;
+        }
+
+        work += left - snakeBegin + 1;
+        mTotalSplitWork += left - snakeBegin + 1;
+        forward[d] = left;
+
+        if (
+          isOdd &&
+          backwardMin <= d && d <= backwardMax &&
+          backward[d] <= left)
+        {
+          return splitAt(region, left, right);
+        }
+      }
+
+      if (backwardMin > minDiagonal)
+      {
+        backward[--backwardMin - 1] = std::numeric_limits<Index>::max();
+      }
+      else
+      {
+        ++backwardMin;
+      }
+
+      if (backwardMax < maxDiagonal)
+      {
+        backward[++backwardMax + 1] = std::numeric_limits<Index>::max();
+      }
+      else
+      {
+        --backwardMax;
+      }
+
+      for (auto d = backwardMax; d >= backwardMin; d -= 2)
+      {
+        auto left = backward[d - 1] < backward[d + 1]
+          ? backward[d - 1]
+          : backward[d + 1] - 1;
+        auto right = left - d;
+        const auto snakeEnd = left;
+
+        while (
+          left > leftBegin &&
+          right > rightBegin &&
+          mLeft[left - 1] == mRight[right - 1])
+        {
+          --left;
+          --right;
+        }
+
+        work += snakeEnd - left + 1;
+        mTotalSplitWork += snakeEnd - left + 1;
+        backward[d] = left;
+
+        if (
+          !isOdd &&
+          forwardMin <= d && d <= forwardMax &&
+          left <= forward[d])
+        {
+          return splitAt(region, left, right);
+        }
+      }
+
+      if (cost < MIN_SPLIT_COST || work < MAX_SPLIT_WORK)
+      {
+        continue;
+      }
+
+      // Taking too long. Split where one of the directions made the most
+      // progress, counting lines on both sides.
+      Index forwardBest = -1;
+      Index forwardBestLeft = -1;
+      for (auto d = forwardMax; d >= forwardMin; d -= 2)
+      {
+        auto left = std::min(forward[d], leftEnd);
+        auto right = left - d;
+        if (right > rightEnd)
+        {
+          left = rightEnd + d;
+          right = rightEnd;
+        }
+
+        if (forwardBest < left + right)
+        {
+          forwardBest = left + right;
+          forwardBestLeft = left;
+        }
+      }
+
+      auto backwardBest = std::numeric_limits<Index>::max();
+      Index backwardBestLeft = leftEnd;
+      for (auto d = backwardMax; d >= backwardMin; d -= 2)
+      {
+        auto left = std::max(leftBegin, backward[d]);
+        auto right = left - d;
+        if (right < rightBegin)
+        {
+          left = rightBegin + d;
+          right = rightBegin;
+        }
+
+        if (left + right < backwardBest)
+        {
+          backwardBest = left + right;
+          backwardBestLeft = left;
+        }
+      }
+
+      if (
+        (leftEnd + rightEnd) - backwardBest <
+        forwardBest - (leftBegin + rightBegin))
+      {
+        return splitAt(
+          region, forwardBestLeft, forwardBest - forwardBestLeft);
+      }
+
+      return splitAt(
+        region, backwardBestLeft, backwardBest - backwardBestLeft);
+    }
+  }
+
+
+  static std::optional<std::pair<std::size_t, std::size_t>> splitAt(
+    const Region& region,
+    const std::ptrdiff_t left,
+    const std::ptrdiff_t right)
+  {
+    const auto leftSplit = static_cast<std::size_t>(left);
+    const auto rightSplit = static_cast<std::size_t>(right);
+
+    // Splitting at either corner wouldn't make the region any smaller
+    if (
+      (leftSplit == region.leftBegin && rightSplit == region.rightBegin) ||
+      (leftSplit == region.leftEnd && rightSplit == region.rightEnd))
+    {
+      return {};
+    }
+
+    return std::pair{leftSplit, rightSplit};
+  }
+
+
+  std::vector<std::uint64_t> mLeft;
+  std::vector<std::uint64_t> mRight;
+  std::vector<Match> mMatches;
+  std::uint64_t mTotalSplitWork = 0;
+};
+
+
+std::vector<std::uint64_t> lineHashes(const Document& document)
+{
+  std::vector<std::uint64_t> hashes(document.lineCount());
+  for (std::size_t i = 0; i < hashes.size(); ++i)
+  {
+    hashes[i] = document.lineHash(i);
+  }
+
+  return hashes;
+}
+
+}
+
+
+LineDiff::LineDiff(const Document& left, const Document& right)
+{
+  const auto leftLineCount = left.lineCount();
+  const auto rightLineCount = right.lineCount();
+
+  const auto matches =
+    Differ{lineHashes(left), lineHashes(right)}.run();
+
+  // Everything between two matches is a hunk
+  std::size_t leftLine = 0;
+  std::size_t rightLine = 0;
+  std::size_t row = 0;
+
+  auto addHunk = [&](const std::size_t leftEnd, const std::size_t rightEnd)
+  {
+    if (leftEnd == leftLine && rightEnd == rightLine)
+    {
+      return;
+    }
+
+    const auto hunk =
+      Hunk{leftLine, leftEnd - leftLine, rightLine, rightEnd - rightLine, row};
+    mHunks.push_back(hunk);
+    row += hunk.rowCount();
+  };
+
+  for (const auto& match : matches)
+  {
+    addHunk(match.left, match.right);
+    row += match.length;
+    leftLine = match.left + match.length;
+    rightLine = match.right + match.length;
+  }
+
+  addHunk(leftLineCount, rightLineCount);
+  mRowCount = row;
+}
+
+
+LineDiff::Row LineDiff::row(const std::size_t index) const
+{
+  // Last hunk starting at or before the row
+  const auto iNextHunk = std::upper_bound(
+    mHunks.begin(),
+    mHunks.end(),
+    index,
+    [](const std::size_t row, const Hunk& hunk) { return row < hunk.firstRow; });
+
+  if (iNextHunk == mHunks.begin())
+  {
+    return {index, index, false};
+  }
+
+  const auto& hunk = *std::prev(iNextHunk);
+  const auto offset = index - hunk.firstRow;
+  if (offset < hunk.rowCount())
+  {
+    return {
+      offset < hunk.leftCount
+        ? std::optional<std::size_t>{hunk.leftFirst + offset}
+        : std::nullopt,
+      offset < hunk.rightCount
+        ? std::optional<std::size_t>{hunk.rightFirst + offset}
+        : std::nullopt,
+      true};
+  }
+
+  // Equal lines after the hunk
+  const auto equalOffset = offset - hunk.rowCount();
+  return {
+    hunk.leftFirst + hunk.leftCount + equalOffset,
+    hunk.rightFirst + hunk.rightCount + equalOffset,
+    false};
+}
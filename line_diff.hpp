@@ -0,0 +1,85 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+
+class Document;
+
+
+// Line-level differences between two documents, laid out as rows for
+// showing them side by side. Lines are compared by their hashes (see
+// Document::hashLines()), so both documents need to hash their lines,
+// in the same mode. The text itself isn't compared, the hashes are wide
+// enough for different lines to practically never look equal.
+//
+// The diff is computed like a patience diff: Lines that occur exactly once
+// on both sides, and in the same order, serve as anchors, and the regions
+// between anchors are diffed recursively. Regions without such lines, like
+// ones only differing in blank lines or repeated messages, are split using
+// Myers' algorithm instead, in its linear space variant. The same goes for
+// regions that are too large to index. Myers' algorithm can take a long
+// time on inputs with many differences, so it gives up looking for the
+// minimal diff after a while, settling for a good one.
+//
+// Only the changed regions (hunks) are kept. Rows between hunks show
+// equal lines next to each other. A hunk takes up as many rows as its
+// larger side has lines, with the other side padded with empty rows.
+class LineDiff {
+public:
+  struct Hunk
+  {
+    std::size_t leftFirst;
+    std::size_t leftCount;
+    std::size_t rightFirst;
+    std::size_t rightCount;
+
+    std::size_t firstRow;
+
+    std::size_t rowCount() const { return std::max(leftCount, rightCount); }
+  };
+
+  // The line shown on each side of a row. Empty on the side of a hunk
+  // that has fewer lines.
+  struct Row
+  {
+    std::optional<std::size_t> leftLine;
+    std::optional<std::size_t> rightLine;
+    bool isChanged;
+  };
+
+  LineDiff(const Document& left, const Document& right);
+
+  std::size_t rowCount() const { return mRowCount; }
+  Row row(std::size_t index) const;
+
+  // Hunks in document order
+  const std::vector<Hunk>& hunks() const { return mHunks; }
+
+private:
+  std::vector<Hunk> mHunks;
+  std::size_t mRowCount;
+};
@@ -0,0 +1,191 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "line_folding.hpp"
+
+#include "document.hpp"
+
+#include <algorithm>
+
+
+void LineFolding::update(const Document& document)
+{
+  mLineCount = document.lineCount();
+  const auto hashedLineCount = document.hashedLineCount();
+
+  // The document drops repeats of its last complete line as they come
+  // in, so that line's count can grow after it was added to a run
+  if (
+    !mRuns.empty() &&
+    mRuns.back().firstLine + mRuns.back().lineCount == mCheckedLineCount)
+  {
+    mRuns.back().repeatCount +=
+      document.repeatCount(mCheckedLineCount - 1) - mLastLineRepeatCount;
+  }
+
+  for (auto line = std::max<std::size_t>(mCheckedLineCount, 1);
+    line < hashedLineCount;
+    ++line)
+  {
+    if (document.lineHash(line) != document.lineHash(line - 1))
+    {
+      continue;
+    }
+
+    // Start a new run with the previous line, unless that's already
+    // the end of the last run
+    if (
+      mRuns.empty() ||
+      mRuns.back().firstLine + mRuns.back().lineCount != line)
+    {
+      mRuns.push_back({
+        line - 1, 1, document.repeatCount(line - 1), hiddenLineCount(), false});
+    }
+
+    ++mRuns.back().lineCount;
+    mRuns.back().repeatCount += document.repeatCount(line);
+  }
+
+  mCheckedLineCount = hashedLineCount;
+  mLastLineRepeatCount =
+    hashedLineCount > 0 ? document.repeatCount(hashedLineCount - 1) : 0;
+}
+
+
+std::size_t LineFolding::rowCount() const
+{
+  return mLineCount - hiddenLineCount();
+}
+
+
+std::size_t LineFolding::lineAtRow(const std::size_t row) const
+{
+  const auto iNext = std::upper_bound(
+    mRuns.begin(),
+    mRuns.end(),
+    row,
+    [](const std::size_t value, const Run& run) { return value < run.firstRow(); });
+  if (iNext == mRuns.begin())
+  {
+    return row;
+  }
+
+  // Rows after the first one of a collapsed run skip its hidden lines
+  const auto& run = *std::prev(iNext);
+  const auto hiddenLines = row > run.firstRow() ? run.hiddenLines() : 0;
+  return row + run.hiddenLinesBefore + hiddenLines;
+}
+
+
+std::size_t LineFolding::rowOfLine(const std::size_t line) const
+{
+  const auto iNext = std::upper_bound(
+    mRuns.begin(),
+    mRuns.end(),
+    line,
+    [](const std::size_t value, const Run& run) { return value < run.firstLine; });
+  if (iNext == mRuns.begin())
+  {
+    return line;
+  }
+
+  // Lines hidden in a collapsed run belong to its first row
+  const auto& run = *std::prev(iNext);
+  const auto hiddenLines = std::min(line - run.firstLine, run.hiddenLines());
+  return line - run.hiddenLinesBefore - hiddenLines;
+}
+
+
+std::size_t LineFolding::repeatCount(
+  const Document& document,
+  const std::size_t line) const
+{
+  const auto pRun = runContaining(line);
+  if (pRun && !pRun->isExpanded && pRun->firstLine == line)
+  {
+    return pRun->repeatCount;
+  }
+
+  return document.repeatCount(line);
+}
+
+
+bool LineFolding::isHidden(const std::size_t line) const
+{
+  const auto pRun = runContaining(line);
+  return pRun && !pRun->isExpanded && pRun->firstLine != line;
+}
+
+
+std::optional<bool> LineFolding::isExpanded(const std::size_t line) const
+{
+  if (const auto pRun = runContaining(line))
+  {
+    return pRun->isExpanded;
+  }
+
+  return {};
+}
+
+
+void LineFolding::toggle(const std::size_t line)
+{
+  const auto pRun = runContaining(line);
+  if (!pRun)
+  {
+    return;
+  }
+
+  const auto index = static_cast<std::size_t>(pRun - mRuns.data());
+  mRuns[index].isExpanded = !mRuns[index].isExpanded;
+
+  // The number of hidden lines changed for all runs after this one
+  for (auto i = index + 1; i < mRuns.size(); ++i)
+  {
+    mRuns[i].hiddenLinesBefore =
+      mRuns[i - 1].hiddenLinesBefore + mRuns[i - 1].hiddenLines();
+  }
+}
+
+
+const LineFolding::Run* LineFolding::runContaining(const std::size_t line) const
+{
+  const auto iNext = std::upper_bound(
+    mRuns.begin(),
+    mRuns.end(),
+    line,
+    [](const std::size_t value, const Run& run) { return value < run.firstLine; });
+  if (iNext == mRuns.begin())
+  {
+    return nullptr;
+  }
+
+  const auto& run = *std::prev(iNext);
+  return line < run.firstLine + run.lineCount ? &run : nullptr;
+}
+
+
+std::size_t LineFolding::hiddenLineCount() const
+{
+  return mRuns.empty()
+    ? 0
+    : mRuns.back().hiddenLinesBefore + mRuns.back().hiddenLines();
+}
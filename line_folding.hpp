@@ -0,0 +1,89 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+
+class Document;
+
+
+// Shows runs of repeated lines as a single row each. Two consecutive lines
+// are repeats when they have the same hash (see Document::hashLines()).
+// Runs start out collapsed, and can be expanded to show all of their lines.
+//
+// The view lays out rows, while the document stores lines. Converting
+// between the two is a binary search over the runs, which works out since
+// each run remembers how many lines are hidden by collapsed runs before it.
+class LineFolding {
+public:
+  // Looks at the lines that were hashed since the last call, adding them
+  // to existing or new runs. Needs to be called when the document grows.
+  void update(const Document& document);
+
+  std::size_t rowCount() const;
+  std::size_t lineAtRow(std::size_t row) const;
+  std::size_t rowOfLine(std::size_t line) const;
+
+  // Number of lines shown by the given line's row, including repeats
+  // dropped by the document. 1 for lines that aren't repeated.
+  std::size_t repeatCount(const Document& document, std::size_t line) const;
+
+  // True if the line is part of a collapsed run, but not its first line
+  bool isHidden(std::size_t line) const;
+
+  // Tells whether the run containing the line is expanded. Returns an
+  // empty optional for lines that aren't part of any run.
+  std::optional<bool> isExpanded(std::size_t line) const;
+
+  // Expands the run containing the given line, or collapses it if it's
+  // already expanded. Does nothing for lines that aren't part of a run.
+  void toggle(std::size_t line);
+
+private:
+  struct Run
+  {
+    std::size_t firstLine;
+    std::size_t lineCount;
+
+    // Total number of repeats, including ones dropped by the document
+    std::size_t repeatCount;
+
+    // Lines hidden by collapsed runs before this one
+    std::size_t hiddenLinesBefore;
+    bool isExpanded;
+
+    std::size_t firstRow() const { return firstLine - hiddenLinesBefore; }
+    std::size_t hiddenLines() const { return isExpanded ? 0 : lineCount - 1; }
+  };
+
+  const Run* runContaining(std::size_t line) const;
+
+  std::size_t hiddenLineCount() const;
+
+  std::vector<Run> mRuns;
+  std::size_t mLineCount = 0;
+  std::size_t mCheckedLineCount = 0;
+  std::size_t mLastLineRepeatCount = 0;
+};
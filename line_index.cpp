@@ -0,0 +1,335 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "line_index.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+
+namespace
+{
+
+constexpr std::size_t LINES_PER_BLOCK = 64;
+
+// Identifies the cache file format. Also guards against using a cache
+// file written on a machine with different endianness.
+constexpr char CACHE_MAGIC[8] = {'T', 'V', 'I', 'D', 'X', '0', '0', '1'};
+constexpr std::uint64_t BYTE_ORDER_MARK = 0x0102030405060708ull;
+
+
+struct CacheHeader
+{
+  char magic[8];
+  std::uint64_t byteOrderMark;
+  std::uint64_t device;
+  std::uint64_t inode;
+  std::uint64_t size;
+  std::int64_t modificationTime;
+  std::uint64_t headHash;
+  std::uint64_t lineCount;
+  std::uint64_t blockCount;
+  std::uint64_t deltaBytes;
+};
+
+
+void appendVarint(std::vector<std::uint8_t>& output, std::uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    output.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+
+  output.push_back(static_cast<std::uint8_t>(value));
+}
+
+
+std::uint64_t readVarint(const std::uint8_t*& pInput)
+{
+  std::uint64_t value = 0;
+  for (auto shift = 0; ; shift += 7)
+  {
+    const auto byte = *pInput++;
+    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80))
+    {
+      return value;
+    }
+  }
+}
+
+
+// Like readVarint(), but for data that may be damaged. Returns false
+// instead of reading past the end, or when the value doesn't fit.
+bool readCheckedVarint(
+  const std::uint8_t*& pInput,
+  const std::uint8_t* const pEnd,
+  std::uint64_t& value)
+{
+  value = 0;
+  for (auto shift = 0; shift < 64 && pInput != pEnd; shift += 7)
+  {
+    const auto byte = *pInput++;
+    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}
+
+
+LineIndex::LineIndex()
+{
+  addLineStart(0);
+}
+
+
+void LineIndex::addLineStart(const std::uint64_t offset)
+{
+  if (mLineCount % LINES_PER_BLOCK == 0)
+  {
+    mBlocks.push_back({offset, mDeltas.size()});
+  }
+  else
+  {
+    appendVarint(mDeltas, offset - mLastLineStart);
+  }
+
+  mLastLineStart = offset;
+  ++mLineCount;
+}
+
+
+std::size_t LineIndex::lineCount() const
+{
+  return mLineCount;
+}
+
+
+std::uint64_t LineIndex::lineStart(const std::size_t line) const
+{
+  const auto& block = blocks()[line / LINES_PER_BLOCK];
+
+  auto offset = block.firstLineStart;
+  auto pDelta = deltas() + block.deltaOffset;
+  for (auto i = line % LINES_PER_BLOCK; i > 0; --i)
+  {
+    offset += readVarint(pDelta);
+  }
+
+  return offset;
+}
+
+
+std::size_t LineIndex::lineContaining(const std::uint64_t offset) const
+{
+  // Find the last block starting at or before the offset, then walk
+  // through the lines of that block
+  const auto blockCount = (mLineCount + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+  const auto pBlocksEnd = blocks() + blockCount;
+  const auto pBlock = std::upper_bound(
+    blocks(),
+    pBlocksEnd,
+    offset,
+    [](const std::uint64_t value, const Block& block)
+    {
+      return value < block.firstLineStart;
+    }) - 1;
+
+  auto line = static_cast<std::size_t>(pBlock - blocks()) * LINES_PER_BLOCK;
+  auto lineStart = pBlock->firstLineStart;
+  auto pDelta = deltas() + pBlock->deltaOffset;
+  while (line + 1 < mLineCount && (line + 1) % LINES_PER_BLOCK != 0)
+  {
+    const auto nextLineStart = lineStart + readVarint(pDelta);
+    if (nextLineStart > offset)
+    {
+      break;
+    }
+
+    lineStart = nextLineStart;
+    ++line;
+  }
+
+  return line;
+}
+
+bool LineIndex::save(const std::string& path, const FileIdentity& source) const
+{
+  CacheHeader header;
+  std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.byteOrderMark = BYTE_ORDER_MARK;
+  header.device = source.device;
+  header.inode = source.inode;
+  header.size = source.size;
+  header.modificationTime = source.modificationTime;
+  header.headHash = source.headHash;
+  header.lineCount = mLineCount;
+  header.blockCount = mBlocks.size();
+  header.deltaBytes = mDeltas.size();
+
+  // Write to a temporary file first, so that a concurrently running
+  // viewer never sees a partially written index
+  const auto tempPath = path + ".tmp";
+  const auto pFile = std::fopen(tempPath.c_str(), "wb");
+  if (!pFile)
+  {
+    return false;
+  }
+
+  const auto success =
+    std::fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+    std::fwrite(blocks(), sizeof(Block), mBlocks.size(), pFile) == mBlocks.size() &&
+    std::fwrite(deltas(), 1, mDeltas.size(), pFile) == mDeltas.size();
+
+  if (std::fclose(pFile) != 0 || !success)
+  {
+    std::remove(tempPath.c_str());
+    return false;
+  }
+
+  return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+
+std::optional<LineIndex> LineIndex::load(
+  const std::string& path,
+  const FileIdentity& source)
+{
+  std::shared_ptr<MappedFile> pMapping = MappedFile::open(path);
+  if (!pMapping || pMapping->size() < sizeof(CacheHeader))
+  {
+    return {};
+  }
+
+  CacheHeader header;
+  std::memcpy(&header, pMapping->data(), sizeof(header));
+
+  const auto isValid =
+    std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+    header.byteOrderMark == BYTE_ORDER_MARK &&
+    header.device == source.device &&
+    header.inode == source.inode &&
+    header.size == source.size &&
+    header.modificationTime == source.modificationTime &&
+    header.headHash == source.headHash &&
+    header.lineCount > 0 &&
+    header.blockCount == (header.lineCount + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK &&
+    header.blockCount <= pMapping->size() / sizeof(Block) &&
+    header.deltaBytes <= pMapping->size() &&
+    pMapping->size() ==
+      sizeof(CacheHeader) + header.blockCount * sizeof(Block) + header.deltaBytes;
+  if (!isValid)
+  {
+    return {};
+  }
+
+  // The header's size is a multiple of 8, so the blocks following it are
+  // suitably aligned within the (page aligned) mapping.
+  static_assert(sizeof(CacheHeader) % alignof(Block) == 0);
+
+  LineIndex index;
+  index.mpMappedBlocks =
+    reinterpret_cast<const Block*>(pMapping->data() + sizeof(CacheHeader));
+  index.mpMappedDeltas = reinterpret_cast<const std::uint8_t*>(
+    pMapping->data() + sizeof(CacheHeader) + header.blockCount * sizeof(Block));
+  index.mpMapping = std::move(pMapping);
+  index.mLineCount = header.lineCount;
+  index.mBlocks.clear();
+
+  // Looking up lines trusts the offsets, so a damaged file would make it
+  // read outside of the mapping, or return offsets outside of the text.
+  // Checking all of them takes a fraction of the time scanning the text
+  // would.
+  if (!index.hasValidLineStarts(header.deltaBytes, source.size))
+  {
+    return {};
+  }
+
+  return index;
+}
+
+
+bool LineIndex::hasValidLineStarts(
+  const std::uint64_t deltaBytes,
+  const std::uint64_t textSize) const
+{
+  // Lines start after each other, within the text, and each block's
+  // deltas begin where the previous block's end
+  const auto blockCount = (mLineCount + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+  const auto pDeltasEnd = deltas() + deltaBytes;
+  auto pDelta = deltas();
+  std::uint64_t lineStart = 0;
+
+  for (std::size_t i = 0; i < blockCount; ++i)
+  {
+    const auto& block = blocks()[i];
+    const auto isFirstBlock = i == 0;
+    if (
+      block.deltaOffset != static_cast<std::uint64_t>(pDelta - deltas()) ||
+      (isFirstBlock ? block.firstLineStart != 0 : block.firstLineStart <= lineStart) ||
+      block.firstLineStart > textSize)
+    {
+      return false;
+    }
+
+    lineStart = block.firstLineStart;
+
+    const auto blockLineCount =
+      std::min(LINES_PER_BLOCK, mLineCount - i * LINES_PER_BLOCK);
+    for (std::size_t line = 1; line < blockLineCount; ++line)
+    {
+      std::uint64_t delta;
+      if (
+        !readCheckedVarint(pDelta, pDeltasEnd, delta) ||
+        delta == 0 ||
+        delta > textSize - lineStart)
+      {
+        return false;
+      }
+
+      lineStart += delta;
+    }
+  }
+
+  return pDelta == pDeltasEnd;
+}
+
+
+const LineIndex::Block* LineIndex::blocks() const
+{
+  return mpMapping ? mpMappedBlocks : mBlocks.data();
+}
+
+
+const std::uint8_t* LineIndex::deltas() const
+{
+  return mpMapping ? mpMappedDeltas : mDeltas.data();
+}
@@ -0,0 +1,93 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "mapped_file.hpp"
+#include "position_store.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Stores the byte offset at which each line of a document starts.
+//
+// Offsets are stored compactly: Lines are grouped into blocks of 64, and
+// only the first line of each block has its absolute offset stored. For the
+// remaining lines, the distance to the previous line is stored as a
+// variable-length integer, which takes up a single byte for lines shorter
+// than 128 bytes. Looking up a line decodes at most 63 of these.
+//
+// The same format is used for the on-disk cache (see save()/load()), which
+// allows using a cached index directly from a memory mapping, without
+// reading or decoding it up front.
+class LineIndex {
+public:
+  // Creates an index with a single line starting at offset 0
+  LineIndex();
+
+  // Adds the start of a new line. Offsets must be increasing.
+  void addLineStart(std::uint64_t offset);
+
+  std::size_t lineCount() const;
+  std::uint64_t lineStart(std::size_t line) const;
+
+  // Returns the line that the given byte offset belongs to
+  std::size_t lineContaining(std::uint64_t offset) const;
+
+  // Writes the index to the given file, tagged with the identity of the
+  // file that it was built from. Returns false on failure.
+  bool save(const std::string& path, const FileIdentity& source) const;
+
+  // Maps a previously saved index. Returns an empty optional if the file
+  // doesn't exist, is damaged, or was built for a different version
+  // of the source file.
+  static std::optional<LineIndex> load(
+    const std::string& path,
+    const FileIdentity& source);
+
+private:
+  struct Block
+  {
+    std::uint64_t firstLineStart;
+    std::uint64_t deltaOffset;
+  };
+
+  const Block* blocks() const;
+  const std::uint8_t* deltas() const;
+  bool hasValidLineStarts(std::uint64_t deltaBytes, std::uint64_t textSize) const;
+
+  std::vector<Block> mBlocks;
+  std::vector<std::uint8_t> mDeltas;
+
+  // Set when the index was loaded from a cache file. Blocks and deltas
+  // are read from the mapping in that case.
+  std::shared_ptr<MappedFile> mpMapping;
+  const Block* mpMappedBlocks = nullptr;
+  const std::uint8_t* mpMappedDeltas = nullptr;
+
+  std::size_t mLineCount = 0;
+  std::uint64_t mLastLineStart = 0;
+};
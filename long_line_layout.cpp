@@ -0,0 +1,197 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "long_line_layout.hpp"
+
+#include "imgui_internal.h"
+
+#include <algorithm>
+
+
+namespace
+{
+
+constexpr std::size_t CHECKPOINT_INTERVAL = 1024;
+
+// Only lines close to the visible ones are needed at any time
+constexpr std::size_t MAX_CACHED_LAYOUTS = 64;
+
+
+// Steps over one character, and returns its width. Follows what ImGui
+// does when rendering text.
+double advance(
+  const ImFont& font,
+  const float scale,
+  const char*& pChar,
+  const char* pEnd)
+{
+  unsigned int codepoint = static_cast<unsigned char>(*pChar);
+  if (codepoint < 0x80)
+  {
+    ++pChar;
+  }
+  else
+  {
+    pChar += std::max(ImTextCharFromUtf8(&codepoint, pChar, pEnd), 1);
+  }
+
+  if (codepoint == '\r')
+  {
+    return 0.0;
+  }
+
+  const auto advanceX = codepoint <= IM_UNICODE_CODEPOINT_MAX
+    ? font.GetCharAdvance(static_cast<ImWchar>(codepoint))
+    : font.FallbackAdvanceX;
+  return static_cast<double>(advanceX) * scale;
+}
+
+}
+
+
+double LongLineLayout::width(const std::size_t line, const std::string_view text)
+{
+  return layout(line, text).width;
+}
+
+
+LongLineLayout::Span LongLineLayout::visibleSpan(
+  const std::size_t line,
+  const std::string_view text,
+  const double left,
+  const double right)
+{
+  const auto& lineLayout = layout(line, text);
+  const auto& font = *ImGui::GetFont();
+  const auto scale = ImGui::GetFontSize() / font.FontSize;
+
+  // Start at the last checkpoint left of the visible part. The first one
+  // is at the start of the line.
+  const auto iCheckpoint = std::upper_bound(
+    lineLayout.checkpoints.begin() + 1,
+    lineLayout.checkpoints.end(),
+    left,
+    [](const double value, const Checkpoint& checkpoint)
+    {
+      return value < checkpoint.x;
+    }) - 1;
+
+  const auto pEnd = text.data() + text.size();
+  auto pChar = text.data() + iCheckpoint->offset;
+  auto x = iCheckpoint->x;
+
+  // Skip characters that end before the visible part
+  while (pChar != pEnd)
+  {
+    auto pNext = pChar;
+    const auto nextX = x + advance(font, scale, pNext, pEnd);
+    if (nextX > left)
+    {
+      break;
+    }
+
+    pChar = pNext;
+    x = nextX;
+  }
+
+  const auto pBegin = pChar;
+  const auto beginX = x;
+
+  // Include characters until one starts beyond the visible part
+  while (pChar != pEnd && x < right)
+  {
+    x += advance(font, scale, pChar, pEnd);
+  }
+
+  return {std::string_view(pBegin, pChar - pBegin), beginX};
+}
+
+
+const LongLineLayout::Layout& LongLineLayout::layout(
+  const std::size_t line,
+  const std::string_view text)
+{
+  const auto pFont = ImGui::GetFont();
+  const auto fontSize = ImGui::GetFontSize();
+  const auto fontTexture = pFont->ContainerAtlas->TexID;
+
+  auto iLayout = std::find_if(
+    mLayouts.begin(),
+    mLayouts.end(),
+    [&](const Layout& layout)
+    {
+      // The font atlas is rebuilt when glyphs are added (see FontManager),
+      // which can change the width of characters that were missing before
+      return
+        layout.line == line &&
+        layout.pFont == pFont &&
+        layout.fontSize == fontSize &&
+        layout.fontTexture == fontTexture &&
+        layout.textSize <= text.size();
+    });
+
+  if (iLayout == mLayouts.end())
+  {
+    if (mLayouts.size() >= MAX_CACHED_LAYOUTS)
+    {
+      mLayouts.pop_back();
+    }
+
+    mLayouts.push_front(Layout{line, 0, pFont, fontSize, fontTexture, {{0, 0.0}}, 0.0});
+    iLayout = mLayouts.begin();
+  }
+  else
+  {
+    mLayouts.splice(mLayouts.begin(), mLayouts, iLayout);
+  }
+
+  auto& lineLayout = *iLayout;
+  if (lineLayout.textSize == text.size())
+  {
+    return lineLayout;
+  }
+
+  // Text is only ever appended to the last line of script output, so the
+  // layout can continue from the last checkpoint
+  const auto& font = *pFont;
+  const auto scale = fontSize / font.FontSize;
+  const auto pBegin = text.data();
+  const auto pEnd = pBegin + text.size();
+
+  auto pChar = pBegin + lineLayout.checkpoints.back().offset;
+  auto x = lineLayout.checkpoints.back().x;
+  auto nextCheckpoint = lineLayout.checkpoints.back().offset + CHECKPOINT_INTERVAL;
+  while (pChar != pEnd)
+  {
+    // Checkpoints are placed at the start of characters
+    if (static_cast<std::size_t>(pChar - pBegin) >= nextCheckpoint)
+    {
+      lineLayout.checkpoints.push_back({static_cast<std::size_t>(pChar - pBegin), x});
+      nextCheckpoint = lineLayout.checkpoints.back().offset + CHECKPOINT_INTERVAL;
+    }
+
+    x += advance(font, scale, pChar, pEnd);
+  }
+
+  lineLayout.textSize = text.size();
+  lineLayout.width = x;
+  return lineLayout;
+}
@@ -0,0 +1,89 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+
+#include <cstddef>
+#include <list>
+#include <string_view>
+#include <vector>
+
+
+// Allows drawing only the visible part of very long lines, like minified
+// JSON or base64 data. For each such line, the horizontal position of every
+// 1024th byte is recorded once. Finding the part of the line that's visible
+// at some scroll position then only needs a binary search in these
+// checkpoints, followed by measuring at most 1024 bytes, instead of laying
+// out the line from its start.
+//
+// Positions are kept in double precision, as floats can't represent
+// individual pixels anymore beyond 16 million or so, which a line of
+// a few MB easily exceeds.
+class LongLineLayout {
+public:
+  // Lines with more bytes than this are drawn in parts. For shorter ones,
+  // laying out the entire line is cheap enough.
+  static constexpr std::size_t MIN_LINE_SIZE = 16 * 1024;
+
+  struct Span
+  {
+    std::string_view text;
+
+    // Position of the first character, relative to the start of the line
+    double x;
+  };
+
+  // Returns the width of the given line, in pixels
+  double width(std::size_t line, std::string_view text);
+
+  // Returns the part of the line that is visible between the given
+  // positions, which are relative to the start of the line
+  Span visibleSpan(
+    std::size_t line,
+    std::string_view text,
+    double left,
+    double right);
+
+private:
+  struct Checkpoint
+  {
+    std::size_t offset;
+    double x;
+  };
+
+  struct Layout
+  {
+    std::size_t line;
+    std::size_t textSize;
+    ImFont* pFont;
+    float fontSize;
+    ImTextureID fontTexture;
+    std::vector<Checkpoint> checkpoints;
+    double width;
+  };
+
+  const Layout& layout(std::size_t line, std::string_view text);
+
+  // Most recently used first
+  std::list<Layout> mLayouts;
+};
@@ -19,6 +19,14 @@
   * SOFTWARE.
   */
 
+#include "daemon_socket.hpp"
+#include "diff_view.hpp"
+#include "escape_sequences.hpp"
+#include "font_manager.hpp"
+#include "frame_presenter.hpp"
+#include "hex_view.hpp"
+#include "latency_probe.hpp"
+#include "position_store.hpp"
 #include "view.hpp"
 
 #include "imgui.h"
@@ -27,14 +35,19 @@
 #include "imgui_impl_opengl3.h"
 
 #include <cxxopts.hpp>
-#include <GLES2/gl2.h>
 #include <SDL.h>
 
+#include <unistd.h>
+
+#include <chrono>
 #include <cstdlib>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <optional>
+#include <vector>
 
 
 namespace
@@ -43,7 +56,12 @@ namespace
 // Parses command line options and returns a ParseResult if successful.
 // Returns an empty optional otherwise.
 // This function defines all available command line arguments.
-std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
+// Prints the help text and exits when asked for it, unless mayExit is
+// false. The help is refused like an invalid command line then.
+std::optional<cxxopts::ParseResult> parseArgs(
+  int argc,
+  char** argv,
+  const bool mayExit = true)
 {
   try
   {
@@ -53,17 +71,28 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
     // This is using the cxxopts library. Refer to its documentation for more info:
     // https://github.com/jarro2783/cxxopts/wiki/Options
     options
-      .positional_help("[input file]")
+      .positional_help("[input file...]")
       .show_positional_help()
       .add_options()
-        ("input_file", "text file to view", cxxopts::value<std::string>())
+        ("input_file", "text file(s) to view, each one is shown in its own tab", cxxopts::value<std::vector<std::string>>())
         ("s,script_file", "script outpout to view", cxxopts::value<std::string>())
         ("m,message", "text to show instead of viewing a file", cxxopts::value<std::string>())
         ("f,font_size", "font size in pixels", cxxopts::value<int>())
+        ("font", "TTF font file to use, needed for non-Latin text. Glyphs are loaded on demand", cxxopts::value<std::string>())
         ("t,title", "window title (filename by default)", cxxopts::value<std::string>())
         ("y,yes_button", "shows a yes button with different exit code")
         ("e,error_display", "format as error, background will be red")
         ("w,wrap_lines", "wrap long lines of text. WARNING: could be slow for large files!")
+        ("tee", "also write the script's output to the given file", cxxopts::value<std::string>())
+        ("export_dir", "directory where selected text is saved", cxxopts::value<std::string>()->default_value("."))
+        ("search", "highlight lines matching the given regular expression", cxxopts::value<std::string>())
+        ("columns", "for JSON lines input, show the given fields as columns, e.g. ts,level,msg", cxxopts::value<std::vector<std::string>>())
+        ("daemon", "keep running in the background with the window hidden, and show the text of each --client invocation that connects to the given socket", cxxopts::value<std::string>())
+        ("client", "let the daemon listening on the given socket show the text, instead of starting up a viewer. Font options only take effect when starting the daemon", cxxopts::value<std::string>())
+        ("latency_probe", "measure how long it takes for input to show up on screen, and print statistics when quitting. With --latency_probe=finish, also wait for the GPU to complete rendering and swapping", cxxopts::value<std::string>()->implicit_value("swap"))
+        ("render_late", "together with --latency_probe, start each frame as late as possible before the display refreshes, to reduce latency")
+        ("collapse", "show runs of repeated lines as a single line. With --collapse=similar, lines that only differ in numbers (e.g. timestamps) count as repeated", cxxopts::value<std::string>()->implicit_value("identical"))
+        ("diff", "compare the two given input files side by side. With --diff=similar, lines that only differ in numbers (e.g. timestamps) count as equal", cxxopts::value<std::string>()->implicit_value("identical"))
         ("h,help", "show help")
       ;
 
@@ -79,13 +108,31 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
       // cxxopts) and exit.
       if (result.count("help"))
       {
+        if (!mayExit)
+        {
+          return {};
+        }
+
         std::cout << options.help({""}) << '\n';
         std::exit(0);
       }
 
+      const auto hasInput =
+        result.count("input_file") ||
+        result.count("message") ||
+        result.count("script_file");
+
+      // A daemon gets its input from clients
+      if (result.count("daemon") && (hasInput || result.count("client")))
+      {
+        std::cerr << "Error: --daemon cannot be combined with input or --client\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
       // Verification: Make sure there's some input, otherwise print an error and
       // exit.
-      if (!result.count("input_file") && !result.count("message") && !result.count("script_file"))
+      if (!hasInput && !result.count("daemon"))
       {
         std::cerr << "Error: No input given\n\n";
         std::cerr << options.help({""}) << '\n';
@@ -101,6 +148,63 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
         return {};
       }
 
+      if (result.count("tee") && !result.count("script_file"))
+      {
+        std::cerr << "Error: --tee can only be used together with script_file\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
+      if (
+        result.count("collapse") &&
+        result["collapse"].as<std::string>() != "identical" &&
+        result["collapse"].as<std::string>() != "similar")
+      {
+        std::cerr << "Error: --collapse must be either identical or similar\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
+      if (result.count("diff"))
+      {
+        if (
+          result["diff"].as<std::string>() != "identical" &&
+          result["diff"].as<std::string>() != "similar")
+        {
+          std::cerr << "Error: --diff must be either identical or similar\n\n";
+          std::cerr << options.help({""}) << '\n';
+          return {};
+        }
+
+        if (
+          !result.count("input_file") ||
+          result["input_file"].as<std::vector<std::string>>().size() != 2 ||
+          result.count("script_file") ||
+          result.count("collapse"))
+        {
+          std::cerr << "Error: --diff needs exactly two input files, and cannot be combined with script_file or --collapse\n\n";
+          std::cerr << options.help({""}) << '\n';
+          return {};
+        }
+      }
+
+      if (
+        result.count("latency_probe") &&
+        result["latency_probe"].as<std::string>() != "swap" &&
+        result["latency_probe"].as<std::string>() != "finish")
+      {
+        std::cerr << "Error: --latency_probe must be either swap or finish\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
+      if (result.count("render_late") && !result.count("latency_probe"))
+      {
+        std::cerr << "Error: --render_late can only be used together with --latency_probe\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
       // All verification steps passed, we can return the parsed options
       return result;
     }
@@ -123,208 +227,800 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
 }
 
 
-// Converts escape sequences like `\n` into their character values.
-// This mimicks the behavior of the `echo -e` UNIX command, albeit
-// not all possible escape sequences are implemented.
-//
-// Compare https://github.com/wertarbyte/coreutils/blob/f70c7b785b93dd436788d34827b209453157a6f2/src/echo.c#L203
-std::string replaceEscapeSequences(const std::string& original)
+// Returns the window title to display for the given input file, based on
+// the current options. inputFile is empty for scripts and messages.
+std::string determineTitle(
+  const cxxopts::ParseResult& args,
+  const std::string& inputFile)
 {
-  std::string result;
-  result.reserve(original.size());
+  if (args.count("title"))
+  {
+    return args["title"].as<std::string>();
+  }
+  else if (!inputFile.empty())
+  {
+    return inputFile;
+  }
+  else if (args.count("error_display"))
+  {
+    return "Error!!";
+  }
+  else
+  {
+    return "Info";
+  }
+}
 
-  for (auto iChar = original.begin(); iChar != original.end(); ++iChar)
+
+// Each input is shown in its own tab. Files are only loaded once their
+// tab is shown for the first time, and loading happens in the background.
+// When comparing two files, there is a single tab showing both, which
+// also computes the diff in the background.
+struct Tab
+{
+  std::string label;
+  std::string inputFile;
+  std::future<Document> pendingDocument;
+  std::unique_ptr<View> pView;
+  std::optional<FileIdentity> fileIdentity;
+
+  // Binary files are shown as a hex dump instead
+  std::unique_ptr<HexView> pHexView;
+
+  std::optional<std::string> diffInputFile;
+  std::future<std::unique_ptr<DiffView>> pendingDiff;
+  std::unique_ptr<DiffView> pDiffView;
+};
+
+
+// Draws a bar at the top of the screen listing all tabs, and returns the
+// height it takes up. Tabs can also be selected by clicking on them, in
+// which case activeTabIndex is updated accordingly.
+float drawTabBar(
+  const std::vector<Tab>& tabs,
+  std::size_t& activeTabIndex,
+  const bool activeTabChanged)
+{
+  const auto height =
+    ImGui::GetFrameHeightWithSpacing() +
+    ImGui::GetStyle().WindowPadding.y * 2.0f;
+
+  ImGui::SetNextWindowPos({0.0f, 0.0f});
+  ImGui::SetNextWindowSize({ImGui::GetIO().DisplaySize.x, height});
+
+  // The tab bar is not part of gamepad navigation, tabs are switched
+  // using the shoulder buttons instead (see run()).
+  ImGui::Begin(
+    "##tab_bar",
+    nullptr,
+    ImGuiWindowFlags_NoTitleBar |
+    ImGuiWindowFlags_NoResize |
+    ImGuiWindowFlags_NoMove |
+    ImGuiWindowFlags_NoScrollbar |
+    ImGuiWindowFlags_NoSavedSettings |
+    ImGuiWindowFlags_NoNav |
+    ImGuiWindowFlags_NoFocusOnAppearing |
+    ImGuiWindowFlags_NoBringToFrontOnFocus);
+
+  if (ImGui::BeginTabBar("##tabs"))
   {
-    if (*iChar == '\\' && std::next(iChar) != original.end())
+    for (std::size_t i = 0; i < tabs.size(); ++i)
     {
-      switch (*std::next(iChar))
+      const auto flags = activeTabChanged && i == activeTabIndex
+        ? ImGuiTabItemFlags_SetSelected
+        : ImGuiTabItemFlags_None;
+
+      // Inputs might have the same name, so we use the index as ID
+      ImGui::PushID(static_cast<int>(i));
+      if (ImGui::BeginTabItem(tabs[i].label.c_str(), nullptr, flags))
       {
-        case 'f': result.push_back('\f'); ++iChar; break;
-        case 'n': result.push_back('\n'); ++iChar; break;
-        case 'r': result.push_back('\r'); ++iChar; break;
-        case 't': result.push_back('\t'); ++iChar; break;
-        case 'v': result.push_back('\v'); ++iChar; break;
-        case '\\': result.push_back('\\'); ++iChar; break;
-
-        default:
-          result.push_back(*iChar);
-          break;
+        // If the active tab was just changed via gamepad, the previously
+        // selected tab is still reported as selected during this frame
+        if (!activeTabChanged)
+        {
+          activeTabIndex = i;
+        }
+
+        ImGui::EndTabItem();
       }
+      ImGui::PopID();
     }
-    else
-    {
-      result.push_back(*iChar);
-    }
+
+    ImGui::EndTabBar();
   }
 
-  return result;
+  ImGui::End();
+
+  return height;
 }
 
 
-// When running a script (option -s/--script given), this returns the path
-// of the script to run.
-// Otherwise, it returns the text that should be displayed in the viewer.
-std::string readInputOrScriptName(const cxxopts::ParseResult& args)
+// Shown in place of a file's view while the file is loading
+void drawLoadingScreen(
+  const ImVec2& windowPos,
+  const ImVec2& windowSize,
+  const std::string& label)
 {
-  if (args.count("input_file"))
+  ImGui::SetNextWindowPos(windowPos);
+  ImGui::SetNextWindowSize(windowSize);
+  ImGui::Begin(
+    label.c_str(),
+    nullptr,
+    ImGuiWindowFlags_NoCollapse |
+    ImGuiWindowFlags_NoResize |
+    ImGuiWindowFlags_NoMove);
+  ImGui::TextUnformatted("Loading...");
+  ImGui::End();
+}
+
+
+// Loads two files and computes their diff, for showing them side by side.
+// Meant to run in the background. Both files are loaded and hashed at
+// the same time.
+std::unique_ptr<DiffView> loadDiff(
+  std::string title,
+  const std::string& leftFile,
+  const std::string& rightFile,
+  const bool ignoreNumbers,
+  FontManager& fontManager)
+{
+  auto loadFile = [ignoreNumbers](const std::string& path)
   {
-    // If an input file is specified, we load the entire file into
-    // memory and return its content
-    const auto& inputFilename = args["input_file"].as<std::string>();
-    std::ifstream file(inputFilename, std::ios::ate);
-    
-    // If there was an error (file doesn't exist, we don't have permission,
-    // other error etc.), return an empty string
-    if (!file.is_open())
-    {
-      return {};
-    }
+    auto document = Document::fromFile(path);
+    document.hashLines(ignoreNumbers);
+    return document;
+  };
 
-    const auto fileSize = file.tellg();
-    file.seekg(0);
+  auto pendingRight = std::async(std::launch::async, loadFile, rightFile);
+  auto left = loadFile(leftFile);
+  auto right = pendingRight.get();
+
+  LineDiff diff{left, right};
+  return std::make_unique<DiffView>(
+    std::move(title),
+    leftFile,
+    rightFile,
+    std::move(left),
+    std::move(right),
+    std::move(diff),
+    fontManager);
+}
 
-    std::string inputText;
-    inputText.resize(fileSize);
-    file.read(&inputText[0], fileSize);
 
-    return inputText;
-  }
-  else if (args.count("script_file"))
+// This function implements the main loop. Returns the exit code once the
+// user is done, or an empty optional if the application should quit.
+std::optional<int> showInputs(
+  SDL_Window* pWindow,
+  const cxxopts::ParseResult& args,
+  FontManager& fontManager,
+  LatencyProbe* pLatencyProbe)
+{
+  // Create the tabs. The view objects are where all the core logic
+  // is implemented. See view.hpp/view.cpp.
+  // Ideally, all command line options should be converted to plain
+  // C++ types before handing them over to the View, to
+  // avoid making the View dependent on cxxopts.
+  const auto showYesNoButtons = args.count("yes_button") > 0;
+  const auto wrapLines = args.count("wrap_lines") > 0;
+  const auto exportDirectory = args["export_dir"].as<std::string>();
+
+  const auto searchPattern = args.count("search")
+    ? std::optional<std::string>{args["search"].as<std::string>()}
+    : std::nullopt;
+
+  const auto jsonColumns = args.count("columns")
+    ? args["columns"].as<std::vector<std::string>>()
+    : std::vector<std::string>{};
+
+  // Repeated lines are recognized by their hashes, which need to be
+  // there before the view is created. For files, this happens in the
+  // background, together with loading the file.
+  const auto collapseRepeatedLines = args.count("collapse") > 0;
+  const auto collapseSimilarLines =
+    collapseRepeatedLines && args["collapse"].as<std::string>() == "similar";
+
+  auto prepareDocument =
+    [collapseRepeatedLines, collapseSimilarLines](Document document)
   {
-    return args["script_file"].as<std::string>();
-  }
-  else
+    if (collapseRepeatedLines)
+    {
+      document.hashLines(collapseSimilarLines);
+    }
+
+    return document;
+  };
+
+  // Options that apply to every view, whatever it shows
+  auto applyViewOptions = [&](View& view)
   {
-    // If no input file is given, we return whatever was passed in
-    // via the --message argument, but with escape sequences replaced
-    return replaceEscapeSequences(args["message"].as<std::string>());
-  }
-}
+    if (searchPattern)
+    {
+      view.startSearch(*searchPattern);
+    }
 
+    if (!jsonColumns.empty())
+    {
+      view.setJsonColumns(jsonColumns);
+    }
+  };
 
-// Returns the window title to display, based on the current options
-std::string determineTitle(const cxxopts::ParseResult& args)
-{
-  if (args.count("title"))
+  std::vector<Tab> tabs;
+
+  if (args.count("diff"))
   {
-    return args["title"].as<std::string>();
+    // Both files are given, see parseArgs()
+    const auto& inputFiles = args["input_file"].as<std::vector<std::string>>();
+
+    Tab tab;
+    tab.label = inputFiles[0] + " vs. " + inputFiles[1];
+    tab.inputFile = inputFiles[0];
+    tab.diffInputFile = inputFiles[1];
+    tabs.push_back(std::move(tab));
   }
   else if (args.count("input_file"))
   {
-    return args["input_file"].as<std::string>();
+    for (const auto& inputFile : args["input_file"].as<std::vector<std::string>>())
+    {
+      Tab tab;
+      tab.label = inputFile;
+      tab.inputFile = inputFile;
+      tabs.push_back(std::move(tab));
+    }
   }
-  else if (args.count("error_display"))
+
+  if (args.count("script_file"))
   {
-    return "Error!!";
+    // Unlike files, scripts are started right away, since they might be
+    // doing something that shouldn't wait until their tab is shown.
+    const auto& scriptFile = args["script_file"].as<std::string>();
+
+    Tab tab;
+    tab.label = scriptFile;
+    tab.pView = std::make_unique<View>(
+      determineTitle(args, {}),
+      prepareDocument(Document{}),
+      scriptFile,
+      showYesNoButtons,
+      wrapLines,
+      exportDirectory,
+      fontManager);
+
+    if (
+      args.count("tee") &&
+      !tab.pView->startSavingOutput(args["tee"].as<std::string>()))
+    {
+      std::cerr << "Warning: Cannot write to " << args["tee"].as<std::string>() << '\n';
+    }
+
+    applyViewOptions(*tab.pView);
+
+    tabs.push_back(std::move(tab));
   }
-  else
+  else if (tabs.empty())
   {
-    return "Info";
+    // If neither input files nor a script are given, we show whatever was
+    // passed in via the --message argument, but with escape sequences
+    // replaced
+    Tab tab;
+    tab.pView = std::make_unique<View>(
+      determineTitle(args, {}),
+      prepareDocument(
+        Document{replaceEscapeSequences(args["message"].as<std::string>())}),
+      std::nullopt,
+      showYesNoButtons,
+      wrapLines,
+      exportDirectory,
+      fontManager);
+    applyViewOptions(*tab.pView);
+    tabs.push_back(std::move(tab));
   }
-}
 
+  std::size_t activeTabIndex = 0;
 
-// This function implements the main loop
-int run(SDL_Window* pWindow, const cxxopts::ParseResult& args)
-{
-  // Data structures and helper functions for dealing with controllers
-  
-  // List of all currently open controllers
-  std::vector<SDL_GameController*> gameControllers;
+  PositionStore positionStore;
 
-  // Close all currently open controllers and clear the list
-  auto clearGameControllers = [&]()
+  // Creates the view for a file once its content has been loaded
+  auto createFileView = [&](Tab& tab)
   {
-    for (const auto pController : gameControllers)
+    auto document = tab.pendingDocument.get();
+    if (document.isBinary())
     {
-      SDL_GameControllerClose(pController);
+      tab.pHexView = std::make_unique<HexView>(
+        determineTitle(args, tab.inputFile), std::move(document));
+      return;
     }
 
-    gameControllers.clear();
+    tab.pView = std::make_unique<View>(
+      determineTitle(args, tab.inputFile),
+      std::move(document),
+      std::nullopt,
+      showYesNoButtons,
+      wrapLines,
+      exportDirectory,
+      fontManager);
+
+    // When viewing a file that we've seen before, continue reading where
+    // the user left off last time, and restore their bookmarks.
+    tab.fileIdentity = identifyFile(tab.inputFile);
+    if (tab.fileIdentity)
+    {
+      if (const auto position = positionStore.load(*tab.fileIdentity))
+      {
+        tab.pView->setReadingPosition(*position);
+      }
+    }
+
+    applyViewOptions(*tab.pView);
   };
 
-  // Look for game controllers currently plugged in, and try opening
-  // them. This will open any controller that's recognized by SDL, i.e.
-  // has a valid controller mapping.
-  auto enumerateGameControllers = [&]()
+  auto saveReadingPositions = [&]()
   {
-    clearGameControllers();
-
-    for (std::uint8_t i = 0; i < SDL_NumJoysticks(); ++i) {
-      if (SDL_IsGameController(i)) {
-        gameControllers.push_back(SDL_GameControllerOpen(i));
+    for (const auto& tab : tabs)
+    {
+      if (tab.pView && tab.fileIdentity)
+      {
+        positionStore.save(*tab.fileIdentity, tab.pView->readingPosition());
       }
     }
   };
 
-
-  // Create the view object. This is where all the core logic
-  // is implemented. See view.hpp/view.cpp.
-  // Ideally, all command line options should be converted to plain
-  // C++ types before handing them over to the View, to
-  // avoid making the View dependent on cxxopts.
-  auto view = View{
-    determineTitle(args),
-    readInputOrScriptName(args),
-    args.count("yes_button") > 0,
-    args.count("wrap_lines") > 0,
-    args.count("script_file") > 0};
-
   const auto& io = ImGui::GetIO();
 
+  // Skips rendering frames that didn't change. In that case, we wait
+  // for about as long as a frame would have taken at 60 Hz.
+  FramePresenter presenter{pWindow, pLatencyProbe};
+  const auto idleFrameIntervalMs = 16;
+
+  // While a script floods the active tab with output, we only draw a few
+  // frames per second, and read output in between
+  const auto floodedFrameInterval = std::chrono::milliseconds(100);
+  auto lastFrameTime = std::chrono::steady_clock::now();
+
+  // The triggers are used for zooming. They are analog, so we consider
+  // them pressed once they pass a threshold, and zoom on each press.
+  const auto triggerThreshold = 16384;
+  bool leftTriggerPressed = false;
+  bool rightTriggerPressed = false;
+
+  // Tapping the shoulder buttons switches tabs. While held, they also change
+  // the scrolling speed (handled by ImGui), so we only switch tabs if the
+  // user didn't scroll while holding the button.
+  const auto stickDeadZone = 8000;
+  std::optional<Uint8> tappedShoulderButton;
+  bool activeTabChanged = false;
+
   // Keep running until an exit code is set
   std::optional<int> exitCode;
   while (!exitCode)
   {
+    if (pLatencyProbe)
+    {
+      pLatencyProbe->waitForFrameStart();
+    }
+
     // Process pending events
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
+      if (pLatencyProbe)
+      {
+        pLatencyProbe->eventReceived(event);
+      }
+
       // Forward events to Dear ImGui
       ImGui_ImplSDL2_ProcessEvent(&event);
 
       // Check if we need to quit, this directly handles some controller events.
       // Most controller events are handled by ImGui instead.
+      // The controller buttons only close the current inputs, whereas
+      // closing the window also makes a daemon quit.
       if (
         event.type == SDL_QUIT ||
-        (event.type == SDL_CONTROLLERBUTTONDOWN &&
-         (event.cbutton.button == SDL_CONTROLLER_BUTTON_GUIDE || event.cbutton.button == SDL_CONTROLLER_BUTTON_BACK)) ||
         (event.type == SDL_WINDOWEVENT &&
          event.window.event == SDL_WINDOWEVENT_CLOSE &&
          event.window.windowID == SDL_GetWindowID(pWindow))
       ) {
+        saveReadingPositions();
+        return {};
+      }
+
+      if (
+        event.type == SDL_CONTROLLERBUTTONDOWN &&
+        (event.cbutton.button == SDL_CONTROLLER_BUTTON_GUIDE || event.cbutton.button == SDL_CONTROLLER_BUTTON_BACK)
+      ) {
+        saveReadingPositions();
         return 0;
       }
 
-      // Handle controller hot-plugging
+      auto& activeView = tabs[activeTabIndex].pView;
+      auto& activeDiffView = tabs[activeTabIndex].pDiffView;
+
+      if (event.type == SDL_CONTROLLERBUTTONDOWN)
+      {
+        switch (event.cbutton.button)
+        {
+          // X and Y are shortcuts for the bookmark buttons
+          case SDL_CONTROLLER_BUTTON_X:
+            if (activeView)
+            {
+              activeView->toggleBookmark();
+            }
+            break;
+
+          case SDL_CONTROLLER_BUTTON_Y:
+            if (activeView)
+            {
+              activeView->jumpToNextBookmark();
+            }
+            break;
+
+          // Clicking the left stick starts and finishes selecting text.
+          // When comparing files, it jumps to the previous change instead.
+          case SDL_CONTROLLER_BUTTON_LEFTSTICK:
+            if (activeView)
+            {
+              activeView->markSelection();
+            }
+            else if (activeDiffView)
+            {
+              activeDiffView->jumpToPreviousChange();
+            }
+            break;
+
+          // Clicking the right stick jumps to the next search match, or
+          // to the next change
+          case SDL_CONTROLLER_BUTTON_RIGHTSTICK:
+            if (activeView)
+            {
+              activeView->jumpToNextMatch();
+            }
+            else if (activeDiffView)
+            {
+              activeDiffView->jumpToNextChange();
+            }
+            break;
+
+          case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+          case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+            tappedShoulderButton = event.cbutton.button;
+            break;
+
+          case SDL_CONTROLLER_BUTTON_DPAD_UP:
+          case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+          case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+          case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+            tappedShoulderButton.reset();
+            break;
+        }
+      }
+
       if (
-        event.type == SDL_CONTROLLERDEVICEADDED ||
-        event.type == SDL_CONTROLLERDEVICEREMOVED)
+        event.type == SDL_CONTROLLERBUTTONUP &&
+        tappedShoulderButton == event.cbutton.button &&
+        tabs.size() > 1)
       {
-        enumerateGameControllers();
+        tappedShoulderButton.reset();
+
+        if (event.cbutton.button == SDL_CONTROLLER_BUTTON_LEFTSHOULDER)
+        {
+          activeTabIndex = (activeTabIndex + tabs.size() - 1) % tabs.size();
+        }
+        else
+        {
+          activeTabIndex = (activeTabIndex + 1) % tabs.size();
+        }
+
+        activeTabChanged = true;
+      }
+
+      if (
+        event.type == SDL_CONTROLLERAXISMOTION &&
+        (event.caxis.axis == SDL_CONTROLLER_AXIS_LEFTX ||
+         event.caxis.axis == SDL_CONTROLLER_AXIS_LEFTY) &&
+        std::abs(event.caxis.value) > stickDeadZone)
+      {
+        tappedShoulderButton.reset();
+      }
+
+      // Handle zooming
+      if (event.type == SDL_CONTROLLERAXISMOTION)
+      {
+        const auto isPressed = event.caxis.value > triggerThreshold;
+
+        if (event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERLEFT)
+        {
+          if (isPressed && !leftTriggerPressed)
+          {
+            fontManager.zoomOut();
+          }
+
+          leftTriggerPressed = isPressed;
+        }
+        else if (event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT)
+        {
+          if (isPressed && !rightTriggerPressed)
+          {
+            fontManager.zoomIn();
+          }
+
+          rightTriggerPressed = isPressed;
+        }
+      }
+    }
+
+    // Apply zoom level changes and add any glyphs that were requested
+    // during the previous frame to the font atlas. This can't be done while
+    // a frame is in progress. Atlases are built in the background, this
+    // only picks up the ones that are ready.
+    fontManager.updateAtlas();
+
+    // Load the active tab's file in the background when it's first shown,
+    // and create its view once loading is done. The same goes for diffs.
+    auto& activeTab = tabs[activeTabIndex];
+    if (activeTab.diffInputFile)
+    {
+      using namespace std::chrono_literals;
+
+      if (!activeTab.pDiffView && !activeTab.pendingDiff.valid())
+      {
+        activeTab.pendingDiff = std::async(
+          std::launch::async,
+          loadDiff,
+          determineTitle(args, activeTab.label),
+          activeTab.inputFile,
+          *activeTab.diffInputFile,
+          args["diff"].as<std::string>() == "similar",
+          std::ref(fontManager));
+      }
+      else if (
+        activeTab.pendingDiff.valid() &&
+        activeTab.pendingDiff.wait_for(0s) == std::future_status::ready)
+      {
+        activeTab.pDiffView = activeTab.pendingDiff.get();
       }
     }
+    else if (!activeTab.pView && !activeTab.pHexView)
+    {
+      using namespace std::chrono_literals;
+
+      if (!activeTab.pendingDocument.valid())
+      {
+        activeTab.pendingDocument = std::async(
+          std::launch::async,
+          [inputFile = activeTab.inputFile, prepareDocument]()
+          {
+            return prepareDocument(Document::fromFile(inputFile));
+          });
+      }
+      else if (activeTab.pendingDocument.wait_for(0s) == std::future_status::ready)
+      {
+        createFileView(activeTab);
+      }
+    }
+
+    // Keep scripts in other tabs running
+    for (auto& tab : tabs)
+    {
+      if (tab.pView && &tab != &activeTab)
+      {
+        tab.pView->pollScriptOutput();
+      }
+    }
+
+    if (activeTab.pView && activeTab.pView->isFloodedWithOutput())
+    {
+      const auto now = std::chrono::steady_clock::now();
+      if (now - lastFrameTime < floodedFrameInterval)
+      {
+        activeTab.pView->readScriptOutput(
+          lastFrameTime + floodedFrameInterval - now);
+        continue;
+      }
+    }
+
+    lastFrameTime = std::chrono::steady_clock::now();
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplSDL2_NewFrame(pWindow, gameControllers);
+    ImGui_ImplSDL2_NewFrame(pWindow);
     ImGui::NewFrame();
 
+    if (pLatencyProbe)
+    {
+      pLatencyProbe->mark(LatencyProbe::Point::NewFrame);
+    }
+
     // Draw the UI, respond to user input etc.
-    exitCode = view.draw(io.DisplaySize);
+    auto viewPos = ImVec2{0.0f, 0.0f};
+    auto viewSize = io.DisplaySize;
+    if (tabs.size() > 1)
+    {
+      viewPos.y = drawTabBar(tabs, activeTabIndex, activeTabChanged);
+      viewSize.y -= viewPos.y;
+      activeTabChanged = false;
+    }
+
+    // Clicking on the tab bar might have changed the active tab, we show
+    // the new tab starting with the next frame.
+    if (activeTab.pView)
+    {
+      exitCode = activeTab.pView->draw(viewPos, viewSize);
+    }
+    else if (activeTab.pDiffView)
+    {
+      exitCode = activeTab.pDiffView->draw(viewPos, viewSize);
+    }
+    else if (activeTab.pHexView)
+    {
+      exitCode = activeTab.pHexView->draw(viewPos, viewSize);
+    }
+    else
+    {
+      drawLoadingScreen(viewPos, viewSize, activeTab.label);
+    }
+
+    if (pLatencyProbe)
+    {
+      pLatencyProbe->mark(LatencyProbe::Point::Draw);
+    }
 
     // Render and swap buffers to present the new frame
     ImGui::Render();
 
-    glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-   
-    SDL_GL_SwapWindow(pWindow);
+    // The cached text's texture changing isn't visible in the draw data
+    if (activeTab.pView && activeTab.pView->renderCachedText())
+    {
+      presenter.invalidate();
+    }
+
+    // When nothing changed, there's no swap to wait for vsync on. Wait for
+    // input or the next frame's worth of time instead, so that we don't
+    // spin the CPU while idle.
+    const auto wasPresented = presenter.present(*ImGui::GetDrawData());
+
+    if (pLatencyProbe)
+    {
+      pLatencyProbe->frameFinished(wasPresented);
+    }
+
+    if (!wasPresented)
+    {
+      SDL_WaitEventTimeout(nullptr, idleFrameIntervalMs);
+    }
   }
 
-  return *exitCode;
+  saveReadingPositions();
+  return exitCode;
+}
+
+
+// Shows the inputs given in args, styled according to args
+std::optional<int> run(
+  SDL_Window* pWindow,
+  const cxxopts::ParseResult& args,
+  FontManager& fontManager,
+  LatencyProbe* pLatencyProbe)
+{
+  // Change the background to red if the --error_display option is given
+  const auto isErrorDisplay = args.count("error_display") > 0;
+  if (isErrorDisplay)
+  {
+    ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(ImColor(94, 11, 22, 255))); // Set window background to red
+    ImGui::PushStyleColor(ImGuiCol_TitleBgActive, ImVec4(ImColor(94, 11, 22, 255)));
+  }
+
+  const auto exitCode =
+    showInputs(pWindow, args, fontManager, pLatencyProbe);
+
+  if (isErrorDisplay)
+  {
+    ImGui::PopStyleColor(2);
+  }
+
+  return exitCode;
+}
+
+
+// Parses the command line a client sent to the daemon. Relative paths
+// given on it refer to the client's working directory, so that becomes
+// ours as well.
+std::optional<cxxopts::ParseResult> parseRequest(const DaemonRequest& request)
+{
+  if (
+    request.arguments.empty() ||
+    chdir(request.workingDirectory.c_str()) != 0)
+  {
+    return {};
+  }
+
+  // cxxopts wants mutable C strings
+  auto arguments = request.arguments;
+  std::vector<char*> argv;
+  for (auto& argument : arguments)
+  {
+    argv.push_back(argument.data());
+  }
+  argv.push_back(nullptr);
+
+  // A client asking for help would otherwise make the daemon exit. The
+  // client handles that itself before connecting anyway.
+  auto args = parseArgs(
+    static_cast<int>(arguments.size()), argv.data(), false);
+  if (args && args->count("daemon"))
+  {
+    return {};
+  }
+
+  return args;
+}
+
+
+// Main loop of the daemon. The window stays hidden until a client asks us
+// to show something. Everything else, like the OpenGL context and the font
+// atlases, is kept around in between, which is what makes showing the
+// client's text fast.
+void runDaemon(
+  SDL_Window* pWindow,
+  DaemonSocket& socket,
+  FontManager& fontManager,
+  LatencyProbe* pLatencyProbe)
+{
+  using namespace std::chrono_literals;
+
+  SDL_HideWindow(pWindow);
+
+  // Clients are waiting for their reply, so we only check for the signal
+  // to quit in between them
+  const auto pollInterval = 100ms;
+
+  while (true)
+  {
+    // Controllers might be plugged in or removed while we're waiting
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+      ImGui_ImplSDL2_ProcessEvent(&event);
+
+      if (event.type == SDL_QUIT)
+      {
+        return;
+      }
+    }
+
+    const auto pConnection = socket.accept(pollInterval);
+    if (!pConnection)
+    {
+      continue;
+    }
+
+    const auto args = parseRequest(pConnection->request());
+    if (!args)
+    {
+      pConnection->reply(-2);
+      continue;
+    }
+
+    SDL_ShowWindow(pWindow);
+    SDL_RaiseWindow(pWindow);
+
+    const auto exitCode = run(pWindow, *args, fontManager, pLatencyProbe);
+    pConnection->reply(exitCode.value_or(0));
+
+    if (!exitCode)
+    {
+      return;
+    }
+
+    // Some platforms can't hide a full-screen window, so we at least make
+    // sure the text that was shown doesn't stay visible
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplSDL2_NewFrame(pWindow);
+    ImGui::NewFrame();
+    ImGui::Render();
+    FramePresenter{pWindow}.present(*ImGui::GetDrawData());
+
+    SDL_HideWindow(pWindow);
+  }
 }
 
 }
@@ -340,6 +1036,43 @@ int main(int argc, char** argv)
 
   const auto& args = *oArgs;
 
+  // Leave showing the text to the daemon if there is one. Otherwise, we
+  // do it ourselves, just a bit slower.
+  if (args.count("client"))
+  {
+    const auto socketPath = args["client"].as<std::string>();
+
+    DaemonRequest request;
+    if (const auto pWorkingDirectory = getcwd(nullptr, 0))
+    {
+      request.workingDirectory = pWorkingDirectory;
+      std::free(pWorkingDirectory);
+    }
+
+    request.arguments.assign(argv, argv + argc);
+
+    if (const auto exitCode = sendToDaemon(socketPath, request))
+    {
+      return *exitCode;
+    }
+
+    std::cerr << "Warning: No daemon listening on " << socketPath << '\n';
+  }
+
+  // Claim the socket before doing anything else, so that clients don't
+  // wait for a daemon that's going to fail
+  std::unique_ptr<DaemonSocket> pDaemonSocket;
+  if (args.count("daemon"))
+  {
+    pDaemonSocket = DaemonSocket::listen(args["daemon"].as<std::string>());
+    if (!pDaemonSocket)
+    {
+      std::cerr
+        << "Error: Cannot listen on " << args["daemon"].as<std::string>()
+        << ", is another daemon using it?\n";
+      return -1;
+    }
+  }
 
   // Read the SDL_GAMECONTROLLERCONFIG_FILE environment variable
   // and load the controller mapping database file that it points to,
@@ -391,9 +1124,25 @@ int main(int argc, char** argv)
   SDL_GL_MakeCurrent(pWindow, pGlContext);
   SDL_GL_SetSwapInterval(1); // Enable vsync
 
+  // Setup the font atlases, applying the requested font file and size.
+  // The atlases are owned by the FontManager and shared with ImGui.
+  std::optional<std::string> fontFile;
+  if (args.count("font"))
+  {
+    fontFile = args["font"].as<std::string>();
+  }
+
+  std::optional<float> fontSize;
+  if (args.count("font_size"))
+  {
+    fontSize = static_cast<float>(args["font_size"].as<int>());
+  }
+
+  auto fontManager = FontManager{fontFile, fontSize};
+
   // Setup Dear ImGui context
   IMGUI_CHECKVERSION();
-  ImGui::CreateContext();
+  ImGui::CreateContext(fontManager.atlas());
   auto& io = ImGui::GetIO();
   io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
   io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
@@ -404,28 +1153,47 @@ int main(int argc, char** argv)
   // Setup Dear ImGui style
   ImGui::StyleColorsDark();
 
-  // Change the background to red if the --error_display option is given
-  if (args.count("error_display")) {
-    ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(ImColor(94, 11, 22, 255))); // Set window background to red
-    ImGui::PushStyleColor(ImGuiCol_TitleBgActive, ImVec4(ImColor(94, 11, 22, 255)));
-  }
+  // Setup Platform/Renderer bindings
+  ImGui_ImplSDL2_InitForOpenGL(pWindow, pGlContext);
+  ImGui_ImplOpenGL3_Init(nullptr);
 
-  // Apply the requested font size 
-  if (args.count("font_size"))
+  // Font textures are managed by the FontManager. Let the renderer create
+  // its device objects now, and get rid of the font texture that comes
+  // with them, so that it doesn't replace ours on the first frame.
+  ImGui_ImplOpenGL3_CreateDeviceObjects();
+  ImGui_ImplOpenGL3_DestroyFontsTexture();
+
+  // Only the daemon's own options decide whether latency is measured,
+  // which covers all texts it shows
+  std::optional<LatencyProbe> latencyProbe;
+  if (args.count("latency_probe"))
   {
-    ImFontConfig config;
-    config.SizePixels = args["font_size"].as<int>();
-    ImGui::GetIO().Fonts->AddFontDefault(&config);
+    latencyProbe.emplace(
+      pWindow,
+      args["latency_probe"].as<std::string>() == "finish",
+      args.count("render_late") > 0);
   }
 
-  // Setup Platform/Renderer bindings
-  ImGui_ImplSDL2_InitForOpenGL(pWindow, pGlContext);
-  ImGui_ImplOpenGL3_Init(nullptr);
+  const auto pLatencyProbe = latencyProbe ? &*latencyProbe : nullptr;
 
   // Main loop
-  const auto exitCode = run(pWindow, args);
+  auto exitCode = 0;
+  if (pDaemonSocket)
+  {
+    runDaemon(pWindow, *pDaemonSocket, fontManager, pLatencyProbe);
+  }
+  else
+  {
+    exitCode = run(pWindow, args, fontManager, pLatencyProbe).value_or(0);
+  }
+
+  if (latencyProbe)
+  {
+    std::cerr << latencyProbe->report();
+  }
 
   // Cleanup
+  fontManager.destroyTextures();
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplSDL2_Shutdown();
   ImGui::DestroyContext();
@@ -0,0 +1,82 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+  {
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0)
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  const auto size = static_cast<std::size_t>(info.st_size);
+  const auto pData = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // The mapping stays valid after closing the file descriptor
+  close(fd);
+
+  if (pData == MAP_FAILED)
+  {
+    return nullptr;
+  }
+
+  return std::unique_ptr<MappedFile>(new MappedFile(pData, size));
+}
+
+
+MappedFile::MappedFile(const void* pData, const std::size_t size)
+  : mpData(pData)
+  , mSize(size)
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+  munmap(const_cast<void*>(mpData), mSize);
+}
+
+
+const char* MappedFile::data() const
+{
+  return static_cast<const char*>(mpData);
+}
+
+
+std::size_t MappedFile::size() const
+{
+  return mSize;
+}
@@ -0,0 +1,185 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "output_writer.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+
+
+namespace
+{
+
+constexpr std::size_t BLOCK_SIZE = 4096;
+
+// Once data arrives, we wait this long for more before writing it, unless
+// enough for a full batch has been collected before
+constexpr auto BATCH_INTERVAL = std::chrono::milliseconds(100);
+constexpr std::size_t BATCH_SIZE = 64 * 1024;
+
+constexpr auto SYNC_INTERVAL = std::chrono::seconds(1);
+
+
+bool writeAll(const int fd, const char* pData, std::size_t size, off_t offset)
+{
+  while (size > 0)
+  {
+    const auto bytesWritten = pwrite(fd, pData, size, offset);
+    if (bytesWritten < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    pData += bytesWritten;
+    size -= bytesWritten;
+    offset += bytesWritten;
+  }
+
+  return true;
+}
+
+}
+
+
+std::unique_ptr<OutputWriter> OutputWriter::create(const std::string& path)
+{
+  const auto fd =
+    open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+  {
+    return nullptr;
+  }
+
+  return std::unique_ptr<OutputWriter>(new OutputWriter(fd));
+}
+
+
+OutputWriter::OutputWriter(const int fd)
+  : mFd(fd)
+  , mThread([this]() { run(); })
+{
+}
+
+
+OutputWriter::~OutputWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsFinishing = true;
+  }
+
+  mDataAvailable.notify_one();
+  mThread.join();
+  close(mFd);
+}
+
+
+void OutputWriter::append(const char* pBegin, const char* pEnd)
+{
+  if (pBegin == pEnd || mHasFailed)
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingData.insert(mPendingData.end(), pBegin, pEnd);
+  }
+
+  mDataAvailable.notify_one();
+}
+
+
+bool OutputWriter::hasFailed() const
+{
+  return mHasFailed;
+}
+
+
+void OutputWriter::run()
+{
+  // Data that hasn't been written yet, preceded by the last partial block
+  // that has been written already. Starts at a block boundary, which is
+  // at bufferOffset in the file.
+  std::vector<char> buffer;
+  off_t bufferOffset = 0;
+
+  auto lastSyncTime = std::chrono::steady_clock::now();
+  auto needsSync = false;
+
+  for (auto isFinishing = false; !isFinishing; )
+  {
+    std::vector<char> newData;
+
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mDataAvailable.wait_for(lock, SYNC_INTERVAL, [this]()
+      {
+        return !mPendingData.empty() || mIsFinishing;
+      });
+
+      if (!mPendingData.empty() && !mIsFinishing)
+      {
+        mDataAvailable.wait_for(lock, BATCH_INTERVAL, [this]()
+        {
+          return mPendingData.size() >= BATCH_SIZE || mIsFinishing;
+        });
+      }
+
+      newData.swap(mPendingData);
+      isFinishing = mIsFinishing;
+    }
+
+    if (!newData.empty() && !mHasFailed)
+    {
+      buffer.insert(buffer.end(), newData.begin(), newData.end());
+
+      if (!writeAll(mFd, buffer.data(), buffer.size(), bufferOffset))
+      {
+        mHasFailed = true;
+        continue;
+      }
+
+      // Only keep the partial block at the end, so that the next write
+      // starts at a block boundary again
+      const auto completeBytes = buffer.size() / BLOCK_SIZE * BLOCK_SIZE;
+      buffer.erase(buffer.begin(), buffer.begin() + completeBytes);
+      bufferOffset += completeBytes;
+      needsSync = true;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (needsSync && (isFinishing || now - lastSyncTime >= SYNC_INTERVAL))
+    {
+      fdatasync(mFd);
+      lastSyncTime = now;
+      needsSync = false;
+    }
+  }
+}
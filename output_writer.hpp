@@ -0,0 +1,77 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Writes data to a file on a background thread, so that the caller never
+// has to wait for (possibly slow) storage.
+//
+// Data is written in batches, each starting at a 4 KiB boundary: A partial
+// block at the end is written right away, but written again together with
+// the data following it once that arrives. This keeps the file complete
+// up to the last batch even if the process gets killed, while writes stay
+// aligned to the storage's block size. The file is also synced to disk
+// periodically.
+class OutputWriter {
+public:
+  // Returns nullptr if the file can't be created
+  static std::unique_ptr<OutputWriter> create(const std::string& path);
+
+  // Writes all remaining data and waits for it to be synced to disk
+  ~OutputWriter();
+
+  OutputWriter(const OutputWriter&) = delete;
+  OutputWriter& operator=(const OutputWriter&) = delete;
+
+  // Queues the given bytes for writing. Doesn't block on I/O.
+  void append(const char* pBegin, const char* pEnd);
+
+  // True once writing failed, e.g. because the disk is full. No further
+  // data is written in that case.
+  bool hasFailed() const;
+
+private:
+  explicit OutputWriter(int fd);
+
+  void run();
+
+  int mFd;
+
+  std::mutex mMutex;
+  std::condition_variable mDataAvailable;
+  std::vector<char> mPendingData;
+  bool mIsFinishing = false;
+
+  std::atomic<bool> mHasFailed{false};
+
+  // Declared last, so that everything the thread uses is initialized
+  // before it starts
+  std::thread mThread;
+};
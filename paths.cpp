@@ -0,0 +1,77 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "paths.hpp"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdlib>
+
+
+namespace
+{
+
+std::string xdgDirectory(const char* variable, const char* defaultInHome)
+{
+  if (const auto pDirectory = std::getenv(variable); pDirectory && *pDirectory)
+  {
+    return std::string{pDirectory} + "/tvtextviewer";
+  }
+  else if (const auto pHome = std::getenv("HOME"))
+  {
+    return std::string{pHome} + '/' + defaultInHome + "/tvtextviewer";
+  }
+
+  return {};
+}
+
+}
+
+
+std::string stateDirectory()
+{
+  return xdgDirectory("XDG_STATE_HOME", ".local/state");
+}
+
+
+std::string cacheDirectory()
+{
+  return xdgDirectory("XDG_CACHE_HOME", ".cache");
+}
+
+
+bool makeDirectories(const std::string& path)
+{
+  for (auto pos = path.find('/', 1); ; pos = path.find('/', pos + 1))
+  {
+    const auto partialPath = path.substr(0, pos);
+    if (mkdir(partialPath.c_str(), 0700) != 0 && errno != EEXIST)
+    {
+      return false;
+    }
+
+    if (pos == std::string::npos)
+    {
+      return true;
+    }
+  }
+}
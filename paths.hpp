@@ -0,0 +1,40 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <string>
+
+
+// Directory for state that should persist across runs, like reading
+// positions: $XDG_STATE_HOME/tvtextviewer, or ~/.local/state/tvtextviewer
+// by default. Returns an empty string if neither XDG_STATE_HOME nor
+// HOME are set.
+std::string stateDirectory();
+
+// Directory for data that can be recreated at any time, like line index
+// caches: $XDG_CACHE_HOME/tvtextviewer, or ~/.cache/tvtextviewer by default.
+// Returns an empty string if neither XDG_CACHE_HOME nor HOME are set.
+std::string cacheDirectory();
+
+// Creates the given directory and any missing parents. Returns true if the
+// directory exists afterwards.
+bool makeDirectories(const std::string& path);
@@ -0,0 +1,216 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "position_store.hpp"
+
+#include "hash.hpp"
+#include "paths.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+namespace
+{
+
+// How many bytes from the start of a file are hashed to identify it
+constexpr auto HEAD_SIZE = 4096;
+
+// How many files we remember positions for
+constexpr auto MAX_ENTRIES = 200;
+
+
+// Produces the key identifying a file within the store file
+std::string makeKey(const FileIdentity& file)
+{
+  std::ostringstream stream;
+  stream
+    << std::hex
+    << file.device << ':'
+    << file.inode << ':'
+    << file.size << ':'
+    << file.modificationTime << ':'
+    << file.headHash;
+  return stream.str();
+}
+
+
+// Reads all lines of the store file
+std::vector<std::string> readEntries(const std::string& storeFile)
+{
+  std::vector<std::string> entries;
+
+  std::ifstream file(storeFile);
+  for (std::string line; std::getline(file, line); )
+  {
+    if (!line.empty())
+    {
+      entries.push_back(std::move(line));
+    }
+  }
+
+  return entries;
+}
+
+}
+
+
+std::optional<FileIdentity> identifyFile(const std::string& path)
+{
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+  {
+    return {};
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    close(fd);
+    return {};
+  }
+
+  char head[HEAD_SIZE];
+  const auto bytesRead = read(fd, head, sizeof(head));
+  close(fd);
+
+  if (bytesRead < 0)
+  {
+    return {};
+  }
+
+  return FileIdentity{
+    static_cast<std::uint64_t>(info.st_dev),
+    static_cast<std::uint64_t>(info.st_ino),
+    static_cast<std::uint64_t>(info.st_size),
+    static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1'000'000'000 +
+      info.st_mtim.tv_nsec,
+    hashBytes(head, static_cast<std::size_t>(bytesRead))};
+}
+
+
+PositionStore::PositionStore()
+{
+  // If there's nowhere to store anything, load() and save() won't
+  // do anything
+  if (const auto directory = stateDirectory(); !directory.empty())
+  {
+    mStoreFile = directory + "/positions";
+  }
+}
+
+
+std::optional<ReadingPosition> PositionStore::load(const FileIdentity& file) const
+{
+  if (mStoreFile.empty())
+  {
+    return {};
+  }
+
+  // Each entry has the form: <key> <top line> [<bookmark> ...]
+  // Later entries take precedence, so we look at the most recent ones first.
+  const auto key = makeKey(file);
+  const auto entries = readEntries(mStoreFile);
+  for (auto iEntry = entries.rbegin(); iEntry != entries.rend(); ++iEntry)
+  {
+    std::istringstream stream{*iEntry};
+
+    std::string entryKey;
+    ReadingPosition position;
+    if (!(stream >> entryKey >> position.topLine) || entryKey != key)
+    {
+      continue;
+    }
+
+    for (std::size_t bookmark; stream >> bookmark; )
+    {
+      position.bookmarks.push_back(bookmark);
+    }
+
+    return position;
+  }
+
+  return {};
+}
+
+
+void PositionStore::save(
+  const FileIdentity& file,
+  const ReadingPosition& position)
+{
+  if (mStoreFile.empty())
+  {
+    return;
+  }
+
+  const auto directory = mStoreFile.substr(0, mStoreFile.rfind('/'));
+  if (!makeDirectories(directory))
+  {
+    return;
+  }
+
+  // Drop any previous entry for the same file, and the oldest entries
+  // if there are too many
+  const auto key = makeKey(file);
+  auto entries = readEntries(mStoreFile);
+  entries.erase(
+    std::remove_if(entries.begin(), entries.end(), [&](const std::string& entry) {
+      return entry.compare(0, key.size() + 1, key + ' ') == 0;
+    }),
+    entries.end());
+
+  if (entries.size() >= MAX_ENTRIES)
+  {
+    entries.erase(entries.begin(), entries.end() - (MAX_ENTRIES - 1));
+  }
+
+  std::ostringstream newEntry;
+  newEntry << key << ' ' << position.topLine;
+  for (const auto bookmark : position.bookmarks)
+  {
+    newEntry << ' ' << bookmark;
+  }
+  entries.push_back(newEntry.str());
+
+  // Write to a temporary file first and then replace the store, so that
+  // it doesn't get corrupted if we are interrupted while writing
+  const auto tempFile = mStoreFile + ".tmp";
+  {
+    std::ofstream out(tempFile, std::ios::trunc);
+    for (const auto& entry : entries)
+    {
+      out << entry << '\n';
+    }
+
+    if (!out)
+    {
+      return;
+    }
+  }
+
+  std::rename(tempFile.c_str(), mStoreFile.c_str());
+}
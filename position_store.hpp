@@ -0,0 +1,70 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Identifies a file across runs of the viewer. Besides the file system
+// metadata, a hash of the file's first block is included to guard against
+// inodes being reused for a different file.
+struct FileIdentity
+{
+  std::uint64_t device;
+  std::uint64_t inode;
+  std::uint64_t size;
+  std::int64_t modificationTime;
+  std::uint64_t headHash;
+};
+
+
+struct ReadingPosition
+{
+  std::size_t topLine = 0;
+  std::vector<std::size_t> bookmarks;
+};
+
+
+// Returns the identity of the given file, or an empty optional if the
+// file can't be accessed.
+std::optional<FileIdentity> identifyFile(const std::string& path);
+
+
+// Remembers reading positions and bookmarks of previously viewed files.
+//
+// The positions are kept in a small text file in $XDG_STATE_HOME
+// (~/.local/state by default). Only the most recently viewed files
+// are remembered.
+class PositionStore {
+public:
+  PositionStore();
+
+  std::optional<ReadingPosition> load(const FileIdentity& file) const;
+  void save(const FileIdentity& file, const ReadingPosition& position);
+
+private:
+  std::string mStoreFile;
+};
@@ -0,0 +1,1031 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+
+namespace
+{
+
+// Limits that keep compiling and matching cheap, no matter what was typed
+constexpr int MAX_REPETITIONS = 1000;
+constexpr int MAX_NESTING_DEPTH = 200;
+constexpr std::size_t MAX_NFA_STATES = 20000;
+constexpr std::size_t MAX_DFA_STATES = 2000;
+
+
+// Syntax tree of a parsed pattern
+struct Node
+{
+  enum class Type
+  {
+    Empty,
+    Bytes,
+    Concat,
+    Alternate,
+    Repeat,
+    LineStart,
+    LineEnd
+  };
+
+  Type type = Type::Empty;
+  std::bitset<256> bytes;
+  std::vector<Node> children;
+  int minRepetitions = 0;
+  int maxRepetitions = -1; // -1 means unbounded
+};
+
+
+std::bitset<256> byteRange(const int first, const int last)
+{
+  std::bitset<256> bytes;
+  for (auto byte = first; byte <= last; ++byte)
+  {
+    bytes.set(byte);
+  }
+
+  return bytes;
+}
+
+
+std::bitset<256> wordBytes()
+{
+  auto bytes =
+    byteRange('a', 'z') | byteRange('A', 'Z') | byteRange('0', '9');
+  bytes.set('_');
+  return bytes;
+}
+
+
+std::bitset<256> spaceBytes()
+{
+  std::bitset<256> bytes;
+  for (const auto byte : {' ', '\t', '\n', '\r', '\f', '\v'})
+  {
+    bytes.set(static_cast<unsigned char>(byte));
+  }
+
+  return bytes;
+}
+
+
+// Lines never contain a linebreak, so we make sure that nothing can
+// match one. This keeps negated classes from matching across lines.
+std::bitset<256> withoutNewline(std::bitset<256> bytes)
+{
+  bytes.reset('\n');
+  return bytes;
+}
+
+
+class Parser {
+public:
+  explicit Parser(const std::string_view pattern)
+    : mPattern(pattern)
+  {
+    // (?i) is only supported for the whole pattern
+    constexpr auto IGNORE_CASE_FLAG = std::string_view{"(?i)"};
+    if (mPattern.substr(0, IGNORE_CASE_FLAG.size()) == IGNORE_CASE_FLAG)
+    {
+      mIgnoreCase = true;
+      mPosition = IGNORE_CASE_FLAG.size();
+    }
+  }
+
+  Node parse()
+  {
+    auto node = parseAlternation();
+    if (!atEnd())
+    {
+      // The only way to stop early is an unbalanced closing parenthesis
+      fail("unmatched )");
+    }
+
+    return node;
+  }
+
+  bool ignoresCase() const
+  {
+    return mIgnoreCase;
+  }
+
+private:
+  [[noreturn]] void fail(const std::string& message) const
+  {
+    throw std::invalid_argument(message);
+  }
+
+  bool atEnd() const
+  {
+    return mPosition >= mPattern.size();
+  }
+
+  char peek() const
+  {
+    return mPattern[mPosition];
+  }
+
+  bool consume(const char c)
+  {
+    if (!atEnd() && peek() == c)
+    {
+      ++mPosition;
+      return true;
+    }
+
+    return false;
+  }
+
+  Node parseAlternation()
+  {
+    if (++mDepth > MAX_NESTING_DEPTH)
+    {
+      fail("too many nested groups");
+    }
+
+    Node node;
+    node.type = Node::Type::Alternate;
+    node.children.push_back(parseConcat());
+    while (consume('|'))
+    {
+      node.children.push_back(parseConcat());
+    }
+
+    --mDepth;
+
+    if (node.children.size() == 1)
+    {
+      return std::move(node.children.front());
+    }
+
+    return node;
+  }
+
+  Node parseConcat()
+  {
+    Node node;
+    node.type = Node::Type::Concat;
+    while (!atEnd() && peek() != '|' && peek() != ')')
+    {
+      node.children.push_back(parseRepeat());
+    }
+
+    return node;
+  }
+
+  Node parseRepeat()
+  {
+    auto node = parseAtom();
+
+    while (!atEnd())
+    {
+      auto minRepetitions = 0;
+      auto maxRepetitions = -1;
+
+      if (consume('*'))
+      {
+      }
+      else if (consume('+'))
+      {
+        minRepetitions = 1;
+      }
+      else if (consume('?'))
+      {
+        maxRepetitions = 1;
+      }
+      else if (consume('{'))
+      {
+        minRepetitions = parseNumber();
+        maxRepetitions = minRepetitions;
+        if (consume(','))
+        {
+          maxRepetitions = !atEnd() && peek() == '}' ? -1 : parseNumber();
+        }
+
+        if (!consume('}'))
+        {
+          fail("missing } in repetition");
+        }
+
+        if (maxRepetitions != -1 && maxRepetitions < minRepetitions)
+        {
+          fail("invalid repetition range");
+        }
+      }
+      else
+      {
+        break;
+      }
+
+      // Lazy quantifier. Doesn't make a difference for finding lines.
+      consume('?');
+
+      Node repeat;
+      repeat.type = Node::Type::Repeat;
+      repeat.minRepetitions = minRepetitions;
+      repeat.maxRepetitions = maxRepetitions;
+      repeat.children.push_back(std::move(node));
+      node = std::move(repeat);
+    }
+
+    return node;
+  }
+
+  int parseNumber()
+  {
+    if (atEnd() || !std::isdigit(static_cast<unsigned char>(peek())))
+    {
+      fail("expected a number in repetition");
+    }
+
+    auto number = 0;
+    while (!atEnd() && std::isdigit(static_cast<unsigned char>(peek())))
+    {
+      number = number * 10 + (mPattern[mPosition++] - '0');
+      if (number > MAX_REPETITIONS)
+      {
+        fail("repetition count too large");
+      }
+    }
+
+    return number;
+  }
+
+  Node parseAtom()
+  {
+    const auto c = mPattern[mPosition++];
+
+    switch (c)
+    {
+      case '(':
+        {
+          if (consume('?'))
+          {
+            if (!consume(':'))
+            {
+              fail("unsupported group type");
+            }
+          }
+
+          auto node = parseAlternation();
+          if (!consume(')'))
+          {
+            fail("missing )");
+          }
+
+          return node;
+        }
+
+      case '[':
+        return bytesNode(parseClass());
+
+      case '.':
+        return bytesNode(withoutNewline(std::bitset<256>{}.set()));
+
+      case '^':
+        {
+          Node node;
+          node.type = Node::Type::LineStart;
+          return node;
+        }
+
+      case '$':
+        {
+          Node node;
+          node.type = Node::Type::LineEnd;
+          return node;
+        }
+
+      case '\\':
+        return bytesNode(parseEscape());
+
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        fail("nothing to repeat");
+
+      default:
+        return bytesNode(std::bitset<256>{}.set(static_cast<unsigned char>(c)));
+    }
+  }
+
+  std::bitset<256> parseEscape()
+  {
+    if (atEnd())
+    {
+      fail("trailing backslash");
+    }
+
+    const auto c = mPattern[mPosition++];
+    switch (c)
+    {
+      case 'd': return byteRange('0', '9');
+      case 'D': return withoutNewline(~byteRange('0', '9'));
+      case 'w': return wordBytes();
+      case 'W': return withoutNewline(~wordBytes());
+      case 's': return spaceBytes();
+      case 'S': return withoutNewline(~spaceBytes());
+      case 't': return std::bitset<256>{}.set('\t');
+      case 'r': return std::bitset<256>{}.set('\r');
+      case 'f': return std::bitset<256>{}.set('\f');
+      case 'v': return std::bitset<256>{}.set('\v');
+      case 'n': return std::bitset<256>{}.set('\n');
+
+      case 'x':
+        {
+          auto value = 0;
+          for (auto i = 0; i < 2; ++i)
+          {
+            if (atEnd() || !std::isxdigit(static_cast<unsigned char>(peek())))
+            {
+              fail("expected two hex digits after \\x");
+            }
+
+            const auto digit = mPattern[mPosition++];
+            value = value * 16 + (std::isdigit(static_cast<unsigned char>(digit))
+              ? digit - '0'
+              : std::tolower(static_cast<unsigned char>(digit)) - 'a' + 10);
+          }
+
+          return std::bitset<256>{}.set(value);
+        }
+
+      default:
+        // Escaping letters or digits that have no special meaning is most
+        // likely a mistake, e.g. an unsupported backreference
+        if (std::isalnum(static_cast<unsigned char>(c)))
+        {
+          fail(std::string{"unsupported escape \\"} + c);
+        }
+
+        return std::bitset<256>{}.set(static_cast<unsigned char>(c));
+    }
+  }
+
+  std::bitset<256> parseClass()
+  {
+    const auto isNegated = consume('^');
+
+    std::bitset<256> bytes;
+    auto isFirst = true;
+    while (true)
+    {
+      if (atEnd())
+      {
+        fail("missing ]");
+      }
+
+      // A ] right at the start is taken literally
+      if (peek() == ']' && !isFirst)
+      {
+        ++mPosition;
+        break;
+      }
+
+      isFirst = false;
+
+      const auto first = parseClassElement();
+      if (
+        first.count() == 1 &&
+        mPosition + 1 < mPattern.size() &&
+        peek() == '-' &&
+        mPattern[mPosition + 1] != ']')
+      {
+        ++mPosition;
+        const auto last = parseClassElement();
+        if (last.count() != 1)
+        {
+          fail("invalid range in class");
+        }
+
+        const auto rangeStart = firstByte(first);
+        const auto rangeEnd = firstByte(last);
+        if (rangeEnd < rangeStart)
+        {
+          fail("invalid range in class");
+        }
+
+        bytes |= byteRange(rangeStart, rangeEnd);
+      }
+      else
+      {
+        bytes |= first;
+      }
+    }
+
+    return isNegated ? withoutNewline(~bytes) : bytes;
+  }
+
+  std::bitset<256> parseClassElement()
+  {
+    const auto c = mPattern[mPosition++];
+    if (c == '\\')
+    {
+      return parseEscape();
+    }
+
+    return std::bitset<256>{}.set(static_cast<unsigned char>(c));
+  }
+
+  static int firstByte(const std::bitset<256>& bytes)
+  {
+    for (auto byte = 0; byte < 256; ++byte)
+    {
+      if (bytes[byte])
+      {
+        return byte;
+      }
+    }
+
+    return -1;
+  }
+
+  Node bytesNode(std::bitset<256> bytes) const
+  {
+    if (mIgnoreCase)
+    {
+      for (auto byte = 'a'; byte <= 'z'; ++byte)
+      {
+        const auto upper = byte - 'a' + 'A';
+        if (bytes[byte] || bytes[upper])
+        {
+          bytes.set(byte);
+          bytes.set(upper);
+        }
+      }
+    }
+
+    Node node;
+    node.type = Node::Type::Bytes;
+    node.bytes = bytes;
+    return node;
+  }
+
+  std::string_view mPattern;
+  std::size_t mPosition = 0;
+  int mDepth = 0;
+  bool mIgnoreCase = false;
+};
+
+
+// Collects the bytes that every match has to start with
+void collectLiteralPrefix(const Node& node, std::string& prefix, bool& isComplete)
+{
+  switch (node.type)
+  {
+    case Node::Type::Bytes:
+      if (node.bytes.count() == 1)
+      {
+        for (auto byte = 0; byte < 256; ++byte)
+        {
+          if (node.bytes[byte])
+          {
+            prefix.push_back(static_cast<char>(byte));
+          }
+        }
+      }
+      else
+      {
+        isComplete = true;
+      }
+      break;
+
+    case Node::Type::Concat:
+      for (const auto& child : node.children)
+      {
+        if (isComplete)
+        {
+          break;
+        }
+
+        collectLiteralPrefix(child, prefix, isComplete);
+      }
+      break;
+
+    case Node::Type::LineStart:
+      // Doesn't consume anything, the prefix can continue after it
+      break;
+
+    default:
+      isComplete = true;
+      break;
+  }
+}
+
+}
+
+
+Regex::Regex(const std::string_view pattern)
+{
+  Parser parser{pattern};
+  const auto root = parser.parse();
+
+  // Compile the syntax tree into an NFA, using Thompson's construction.
+  // Each fragment has a start state and a list of dangling exits, which
+  // are connected to whatever follows the fragment.
+  struct Exit
+  {
+    int state;
+    bool isAlternative;
+  };
+
+  struct Fragment
+  {
+    int start;
+    std::vector<Exit> exits;
+  };
+
+  auto addState = [this](const State::Type type)
+  {
+    if (mStates.size() >= MAX_NFA_STATES)
+    {
+      throw std::invalid_argument("pattern too complex");
+    }
+
+    mStates.push_back(State{type, {}, -1, -1});
+    return static_cast<int>(mStates.size() - 1);
+  };
+
+  auto connect = [this](const std::vector<Exit>& exits, const int target)
+  {
+    for (const auto& exit : exits)
+    {
+      if (exit.isAlternative)
+      {
+        mStates[exit.state].alternative = target;
+      }
+      else
+      {
+        mStates[exit.state].next = target;
+      }
+    }
+  };
+
+  auto emptyFragment = [&]()
+  {
+    const auto state = addState(State::Type::Empty);
+    return Fragment{state, {{state, false}}};
+  };
+
+  std::function<Fragment(const Node&)> compile = [&](const Node& node)
+  {
+    switch (node.type)
+    {
+      case Node::Type::Empty:
+        return emptyFragment();
+
+      case Node::Type::Bytes:
+        {
+          const auto state = addState(State::Type::Bytes);
+          mStates[state].bytes = node.bytes;
+          return Fragment{state, {{state, false}}};
+        }
+
+      case Node::Type::LineStart:
+      case Node::Type::LineEnd:
+        {
+          const auto state = addState(node.type == Node::Type::LineStart
+            ? State::Type::LineStart
+            : State::Type::LineEnd);
+          return Fragment{state, {{state, false}}};
+        }
+
+      case Node::Type::Concat:
+        {
+          if (node.children.empty())
+          {
+            return emptyFragment();
+          }
+
+          auto fragment = compile(node.children.front());
+          for (auto i = std::size_t{1}; i < node.children.size(); ++i)
+          {
+            auto next = compile(node.children[i]);
+            connect(fragment.exits, next.start);
+            fragment.exits = std::move(next.exits);
+          }
+
+          return fragment;
+        }
+
+      case Node::Type::Alternate:
+        {
+          // A chain of splits, each one choosing between one of the
+          // branches and the rest of the chain
+          auto fragment = compile(node.children.back());
+          for (auto i = node.children.size() - 1; i-- > 0; )
+          {
+            auto branch = compile(node.children[i]);
+            const auto split = addState(State::Type::Split);
+            mStates[split].next = branch.start;
+            mStates[split].alternative = fragment.start;
+
+            fragment.start = split;
+            fragment.exits.insert(
+              fragment.exits.end(), branch.exits.begin(), branch.exits.end());
+          }
+
+          return fragment;
+        }
+
+      case Node::Type::Repeat:
+        {
+          const auto& child = node.children.front();
+
+          // The mandatory repetitions are simply copies of the child
+          auto fragment = emptyFragment();
+          for (auto i = 0; i < node.minRepetitions; ++i)
+          {
+            auto copy = compile(child);
+            connect(fragment.exits, copy.start);
+            fragment.exits = std::move(copy.exits);
+          }
+
+          if (node.maxRepetitions == -1)
+          {
+            // A loop: either go through the child and come back,
+            // or leave
+            auto loopBody = compile(child);
+            const auto split = addState(State::Type::Split);
+            mStates[split].next = loopBody.start;
+            connect(loopBody.exits, split);
+            connect(fragment.exits, split);
+            fragment.exits = {{split, true}};
+          }
+          else
+          {
+            // Optional repetitions, each one can be skipped to leave
+            std::vector<Exit> skipExits;
+            for (auto i = node.minRepetitions; i < node.maxRepetitions; ++i)
+            {
+              auto copy = compile(child);
+              const auto split = addState(State::Type::Split);
+              mStates[split].next = copy.start;
+              connect(fragment.exits, split);
+              skipExits.push_back({split, true});
+              fragment.exits = std::move(copy.exits);
+            }
+
+            fragment.exits.insert(
+              fragment.exits.end(), skipExits.begin(), skipExits.end());
+          }
+
+          return fragment;
+        }
+    }
+
+    return emptyFragment();
+  };
+
+  auto fragment = compile(root);
+  const auto match = addState(State::Type::Match);
+  connect(fragment.exits, match);
+  mStart = fragment.start;
+
+  if (!parser.ignoresCase())
+  {
+    auto isComplete = false;
+    collectLiteralPrefix(root, mLiteralPrefix, isComplete);
+  }
+}
+
+
+RegexMatcher::RegexMatcher(std::shared_ptr<const Regex> pRegex)
+  : mpRegex(std::move(pRegex))
+  , mVisitedGeneration(mpRegex->mStates.size(), 0)
+{
+  ++mGeneration;
+  addClosure(mUnanchoredStart, mpRegex->mStart, false);
+  std::sort(mUnanchoredStart.begin(), mUnanchoredStart.end());
+}
+
+
+const char* RegexMatcher::findMatchingLine(
+  const char* pBegin,
+  const char* pEnd,
+  const bool isEndOfText)
+{
+  auto pLineStart = pBegin;
+  while (pLineStart < pEnd)
+  {
+    if (!mpRegex->mLiteralPrefix.empty())
+    {
+      // Skip straight to the next line that contains the prefix
+      const auto pCandidate = findLiteralPrefix(pLineStart, pEnd);
+      if (!pCandidate)
+      {
+        return nullptr;
+      }
+
+      const auto pPreviousLinebreak = static_cast<const char*>(
+        memrchr(pLineStart, '\n', pCandidate - pLineStart));
+      if (pPreviousLinebreak)
+      {
+        pLineStart = pPreviousLinebreak + 1;
+      }
+    }
+
+    auto pLineEnd = static_cast<const char*>(
+      std::memchr(pLineStart, '\n', pEnd - pLineStart));
+    if (!pLineEnd)
+    {
+      pLineEnd = pEnd;
+    }
+
+    if (matchesLine(pLineStart, pLineEnd))
+    {
+      return pLineStart;
+    }
+
+    pLineStart = pLineEnd + 1;
+  }
+
+  const auto hasEmptyLastLine =
+    isEndOfText && (pBegin == pEnd || *(pEnd - 1) == '\n');
+  if (hasEmptyLastLine && matchesLine(pEnd, pEnd))
+  {
+    return pEnd;
+  }
+
+  return nullptr;
+}
+
+
+bool RegexMatcher::matchesLine(const char* pBegin, const char* pEnd)
+{
+  auto state = lineStartState();
+
+  for (auto pByte = pBegin; pByte != pEnd; ++pByte)
+  {
+    if (mDfaStates[state].accepts)
+    {
+      return true;
+    }
+
+    const auto byte = static_cast<unsigned char>(*pByte);
+    auto next = mTransitions[state * 256 + byte];
+    if (next < 0)
+    {
+      next = nextState(state, byte);
+    }
+
+    state = next;
+
+    // No match can start or continue anymore, which happens
+    // for patterns anchored at the start of the line
+    if (mDfaStates[state].nfaStates.empty())
+    {
+      return false;
+    }
+  }
+
+  return mDfaStates[state].accepts || mDfaStates[state].acceptsAtLineEnd;
+}
+
+
+const char* RegexMatcher::findLiteralPrefix(
+  const char* pBegin,
+  const char* pEnd) const
+{
+  const auto& prefix = mpRegex->mLiteralPrefix;
+
+  auto pPosition = pBegin;
+  while (pEnd - pPosition >= static_cast<std::ptrdiff_t>(prefix.size()))
+  {
+    const auto pCandidate = static_cast<const char*>(std::memchr(
+      pPosition, prefix.front(), pEnd - pPosition - prefix.size() + 1));
+    if (!pCandidate)
+    {
+      return nullptr;
+    }
+
+    if (std::memcmp(pCandidate + 1, prefix.data() + 1, prefix.size() - 1) == 0)
+    {
+      return pCandidate;
+    }
+
+    pPosition = pCandidate + 1;
+  }
+
+  return nullptr;
+}
+
+
+int RegexMatcher::lineStartState()
+{
+  if (mLineStartState < 0)
+  {
+    std::vector<int> nfaStates;
+    ++mGeneration;
+    addClosure(nfaStates, mpRegex->mStart, true);
+    mLineStartState = findOrAddState(std::move(nfaStates));
+  }
+
+  return mLineStartState;
+}
+
+
+int RegexMatcher::nextState(const int state, const unsigned char byte)
+{
+  const auto& states = mpRegex->mStates;
+
+  std::vector<int> nfaStates;
+  ++mGeneration;
+  for (const auto nfaState : mDfaStates[state].nfaStates)
+  {
+    if (
+      states[nfaState].type == Regex::State::Type::Bytes &&
+      states[nfaState].bytes[byte])
+    {
+      addClosure(nfaStates, states[nfaState].next, false);
+    }
+  }
+
+  // A new match attempt can start at every position
+  for (const auto nfaState : mUnanchoredStart)
+  {
+    if (mVisitedGeneration[nfaState] != mGeneration)
+    {
+      mVisitedGeneration[nfaState] = mGeneration;
+      nfaStates.push_back(nfaState);
+    }
+  }
+
+  std::sort(nfaStates.begin(), nfaStates.end());
+
+  if (mDfaStates.size() >= MAX_DFA_STATES)
+  {
+    // Start over instead of growing without bounds. This invalidates
+    // the state we came from, but the caller only needs the new one.
+    mDfaStates.clear();
+    mTransitions.clear();
+    mStateIds.clear();
+    mLineStartState = -1;
+
+    return findOrAddState(std::move(nfaStates));
+  }
+
+  const auto next = findOrAddState(std::move(nfaStates));
+  mTransitions[state * 256 + byte] = next;
+  return next;
+}
+
+
+int RegexMatcher::findOrAddState(std::vector<int> nfaStates)
+{
+  const auto iExisting = mStateIds.find(nfaStates);
+  if (iExisting != mStateIds.end())
+  {
+    return iExisting->second;
+  }
+
+  auto accepts = false;
+  for (const auto nfaState : nfaStates)
+  {
+    if (mpRegex->mStates[nfaState].type == Regex::State::Type::Match)
+    {
+      accepts = true;
+    }
+  }
+
+  const auto acceptsAtLineEnd = reachesMatchAtLineEnd(nfaStates);
+
+  const auto id = static_cast<int>(mDfaStates.size());
+  mStateIds.emplace(nfaStates, id);
+  mDfaStates.push_back(DfaState{std::move(nfaStates), accepts, acceptsAtLineEnd});
+  mTransitions.resize(mTransitions.size() + 256, -1);
+
+  return id;
+}
+
+
+void RegexMatcher::addClosure(
+  std::vector<int>& nfaStates,
+  const int start,
+  const bool atLineStart)
+{
+  const auto& states = mpRegex->mStates;
+
+  // Iterative, since patterns like (((a))) would otherwise recurse
+  // once per nesting level
+  std::vector<int> pending{start};
+  while (!pending.empty())
+  {
+    const auto nfaState = pending.back();
+    pending.pop_back();
+
+    if (nfaState < 0 || mVisitedGeneration[nfaState] == mGeneration)
+    {
+      continue;
+    }
+
+    mVisitedGeneration[nfaState] = mGeneration;
+
+    const auto& state = states[nfaState];
+    switch (state.type)
+    {
+      case Regex::State::Type::Empty:
+        pending.push_back(state.next);
+        break;
+
+      case Regex::State::Type::Split:
+        pending.push_back(state.alternative);
+        pending.push_back(state.next);
+        break;
+
+      case Regex::State::Type::LineStart:
+        // Can only be passed at the start of a line, and is useless
+        // to keep around otherwise
+        if (atLineStart)
+        {
+          pending.push_back(state.next);
+        }
+        break;
+
+      case Regex::State::Type::Bytes:
+      case Regex::State::Type::LineEnd:
+      case Regex::State::Type::Match:
+        nfaStates.push_back(nfaState);
+        break;
+    }
+  }
+}
+
+
+bool RegexMatcher::reachesMatchAtLineEnd(const std::vector<int>& nfaStates)
+{
+  const auto& states = mpRegex->mStates;
+
+  // At the end of a line, $ can be passed as well. The generation
+  // counter can't be reused here, as we might be in the middle of
+  // computing a closure.
+  std::vector<bool> visited(states.size(), false);
+  std::vector<int> pending;
+  for (const auto nfaState : nfaStates)
+  {
+    if (states[nfaState].type == Regex::State::Type::LineEnd)
+    {
+      pending.push_back(nfaState);
+    }
+  }
+
+  while (!pending.empty())
+  {
+    const auto nfaState = pending.back();
+    pending.pop_back();
+
+    if (nfaState < 0 || visited[nfaState])
+    {
+      continue;
+    }
+
+    visited[nfaState] = true;
+
+    const auto& state = states[nfaState];
+    switch (state.type)
+    {
+      case Regex::State::Type::Match:
+        return true;
+
+      case Regex::State::Type::Split:
+        pending.push_back(state.alternative);
+        pending.push_back(state.next);
+        break;
+
+      case Regex::State::Type::Empty:
+      case Regex::State::Type::LineEnd:
+        pending.push_back(state.next);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return false;
+}
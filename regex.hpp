@@ -0,0 +1,139 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// A regular expression, compiled for finding lines that contain a match.
+//
+// Supported syntax: literal characters and escapes (\. \( \t \xHH etc.),
+// . [abc] [^a-z] \d \w \s \D \W \S, groups (...) and (?:...), alternation,
+// the quantifiers * + ? {n} {n,} {n,m}, ^ and $ for the start and end of
+// a line, and (?i) at the start of the pattern for case-insensitive
+// matching. Lazy quantifiers are accepted, but behave like the greedy ones,
+// since we only need to know whether a line matches. Backreferences and
+// lookaround aren't supported, as they can't be matched in linear time.
+//
+// Matching works on bytes: UTF-8 text can be searched for, but . and
+// negated classes match single bytes, not whole characters.
+class Regex {
+public:
+  // Throws std::invalid_argument describing the problem if the pattern
+  // is invalid or too complex.
+  explicit Regex(std::string_view pattern);
+
+private:
+  friend class RegexMatcher;
+
+  // A state of the (Thompson) NFA. Bytes states consume a byte, all
+  // others are passed without consuming input.
+  struct State
+  {
+    enum class Type
+    {
+      Bytes,
+      Empty,
+      Split,
+      LineStart,
+      LineEnd,
+      Match
+    };
+
+    Type type;
+    std::bitset<256> bytes;
+    int next = -1;
+    int alternative = -1;
+  };
+
+  std::vector<State> mStates;
+  int mStart;
+
+  // If all matches start with the same bytes, candidate lines can be
+  // found quickly by looking for these
+  std::string mLiteralPrefix;
+};
+
+
+// Finds lines matching a Regex, using a DFA that is built lazily while
+// matching. The number of DFA states is bounded: once the limit is reached,
+// all states are thrown away and built anew as needed. Each byte of input
+// therefore takes at most one DFA state construction, which keeps matching
+// linear in the size of the text, whatever the pattern.
+//
+// Matchers aren't thread-safe. Each thread needs its own.
+class RegexMatcher {
+public:
+  explicit RegexMatcher(std::shared_ptr<const Regex> pRegex);
+
+  // Returns the start of the first line in [pBegin, pEnd) that contains
+  // a match, or nullptr if there is none. pBegin must be the start of
+  // a line.
+  //
+  // If the range is the end of the text, an empty range or one ending in
+  // a linebreak is followed by an empty last line, starting at pEnd. It
+  // is searched as well, like any other empty line. Otherwise, whatever
+  // follows pEnd is left to the next call.
+  const char* findMatchingLine(
+    const char* pBegin,
+    const char* pEnd,
+    bool isEndOfText);
+
+private:
+  struct DfaState
+  {
+    std::vector<int> nfaStates;
+    bool accepts;
+    bool acceptsAtLineEnd;
+  };
+
+  bool matchesLine(const char* pBegin, const char* pEnd);
+  const char* findLiteralPrefix(const char* pBegin, const char* pEnd) const;
+
+  int lineStartState();
+  int nextState(int state, unsigned char byte);
+  int findOrAddState(std::vector<int> nfaStates);
+  void addClosure(std::vector<int>& nfaStates, int start, bool atLineStart);
+  bool reachesMatchAtLineEnd(const std::vector<int>& nfaStates);
+
+  std::shared_ptr<const Regex> mpRegex;
+
+  std::vector<DfaState> mDfaStates;
+  std::vector<int> mTransitions;
+  std::map<std::vector<int>, int> mStateIds;
+  int mLineStartState = -1;
+
+  // States reachable from the NFA's start without consuming input,
+  // when not at the start of a line. Part of every DFA state, since
+  // a match can start anywhere.
+  std::vector<int> mUnanchoredStart;
+
+  // Used to avoid visiting NFA states twice when computing closures
+  std::vector<unsigned> mVisitedGeneration;
+  unsigned mGeneration = 0;
+};
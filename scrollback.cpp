@@ -0,0 +1,339 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "scrollback.hpp"
+
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <stdexcept>
+
+
+namespace
+{
+
+// The newest chunks are left uncompressed, since they are what's usually
+// shown while a script is running
+constexpr std::size_t UNCOMPRESSED_CHUNK_COUNT = 2;
+
+// Decompressed chunks kept per thread. Enough for the lines visible on
+// screen, which can span two chunks, plus some scrolling back and forth.
+constexpr std::size_t CACHED_CHUNK_COUNT = 4;
+
+
+struct CachedChunk
+{
+  std::uint64_t scrollbackId;
+  std::size_t index;
+  std::string text;
+};
+
+
+void decompressChunk(
+  const std::string& compressed,
+  std::string& text,
+  const std::size_t size)
+{
+  text.resize(size);
+  if (!decompressBlock(compressed, text.data(), size))
+  {
+    throw std::runtime_error("Compressed text is damaged");
+  }
+}
+
+
+std::atomic<std::uint64_t> gNextScrollbackId{0};
+
+}
+
+
+TextPart::TextPart(const std::uint64_t offset, const std::string_view text)
+  : mOffset(offset)
+  , mText(text)
+  , mSize(text.size())
+{
+}
+
+
+TextPart::TextPart(
+  const std::uint64_t offset,
+  std::shared_ptr<const std::string> pChunk,
+  const std::size_t start,
+  const std::size_t size)
+  : mOffset(offset)
+  , mText(std::string_view{*pChunk}.substr(start, size))
+  , mpChunk(std::move(pChunk))
+  , mSize(size)
+{
+}
+
+
+TextPart::TextPart(
+  const std::uint64_t offset,
+  std::shared_ptr<const std::string> pCompressedChunk,
+  const std::size_t chunkSize,
+  const std::size_t start,
+  const std::size_t size)
+  : mOffset(offset)
+  , mpCompressedChunk(std::move(pCompressedChunk))
+  , mChunkSize(chunkSize)
+  , mStart(start)
+  , mSize(size)
+{
+}
+
+
+std::string_view TextPart::read(std::string& buffer) const
+{
+  if (!mpCompressedChunk)
+  {
+    return mText;
+  }
+
+  decompressChunk(*mpCompressedChunk, buffer, mChunkSize);
+  return std::string_view{buffer}.substr(mStart, mSize);
+}
+
+
+Scrollback::Scrollback(const std::size_t chunkSize)
+  : mChunkSize(chunkSize)
+  , mId(gNextScrollbackId++)
+{
+}
+
+
+void Scrollback::append(const char* pBegin, const char* pEnd)
+{
+  const auto appended = std::string_view{pBegin, std::size_t(pEnd - pBegin)};
+  const auto lastNewline = appended.rfind('\n');
+  if (lastNewline != std::string_view::npos)
+  {
+    mTailLinesSize = mTail.size() + lastNewline + 1;
+  }
+
+  mTail.append(appended);
+}
+
+
+void Scrollback::truncate(const std::uint64_t size)
+{
+  mTail.resize(size - mTailOffset);
+  mTailLinesSize = std::min(mTailLinesSize, mTail.size());
+}
+
+
+void Scrollback::update()
+{
+  finishCompression();
+
+  if (mTailLinesSize >= mChunkSize)
+  {
+    mChunks.push_back({
+      mTailOffset,
+      mTailLinesSize,
+      std::make_shared<const std::string>(mTail, 0, mTailLinesSize),
+      nullptr});
+
+    mTail.erase(0, mTailLinesSize);
+    mTailOffset += mTailLinesSize;
+    mTailLinesSize = 0;
+  }
+
+  // A single background thread compresses all chunks that are ready,
+  // leaving the other cores alone. During a flood of output, more chunks
+  // become ready while it's busy, so it keeps being restarted until it
+  // has caught up.
+  if (
+    !mPendingCompression.valid() &&
+    mChunks.size() > mCompressedChunkCount + UNCOMPRESSED_CHUNK_COUNT)
+  {
+    std::vector<std::shared_ptr<const std::string>> texts;
+    for (auto index = mCompressedChunkCount;
+      index < mChunks.size() - UNCOMPRESSED_CHUNK_COUNT;
+      ++index)
+    {
+      texts.push_back(mChunks[index].pText);
+    }
+
+    mPendingCompression = std::async(
+      std::launch::async,
+      [texts = std::move(texts)]()
+      {
+        std::vector<std::string> results;
+        for (const auto& pText : texts)
+        {
+          results.push_back(compressBlock(*pText));
+        }
+
+        return results;
+      });
+  }
+}
+
+
+void Scrollback::waitForCompression()
+{
+  while (mPendingCompression.valid())
+  {
+    mPendingCompression.wait();
+    update();
+  }
+}
+
+
+void Scrollback::finishCompression()
+{
+  if (
+    !mPendingCompression.valid() ||
+    mPendingCompression.wait_for(std::chrono::seconds{0}) !=
+      std::future_status::ready)
+  {
+    return;
+  }
+
+  for (auto& compressed : mPendingCompression.get())
+  {
+    auto& chunk = mChunks[mCompressedChunkCount];
+    if (compressed.size() < chunk.size)
+    {
+      chunk.pCompressed =
+        std::make_shared<const std::string>(std::move(compressed));
+      chunk.pText.reset();
+    }
+
+    ++mCompressedChunkCount;
+  }
+}
+
+
+std::uint64_t Scrollback::size() const
+{
+  return mTailOffset + mTail.size();
+}
+
+
+std::string_view Scrollback::read(
+  const std::uint64_t offset,
+  const std::size_t size) const
+{
+  if (offset >= mTailOffset)
+  {
+    return std::string_view{mTail}.substr(offset - mTailOffset, size);
+  }
+
+  const auto index = chunkContaining(offset);
+  const auto& chunk = mChunks[index];
+  const auto start = offset - chunk.offset;
+
+  if (chunk.pText)
+  {
+    return std::string_view{*chunk.pText}.substr(start, size);
+  }
+
+  // Most recently used first. The least recently used chunk's memory
+  // is reused for the next one.
+  thread_local std::list<CachedChunk> cachedChunks;
+
+  auto iCached = std::find_if(
+    cachedChunks.begin(),
+    cachedChunks.end(),
+    [&](const CachedChunk& cached)
+    {
+      return cached.scrollbackId == mId && cached.index == index;
+    });
+
+  if (iCached == cachedChunks.end())
+  {
+    if (cachedChunks.size() < CACHED_CHUNK_COUNT)
+    {
+      cachedChunks.emplace_back();
+    }
+
+    iCached = std::prev(cachedChunks.end());
+    iCached->scrollbackId = mId;
+    iCached->index = index;
+    decompressChunk(*chunk.pCompressed, iCached->text, chunk.size);
+  }
+
+  cachedChunks.splice(cachedChunks.begin(), cachedChunks, iCached);
+  return std::string_view{iCached->text}.substr(start, size);
+}
+
+
+void Scrollback::getParts(
+  const std::uint64_t begin,
+  const std::uint64_t end,
+  std::vector<TextPart>& parts) const
+{
+  auto offset = begin;
+  for (auto index = chunkContaining(begin);
+    index < mChunks.size() && offset < end;
+    ++index)
+  {
+    const auto& chunk = mChunks[index];
+    const auto start = offset - chunk.offset;
+    const auto size = std::min(end, chunk.offset + chunk.size) - offset;
+
+    if (chunk.pText)
+    {
+      parts.emplace_back(offset, chunk.pText, start, size);
+    }
+    else
+    {
+      parts.emplace_back(offset, chunk.pCompressed, chunk.size, start, size);
+    }
+
+    offset += size;
+  }
+
+  if (offset < end)
+  {
+    parts.emplace_back(
+      offset,
+      std::string_view{mTail}.substr(offset - mTailOffset, end - offset));
+  }
+}
+
+
+std::size_t Scrollback::chunkContaining(const std::uint64_t offset) const
+{
+  // Returns mChunks.size() for offsets in the tail
+  const auto iNext = std::upper_bound(
+    mChunks.begin(),
+    mChunks.end(),
+    offset,
+    [](const std::uint64_t value, const Chunk& chunk)
+    {
+      return value < chunk.offset;
+    });
+
+  if (iNext == mChunks.begin())
+  {
+    return mChunks.size();
+  }
+
+  const auto index = static_cast<std::size_t>(iNext - mChunks.begin()) - 1;
+  const auto& chunk = mChunks[index];
+  return offset < chunk.offset + chunk.size ? index : mChunks.size();
+}
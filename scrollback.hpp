@@ -0,0 +1,158 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Part of a document's text that can be read on its own, e.g. on another
+// thread, without going through the document. Keeps the memory it refers
+// to alive, except for text that can still change (see Scrollback).
+class TextPart {
+public:
+  // Refers to text owned by someone else
+  TextPart(std::uint64_t offset, std::string_view text);
+
+  // Refers to part of a chunk, which is kept alive by the part
+  TextPart(
+    std::uint64_t offset,
+    std::shared_ptr<const std::string> pChunk,
+    std::size_t start,
+    std::size_t size);
+
+  // Refers to part of a compressed chunk
+  TextPart(
+    std::uint64_t offset,
+    std::shared_ptr<const std::string> pCompressedChunk,
+    std::size_t chunkSize,
+    std::size_t start,
+    std::size_t size);
+
+  // Position of the part's first byte within the document
+  std::uint64_t offset() const { return mOffset; }
+  std::size_t size() const { return mSize; }
+  bool isCompressed() const { return mpCompressedChunk != nullptr; }
+
+  // Returns the text. Compressed text is decompressed into the given
+  // buffer, which must outlive the returned view.
+  std::string_view read(std::string& buffer) const;
+
+private:
+  std::uint64_t mOffset;
+  std::string_view mText;
+  std::shared_ptr<const std::string> mpChunk;
+  std::shared_ptr<const std::string> mpCompressedChunk;
+  std::size_t mChunkSize = 0;
+  std::size_t mStart = 0;
+  std::size_t mSize;
+};
+
+
+// Stores text that keeps growing, like a script's output. Text is split
+// into chunks of whole lines, and all but the newest chunks are compressed
+// on a background thread. Usually, only the end of the text is looked at,
+// so most of it stays compressed, using a fraction of the memory.
+//
+// Reading from a compressed chunk decompresses it into a small cache of
+// recently used chunks. The cache is kept per thread, so that reading on
+// one thread doesn't invalidate text that another one is still using.
+//
+// Text that hasn't been moved into a chunk yet (see update()) can change,
+// everything else stays as it is.
+class Scrollback {
+public:
+  // Large enough to compress well, small enough to decompress in well
+  // under a millisecond
+  static constexpr std::size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+  // Chunks are at least chunkSize bytes, unless they would have to split
+  // a line. Tests use tiny chunks to get many of them out of little text.
+  explicit Scrollback(std::size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+  void append(const char* pBegin, const char* pEnd);
+
+  // Removes text from the end, back to the start of a line. Only text that
+  // hasn't been moved into a chunk yet can be removed.
+  void truncate(std::uint64_t size);
+
+  // Moves complete lines into a new chunk once there are enough of them,
+  // and starts compressing older chunks. Picks up the results of previous
+  // compressions as well, which is when the uncompressed text is released.
+  // Needs to be called regularly, also when nothing is appended, so that
+  // compression can catch up after a burst of output.
+  void update();
+
+  // Blocks until all chunks that can be compressed are
+  void waitForCompression();
+
+  std::uint64_t size() const;
+
+  // Returns the given range of text, which must not span multiple chunks.
+  // Lines never do. The returned view is invalidated by the next call to
+  // append(), truncate() or update(), and on the calling thread also by
+  // reading from a few other compressed chunks.
+  std::string_view read(std::uint64_t offset, std::size_t size) const;
+
+  // Adds the given range of text to parts, split at chunk boundaries
+  void getParts(
+    std::uint64_t begin,
+    std::uint64_t end,
+    std::vector<TextPart>& parts) const;
+
+private:
+  struct Chunk
+  {
+    std::uint64_t offset;
+    std::size_t size;
+
+    // Once compressed, the uncompressed text is released
+    std::shared_ptr<const std::string> pText;
+    std::shared_ptr<const std::string> pCompressed;
+  };
+
+  std::size_t chunkContaining(std::uint64_t offset) const;
+  void finishCompression();
+
+  std::size_t mChunkSize;
+  std::vector<Chunk> mChunks;
+
+  // Chunks before this one are compressed, unless compressing them didn't
+  // make them smaller
+  std::size_t mCompressedChunkCount = 0;
+  std::future<std::vector<std::string>> mPendingCompression;
+
+  // Text that isn't part of a chunk yet
+  std::string mTail;
+  std::uint64_t mTailOffset = 0;
+
+  // Size of the tail's complete lines
+  std::size_t mTailLinesSize = 0;
+
+  // Identifies the scrollback in the per-thread cache
+  std::uint64_t mId;
+};
@@ -0,0 +1,187 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "search.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+
+namespace
+{
+
+// Text is searched in parts of about this size, so that a cancelled
+// search stops quickly. Also the size of the chunks that script output
+// is compressed in, see Scrollback.
+constexpr std::size_t PART_SIZE = 256 * 1024;
+
+// Not worth starting a thread for less than this
+constexpr std::size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+
+// Returns the start of the line following the given position
+const char* nextLineStart(const char* pPosition, const char* pEnd)
+{
+  const auto pNewline = static_cast<const char*>(
+    std::memchr(pPosition, '\n', pEnd - pPosition));
+  return pNewline ? pNewline + 1 : pEnd;
+}
+
+}
+
+
+DocumentSearch::DocumentSearch(
+  const Document& document,
+  std::shared_ptr<const Regex> pRegex,
+  const std::size_t firstLine)
+  : mDocument(document)
+  , mpRegex(std::move(pRegex))
+{
+  mParts = mDocument.textParts(
+    firstLine, mDocument.lineCount() - 1, PART_SIZE);
+
+  // An empty last line has no text, and therefore no part of its own. It
+  // still needs to be searched, see searchChunk().
+  if (mParts.empty())
+  {
+    // Not a null view, since a match is reported as a pointer into it
+    mParts.emplace_back(mDocument.textSize(), std::string_view{""});
+  }
+
+  std::uint64_t textSize = 0;
+  for (const auto& part : mParts)
+  {
+    textSize += part.size();
+  }
+
+  const auto threadCount = std::max(
+    std::size_t{1},
+    std::min<std::size_t>(
+      std::thread::hardware_concurrency(),
+      textSize / MIN_CHUNK_SIZE));
+
+  // Each worker gets a chunk of consecutive parts, with about the same
+  // number of bytes in each chunk. Parts end at line boundaries, so no
+  // line is split between two workers.
+  std::size_t chunkBegin = 0;
+  std::uint64_t chunkedSize = 0;
+  for (auto i = std::size_t{1}; i <= threadCount; ++i)
+  {
+    auto chunkEnd = chunkBegin;
+    while (
+      chunkEnd < mParts.size() &&
+      (i == threadCount || chunkedSize < textSize * i / threadCount))
+    {
+      chunkedSize += mParts[chunkEnd].size();
+      ++chunkEnd;
+    }
+
+    mChunkResults.push_back(std::async(
+      std::launch::async,
+      &DocumentSearch::searchChunk,
+      this,
+      chunkBegin,
+      chunkEnd));
+
+    chunkBegin = chunkEnd;
+  }
+}
+
+
+DocumentSearch::~DocumentSearch()
+{
+  mIsCancelled = true;
+
+  for (auto& chunkResult : mChunkResults)
+  {
+    chunkResult.wait();
+  }
+}
+
+
+std::optional<std::vector<std::size_t>> DocumentSearch::takeResults()
+{
+  for (auto& chunkResult : mChunkResults)
+  {
+    if (
+      !chunkResult.valid() ||
+      chunkResult.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+    {
+      return {};
+    }
+  }
+
+  // Chunks are in document order, so concatenating their
+  // results keeps the lines sorted
+  std::vector<std::size_t> lines;
+  for (auto& chunkResult : mChunkResults)
+  {
+    const auto chunkLines = chunkResult.get();
+    lines.insert(lines.end(), chunkLines.begin(), chunkLines.end());
+  }
+
+  mChunkResults.clear();
+  return lines;
+}
+
+
+std::vector<std::size_t> DocumentSearch::searchChunk(
+  const std::size_t firstPart,
+  const std::size_t endPart)
+{
+  RegexMatcher matcher{mpRegex};
+  std::vector<std::size_t> lines;
+  std::string buffer;
+
+  for (auto i = firstPart; i < endPart && !mIsCancelled; ++i)
+  {
+    const auto& part = mParts[i];
+    const auto text = part.read(buffer);
+    const auto pEnd = text.data() + text.size();
+
+    // Only the last part can be followed by an empty last line. In other
+    // parts, a trailing linebreak is followed by the next part's first line.
+    const auto isEndOfText = i + 1 == mParts.size();
+
+    auto pPosition = text.data();
+    while (
+      const auto pLine =
+        matcher.findMatchingLine(pPosition, pEnd, isEndOfText))
+    {
+      lines.push_back(
+        mDocument.lineContaining(part.offset() + (pLine - text.data())));
+
+      // The empty last line is the only one starting at the end
+      if (pLine == pEnd)
+      {
+        break;
+      }
+
+      pPosition = nextLineStart(pLine, pEnd);
+    }
+  }
+
+  return lines;
+}
@@ -0,0 +1,72 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "document.hpp"
+#include "regex.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <optional>
+#include <vector>
+
+
+// Finds all lines of a document that match a regular expression, using
+// all available cores. The lines to search are split into one chunk per
+// worker thread, with each chunk covering about the same number of bytes.
+// Compressed parts of the document are decompressed by the workers.
+//
+// The document must not be modified while the search is running.
+class DocumentSearch {
+public:
+  // Starts searching lines from firstLine to the end of the document
+  DocumentSearch(
+    const Document& document,
+    std::shared_ptr<const Regex> pRegex,
+    std::size_t firstLine);
+
+  // Stops searching, waiting for the worker threads to notice
+  ~DocumentSearch();
+
+  DocumentSearch(const DocumentSearch&) = delete;
+  DocumentSearch& operator=(const DocumentSearch&) = delete;
+
+  // Returns the matching lines in increasing order once the search is
+  // complete, or an empty optional while it's still running.
+  std::optional<std::vector<std::size_t>> takeResults();
+
+private:
+  std::vector<std::size_t> searchChunk(
+    std::size_t firstPart,
+    std::size_t endPart);
+
+  const Document& mDocument;
+  std::shared_ptr<const Regex> mpRegex;
+  std::vector<TextPart> mParts;
+  std::atomic<bool> mIsCancelled{false};
+
+  // Declared last, so that everything the workers use is initialized
+  // before they start
+  std::vector<std::future<std::vector<std::size_t>>> mChunkResults;
+};
@@ -0,0 +1,583 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "streaming_renderer.hpp"
+
+#include <GLES2/gl2.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+
+namespace
+{
+
+// Buffers start out with room for this many bytes, and double in size
+// whenever a frame needs more
+constexpr std::size_t MIN_BUFFER_SIZE = 64 * 1024;
+
+// Same as the shaders of ImGui's renderer for GLSL ES 1.00
+const char* VERTEX_SHADER = R"(
+uniform mat4 ProjMtx;
+attribute vec2 Position;
+attribute vec2 UV;
+attribute vec4 Color;
+varying vec2 Frag_UV;
+varying vec4 Frag_Color;
+void main()
+{
+  Frag_UV = UV;
+  Frag_Color = Color;
+  gl_Position = ProjMtx * vec4(Position.xy, 0, 1);
+}
+)";
+
+const char* FRAGMENT_SHADER = R"(
+precision mediump float;
+uniform sampler2D Texture;
+varying vec2 Frag_UV;
+varying vec4 Frag_Color;
+void main()
+{
+  gl_FragColor = Frag_Color * texture2D(Texture, Frag_UV.st);
+}
+)";
+
+
+GLuint compileShader(const GLenum type, const char* pSource)
+{
+  const auto shader = glCreateShader(type);
+  glShaderSource(shader, 1, &pSource, nullptr);
+  glCompileShader(shader);
+
+  GLint status = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE)
+  {
+    GLint logSize = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logSize);
+    std::string log(std::max(logSize, 1), '\0');
+    glGetShaderInfoLog(shader, logSize, nullptr, log.data());
+    std::cerr << "Failed to compile shader: " << log.c_str() << '\n';
+
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  return shader;
+}
+
+
+bool hasExtension(const char* name)
+{
+  const auto pExtensions =
+    reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  if (!pExtensions)
+  {
+    return false;
+  }
+
+  // Same as for EGL extensions (see frame_presenter.cpp)
+  const auto extensions = " " + std::string{pExtensions} + " ";
+  return extensions.find(" " + std::string{name} + " ") != std::string::npos;
+}
+
+
+bool operator==(const ImVec4& a, const ImVec4& b)
+{
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+
+GLuint textureName(const ImTextureID texture)
+{
+  return static_cast<GLuint>(reinterpret_cast<std::intptr_t>(texture));
+}
+
+
+// Makes sure that the buffer bound to the given target can hold the given
+// number of bytes. Growing the buffer discards its contents.
+void reserve(const GLenum target, std::size_t& capacity, const std::size_t size)
+{
+  if (size <= capacity)
+  {
+    return;
+  }
+
+  capacity = std::max(capacity, MIN_BUFFER_SIZE);
+  while (capacity < size)
+  {
+    capacity *= 2;
+  }
+
+  glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+}
+
+}
+
+
+StreamingRenderer::StreamingRenderer()
+{
+  createProgram();
+  if (!mProgram)
+  {
+    return;
+  }
+
+  mHasIntIndices = hasExtension("GL_OES_element_index_uint");
+
+  for (auto& buffers : mBuffers)
+  {
+    glGenBuffers(1, &buffers.vertexBuffer);
+    glGenBuffers(1, &buffers.indexBuffer);
+  }
+}
+
+
+StreamingRenderer::~StreamingRenderer()
+{
+  for (auto& buffers : mBuffers)
+  {
+    glDeleteBuffers(1, &buffers.vertexBuffer);
+    glDeleteBuffers(1, &buffers.indexBuffer);
+  }
+
+  if (mProgram)
+  {
+    glDeleteProgram(mProgram);
+  }
+}
+
+
+void StreamingRenderer::render(const ImDrawData& drawData)
+{
+  mStats = {};
+
+  const auto width =
+    static_cast<int>(drawData.DisplaySize.x * drawData.FramebufferScale.x);
+  const auto height =
+    static_cast<int>(drawData.DisplaySize.y * drawData.FramebufferScale.y);
+  if (width <= 0 || height <= 0 || drawData.CmdListsCount == 0)
+  {
+    return;
+  }
+
+  prepareBatches(drawData);
+  if (mBatches.empty())
+  {
+    return;
+  }
+
+  // Whoever renders next might depend on the current state
+  GLint program = 0;
+  GLint texture = 0;
+  GLint activeTexture = 0;
+  GLint arrayBuffer = 0;
+  GLint elementArrayBuffer = 0;
+  GLint viewport[4] = {};
+  GLint scissorBox[4] = {};
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementArrayBuffer);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetIntegerv(GL_SCISSOR_BOX, scissorBox);
+  const auto blend = glIsEnabled(GL_BLEND);
+  const auto cullFace = glIsEnabled(GL_CULL_FACE);
+  const auto depthTest = glIsEnabled(GL_DEPTH_TEST);
+  const auto scissorTest = glIsEnabled(GL_SCISSOR_TEST);
+
+  upload();
+  setUpRenderState(drawData, width, height);
+
+  // Only changed when needed, which is rare once batched
+  auto baseVertex = std::size_t{0};
+  auto boundTexture = ImTextureID{};
+  auto hasBoundTexture = false;
+
+  const auto indexType = mHasIntIndices
+    ? GL_UNSIGNED_INT
+    : (sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+  const auto indexSize =
+    mHasIntIndices ? sizeof(std::uint32_t) : sizeof(ImDrawIdx);
+
+  const auto& displayPos = drawData.DisplayPos;
+  const auto& scale = drawData.FramebufferScale;
+
+  for (const auto& batch : mBatches)
+  {
+    if (batch.pCallbackCommand)
+    {
+      // A special callback value asks for the state to be set up again,
+      // anything else is called
+      if (batch.pCallbackCommand->UserCallback == ImDrawCallback_ResetRenderState)
+      {
+        setUpRenderState(drawData, width, height);
+        baseVertex = 0;
+        hasBoundTexture = false;
+      }
+      else
+      {
+        batch.pCallbackCommand->UserCallback(
+          batch.pCallbackList, batch.pCallbackCommand);
+      }
+
+      continue;
+    }
+
+    // In framebuffer pixels, with the origin at the bottom left
+    const auto clipLeft = (batch.clipRect.x - displayPos.x) * scale.x;
+    const auto clipTop = (batch.clipRect.y - displayPos.y) * scale.y;
+    const auto clipRight = (batch.clipRect.z - displayPos.x) * scale.x;
+    const auto clipBottom = (batch.clipRect.w - displayPos.y) * scale.y;
+    if (
+      clipLeft >= width || clipTop >= height ||
+      clipRight <= 0.0f || clipBottom <= 0.0f)
+    {
+      continue;
+    }
+
+    glScissor(
+      static_cast<int>(clipLeft),
+      static_cast<int>(height - clipBottom),
+      static_cast<int>(clipRight - clipLeft),
+      static_cast<int>(clipBottom - clipTop));
+
+    if (!hasBoundTexture || batch.texture != boundTexture)
+    {
+      glBindTexture(GL_TEXTURE_2D, textureName(batch.texture));
+      boundTexture = batch.texture;
+      hasBoundTexture = true;
+    }
+
+    if (batch.baseVertex != baseVertex)
+    {
+      setVertexBase(batch.baseVertex);
+      baseVertex = batch.baseVertex;
+    }
+
+    glDrawElements(
+      GL_TRIANGLES,
+      static_cast<GLsizei>(batch.indexCount),
+      indexType,
+      reinterpret_cast<const void*>(batch.firstIndex * indexSize));
+    ++mStats.drawCallCount;
+  }
+
+  glDisableVertexAttribArray(mPositionLocation);
+  glDisableVertexAttribArray(mUvLocation);
+  glDisableVertexAttribArray(mColorLocation);
+
+  glUseProgram(program);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glActiveTexture(activeTexture);
+  glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementArrayBuffer);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glScissor(scissorBox[0], scissorBox[1], scissorBox[2], scissorBox[3]);
+
+  auto restore = [](const GLenum capability, const GLboolean wasEnabled)
+  {
+    if (wasEnabled)
+    {
+      glEnable(capability);
+    }
+    else
+    {
+      glDisable(capability);
+    }
+  };
+
+  restore(GL_BLEND, blend);
+  restore(GL_CULL_FACE, cullFace);
+  restore(GL_DEPTH_TEST, depthTest);
+  restore(GL_SCISSOR_TEST, scissorTest);
+}
+
+
+void StreamingRenderer::createProgram()
+{
+  const auto vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+  const auto fragmentShader =
+    compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+
+  if (vertexShader && fragmentShader)
+  {
+    mProgram = glCreateProgram();
+    glAttachShader(mProgram, vertexShader);
+    glAttachShader(mProgram, fragmentShader);
+    glLinkProgram(mProgram);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(mProgram, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+      std::cerr << "Failed to link shader program\n";
+      glDeleteProgram(mProgram);
+      mProgram = 0;
+    }
+  }
+
+  // Deleting the shaders only marks them for deletion while they're
+  // attached to the program
+  if (vertexShader)
+  {
+    glDeleteShader(vertexShader);
+  }
+
+  if (fragmentShader)
+  {
+    glDeleteShader(fragmentShader);
+  }
+
+  if (!mProgram)
+  {
+    return;
+  }
+
+  mProjectionLocation = glGetUniformLocation(mProgram, "ProjMtx");
+  mTextureLocation = glGetUniformLocation(mProgram, "Texture");
+  mPositionLocation = glGetAttribLocation(mProgram, "Position");
+  mUvLocation = glGetAttribLocation(mProgram, "UV");
+  mColorLocation = glGetAttribLocation(mProgram, "Color");
+}
+
+
+void StreamingRenderer::prepareBatches(const ImDrawData& drawData)
+{
+  mVertices.clear();
+  mShortIndices.clear();
+  mIntIndices.clear();
+  mBatches.clear();
+
+  for (auto i = 0; i < drawData.CmdListsCount; ++i)
+  {
+    const auto& drawList = *drawData.CmdLists[i];
+    const auto firstVertex = mVertices.size();
+    mVertices.insert(
+      mVertices.end(), drawList.VtxBuffer.begin(), drawList.VtxBuffer.end());
+
+    for (const auto& command : drawList.CmdBuffer)
+    {
+      addCommand(drawList, command, firstVertex);
+    }
+
+    mStats.commandCount += drawList.CmdBuffer.Size;
+  }
+}
+
+
+void StreamingRenderer::addCommand(
+  const ImDrawList& drawList,
+  const ImDrawCmd& command,
+  const std::size_t listFirstVertex)
+{
+  if (command.UserCallback)
+  {
+    mBatches.push_back({{}, {}, false, 0, 0, 0, &drawList, &command});
+    return;
+  }
+
+  // Commands outside of the region that FramePresenter redraws have an
+  // empty clip rect. Leaving them out entirely allows the commands
+  // around them to be batched.
+  const auto& clipRect = command.ClipRect;
+  if (command.ElemCount == 0 || clipRect.x >= clipRect.z || clipRect.y >= clipRect.w)
+  {
+    return;
+  }
+
+  const auto baseVertex =
+    mHasIntIndices ? 0 : listFirstVertex + command.VtxOffset;
+  const auto indexOffset = mHasIntIndices
+    ? static_cast<std::uint32_t>(listFirstVertex + command.VtxOffset)
+    : 0;
+  const auto firstIndex =
+    mHasIntIndices ? mIntIndices.size() : mShortIndices.size();
+
+  // Copies the indices, and finds out whether any vertex lies outside of
+  // the clip rect on the way. Text usually doesn't, since ImGui already
+  // leaves out lines and characters that aren't visible at all.
+  const auto pVertices = drawList.VtxBuffer.Data + command.VtxOffset;
+  const auto pIndices = drawList.IdxBuffer.Data + command.IdxOffset;
+  auto needsClipping = false;
+  for (std::size_t i = 0; i < command.ElemCount; ++i)
+  {
+    const auto index = pIndices[i];
+    const auto& pos = pVertices[index].pos;
+    needsClipping = needsClipping ||
+      pos.x < clipRect.x || pos.y < clipRect.y ||
+      pos.x > clipRect.z || pos.y > clipRect.w;
+
+    if (mHasIntIndices)
+    {
+      mIntIndices.push_back(index + indexOffset);
+    }
+    else
+    {
+      mShortIndices.push_back(index);
+    }
+  }
+
+  // Commands can be drawn together if they use the same texture and
+  // vertices, and their clip rects don't matter, or are the same
+  if (!mBatches.empty())
+  {
+    auto& batch = mBatches.back();
+    const auto isMergeable =
+      !batch.pCallbackCommand &&
+      batch.texture == command.TextureId &&
+      batch.baseVertex == baseVertex &&
+      batch.firstIndex + batch.indexCount == firstIndex;
+
+    if (isMergeable && batch.clipRect == clipRect)
+    {
+      batch.needsClipping = batch.needsClipping || needsClipping;
+      batch.indexCount += command.ElemCount;
+      return;
+    }
+
+    if (isMergeable && !batch.needsClipping && !needsClipping)
+    {
+      // Scissoring to the combined area still keeps the batch within the
+      // region that FramePresenter redraws
+      batch.clipRect = {
+        std::min(batch.clipRect.x, clipRect.x),
+        std::min(batch.clipRect.y, clipRect.y),
+        std::max(batch.clipRect.z, clipRect.z),
+        std::max(batch.clipRect.w, clipRect.w)};
+      batch.indexCount += command.ElemCount;
+      return;
+    }
+  }
+
+  mBatches.push_back({
+    command.TextureId,
+    clipRect,
+    needsClipping,
+    baseVertex,
+    firstIndex,
+    command.ElemCount,
+    nullptr,
+    nullptr});
+}
+
+
+void StreamingRenderer::upload()
+{
+  // Use the next pair of buffers. Their previous contents are from a few
+  // frames ago, which the GPU should be done with.
+  mCurrentBuffers = (mCurrentBuffers + 1) % mBuffers.size();
+  auto& buffers = mBuffers[mCurrentBuffers];
+
+  const auto vertexSize = mVertices.size() * sizeof(ImDrawVert);
+  glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+  reserve(GL_ARRAY_BUFFER, buffers.vertexCapacity, vertexSize);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, vertexSize, mVertices.data());
+
+  const auto indexSize = mHasIntIndices
+    ? mIntIndices.size() * sizeof(std::uint32_t)
+    : mShortIndices.size() * sizeof(ImDrawIdx);
+  const auto pIndices = mHasIntIndices
+    ? static_cast<const void*>(mIntIndices.data())
+    : static_cast<const void*>(mShortIndices.data());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+  reserve(GL_ELEMENT_ARRAY_BUFFER, buffers.indexCapacity, indexSize);
+  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexSize, pIndices);
+
+  mStats.uploadCount += 2;
+  mStats.uploadSize += vertexSize + indexSize;
+}
+
+
+void StreamingRenderer::setUpRenderState(
+  const ImDrawData& drawData,
+  const int width,
+  const int height)
+{
+  // Alpha blending, no face culling or depth testing, scissor enabled
+  glEnable(GL_BLEND);
+  glBlendEquation(GL_FUNC_ADD);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_SCISSOR_TEST);
+  glViewport(0, 0, width, height);
+
+  // Orthographic projection of ImGui's coordinates onto the viewport
+  const auto left = drawData.DisplayPos.x;
+  const auto right = drawData.DisplayPos.x + drawData.DisplaySize.x;
+  const auto top = drawData.DisplayPos.y;
+  const auto bottom = drawData.DisplayPos.y + drawData.DisplaySize.y;
+  const GLfloat projection[4][4] = {
+    {2.0f / (right - left), 0.0f, 0.0f, 0.0f},
+    {0.0f, 2.0f / (top - bottom), 0.0f, 0.0f},
+    {0.0f, 0.0f, -1.0f, 0.0f},
+    {(right + left) / (left - right), (top + bottom) / (bottom - top), 0.0f, 1.0f}};
+
+  glUseProgram(mProgram);
+  glUniform1i(mTextureLocation, 0);
+  glUniformMatrix4fv(mProjectionLocation, 1, GL_FALSE, &projection[0][0]);
+
+  const auto& buffers = mBuffers[mCurrentBuffers];
+  glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+
+  glEnableVertexAttribArray(mPositionLocation);
+  glEnableVertexAttribArray(mUvLocation);
+  glEnableVertexAttribArray(mColorLocation);
+  setVertexBase(0);
+}
+
+
+void StreamingRenderer::setVertexBase(const std::size_t baseVertex)
+{
+  // Without 32 bit indices, each draw list's indices start at 0, so the
+  // attributes need to point to the draw list's vertices
+  const auto offset = baseVertex * sizeof(ImDrawVert);
+  glVertexAttribPointer(
+    mPositionLocation,
+    2,
+    GL_FLOAT,
+    GL_FALSE,
+    sizeof(ImDrawVert),
+    reinterpret_cast<const void*>(offset + offsetof(ImDrawVert, pos)));
+  glVertexAttribPointer(
+    mUvLocation,
+    2,
+    GL_FLOAT,
+    GL_FALSE,
+    sizeof(ImDrawVert),
+    reinterpret_cast<const void*>(offset + offsetof(ImDrawVert, uv)));
+  glVertexAttribPointer(
+    mColorLocation,
+    4,
+    GL_UNSIGNED_BYTE,
+    GL_TRUE,
+    sizeof(ImDrawVert),
+    reinterpret_cast<const void*>(offset + offsetof(ImDrawVert, col)));
+}
@@ -0,0 +1,131 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Renders ImGui's draw data, like ImGui_ImplOpenGL3_RenderDrawData(), but
+// with less work for the driver. The ImGui renderer re-specifies its
+// vertex and index buffers with glBufferData() for every draw list, which
+// makes some GLES2 drivers wait for the GPU to finish using the previous
+// contents first. Here, each frame's vertices and indices are gathered
+// into a single upload each, to one of several buffer pairs that are used
+// in turn. By the time a pair is used again, the GPU is done with it.
+//
+// Draw commands are also batched: ImGui starts a new command whenever the
+// clip rect changes, e.g. for each window, each side of the diff view, or
+// each table column. Consecutive commands using the same texture can be
+// drawn together when their vertices lie within their clip rects anyway,
+// which is the case for most text. When 32 bit indices are available
+// (OES_element_index_uint), this works across draw lists as well.
+//
+// Only uses GLES2 features, and works with Mesa's software rendering.
+class StreamingRenderer {
+public:
+  // What it took to render a frame
+  struct Stats
+  {
+    std::size_t commandCount;
+    std::size_t drawCallCount;
+    std::size_t uploadCount;
+    std::size_t uploadSize;
+  };
+
+  // Must be created while the GL context is current. Check isValid()
+  // afterwards, the shaders might fail to compile.
+  StreamingRenderer();
+  ~StreamingRenderer();
+
+  StreamingRenderer(const StreamingRenderer&) = delete;
+  StreamingRenderer& operator=(const StreamingRenderer&) = delete;
+
+  bool isValid() const { return mProgram != 0; }
+
+  // Renders to the current framebuffer. GL state is restored afterwards,
+  // except for the contents of the buffers.
+  void render(const ImDrawData& drawData);
+
+  const Stats& lastFrameStats() const { return mStats; }
+
+private:
+  // Consecutive draw commands that are drawn using a single draw call.
+  // Indices are relative to baseVertex. With 32 bit indices, they're
+  // relative to the start of the frame's vertices, so baseVertex is 0.
+  // User callbacks get a batch of their own.
+  struct Batch
+  {
+    ImTextureID texture;
+    ImVec4 clipRect;
+    bool needsClipping;
+    std::size_t baseVertex;
+    std::size_t firstIndex;
+    std::size_t indexCount;
+
+    const ImDrawList* pCallbackList;
+    const ImDrawCmd* pCallbackCommand;
+  };
+
+  struct BufferPair
+  {
+    unsigned int vertexBuffer = 0;
+    unsigned int indexBuffer = 0;
+    std::size_t vertexCapacity = 0;
+    std::size_t indexCapacity = 0;
+  };
+
+  void createProgram();
+  void prepareBatches(const ImDrawData& drawData);
+  void addCommand(
+    const ImDrawList& drawList,
+    const ImDrawCmd& command,
+    std::size_t listFirstVertex);
+  void upload();
+  void setUpRenderState(const ImDrawData& drawData, int width, int height);
+  void setVertexBase(std::size_t baseVertex);
+
+  unsigned int mProgram = 0;
+  int mProjectionLocation = -1;
+  int mTextureLocation = -1;
+  int mPositionLocation = -1;
+  int mUvLocation = -1;
+  int mColorLocation = -1;
+
+  bool mHasIntIndices = false;
+
+  // Three pairs cover drivers that queue up to two frames ahead
+  std::array<BufferPair, 3> mBuffers;
+  std::size_t mCurrentBuffers = 0;
+
+  // Reused from frame to frame, to avoid allocating
+  std::vector<ImDrawVert> mVertices;
+  std::vector<ImDrawIdx> mShortIndices;
+  std::vector<std::uint32_t> mIntIndices;
+  std::vector<Batch> mBatches;
+
+  Stats mStats{};
+};
@@ -0,0 +1,328 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+// Tests for the compression of older script output: round trips through
+// the block compressor, rejection of damaged blocks, and reading lines
+// back from a Scrollback once its chunks are compressed.
+
+#include "check.hpp"
+
+#include "../block_compression.hpp"
+#include "../scrollback.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace
+{
+
+// Deterministic, so that failures can be reproduced
+class Random {
+public:
+  std::uint32_t next()
+  {
+    mState ^= mState << 13;
+    mState ^= mState >> 7;
+    mState ^= mState << 17;
+    return static_cast<std::uint32_t>(mState);
+  }
+
+private:
+  std::uint64_t mState = 0x9E3779B97F4A7C15;
+};
+
+
+std::string decompressed(const std::string_view compressed, const std::size_t size)
+{
+  std::string output(size, '\0');
+  CHECK(decompressBlock(compressed, output.data(), size));
+  return output;
+}
+
+
+void checkRoundTrip(const std::string& data)
+{
+  const auto compressed = compressBlock(data);
+  CHECK(decompressed(compressed, data.size()) == data);
+
+  // The size has to match exactly
+  std::string output(data.size() + 1, '\0');
+  CHECK(!decompressBlock(compressed, output.data(), data.size() + 1));
+  if (!data.empty())
+  {
+    CHECK(!decompressBlock(compressed, output.data(), data.size() - 1));
+  }
+}
+
+
+void testRoundTrips()
+{
+  checkRoundTrip("");
+  checkRoundTrip("a");
+
+  // Around the minimum size for a match, and the end of text limits
+  std::string repeated;
+  for (auto i = 0; i < 64; ++i)
+  {
+    checkRoundTrip(repeated);
+    repeated += "abcd"[i % 4];
+  }
+
+  // Incompressible data ends up a little larger than the original, with
+  // literal counts that need many extra length bytes
+  Random random;
+  std::string noise;
+  for (auto i = 0; i < 1024 * 1024; ++i)
+  {
+    noise.push_back(static_cast<char>(random.next()));
+  }
+
+  checkRoundTrip(noise);
+
+  // Long runs produce matches that overlap with their own output, at
+  // various distances, with long match lengths
+  checkRoundTrip(std::string(1024 * 1024, 'a'));
+  for (const auto period : {2, 3, 7, 15, 16, 17, 300})
+  {
+    std::string text;
+    for (auto i = 0; text.size() < 100000; ++i)
+    {
+      text.push_back(static_cast<char>('a' + i % period));
+    }
+
+    checkRoundTrip(text);
+  }
+
+  // Something like actual output, with runs and noise mixed in
+  std::string log;
+  for (auto i = 0; log.size() < 1024 * 1024; ++i)
+  {
+    log += "[INFO] request " + std::to_string(i) + " took ";
+    log += std::to_string(random.next() % 1000) + " ms\n";
+    if (i % 100 == 0)
+    {
+      log += std::string(random.next() % 1000, '-') + "\n";
+      log += noise.substr(random.next() % 1000, random.next() % 100);
+    }
+  }
+
+  const auto compressedLog = compressBlock(log);
+  CHECK(compressedLog.size() < log.size() / 2);
+  CHECK(decompressed(compressedLog, log.size()) == log);
+}
+
+
+void testOverlappingMatch()
+{
+  // One literal 'a', then a match of 4 + 15 + 5 bytes at offset 1, which
+  // repeats the 'a'. Then 5 more literals.
+  const std::string block{
+    "\x1F" "a" "\x01\x00" "\x05"
+    "\x50" "bcdef",
+    11};
+
+  CHECK(decompressed(block, 30) == std::string(25, 'a') + "bcdef");
+
+  // The same at offset 2
+  const std::string block2{
+    "\x2F" "ab" "\x02\x00" "\x05"
+    "\x50" "cdefg",
+    12};
+
+  std::string expected;
+  for (auto i = 0; i < 26; ++i)
+  {
+    expected.push_back("ab"[i % 2]);
+  }
+
+  CHECK(decompressed(block2, 31) == expected + "cdefg");
+}
+
+
+void testDamagedBlocks()
+{
+  std::string text;
+  for (auto i = 0; text.size() < 100000; ++i)
+  {
+    text += "line " + std::to_string(i % 1000) + "\n";
+  }
+
+  const auto compressed = compressBlock(text);
+  std::string output(text.size(), '\0');
+
+  // Cut off anywhere, some of the text is missing
+  for (std::size_t size = 0; size < compressed.size(); ++size)
+  {
+    CHECK(!decompressBlock(
+      std::string_view{compressed}.substr(0, size),
+      output.data(),
+      output.size()));
+  }
+
+  // Matches that start before the text, or at no offset at all
+  CHECK(!decompressBlock({"\x10" "a" "\x02\x00" "\x50" "bcdef", 10}, output.data(), 10));
+  CHECK(!decompressBlock({"\x10" "a" "\x00\x00" "\x50" "bcdef", 10}, output.data(), 10));
+
+  // A match that's longer than the remaining output
+  CHECK(!decompressBlock({"\x1F" "a" "\x01\x00" "\xFF\x05", 6}, output.data(), 30));
+
+  // More literals than there are bytes in the block
+  CHECK(!decompressBlock({"\xF0" "\x05" "abc", 5}, output.data(), output.size()));
+
+  // Length bytes that never end
+  CHECK(!decompressBlock({"\xF0" "\xFF", 2}, output.data(), output.size()));
+
+  // Random damage either produces some text of the right size, or is
+  // rejected. It must never read or write outside of the buffers, which
+  // is checked when built with SANITIZE=1.
+  Random random;
+  for (auto i = 0; i < 20000; ++i)
+  {
+    auto damaged = compressed;
+    for (auto j = 0u; j < 1 + random.next() % 4; ++j)
+    {
+      damaged[random.next() % damaged.size()] =
+        static_cast<char>(random.next());
+    }
+
+    decompressBlock(damaged, output.data(), output.size());
+  }
+}
+
+
+// Reads the given lines back one by one, and all at once via parts
+void checkLines(
+  const Scrollback& scrollback,
+  const std::vector<std::string>& lines)
+{
+  std::string text;
+  std::uint64_t offset = 0;
+  for (const auto& line : lines)
+  {
+    CHECK(scrollback.read(offset, line.size()) == line);
+    offset += line.size();
+    text += line;
+  }
+
+  CHECK(scrollback.size() == text.size());
+
+  std::vector<TextPart> parts;
+  scrollback.getParts(0, text.size(), parts);
+
+  std::string buffer;
+  std::string partsText;
+  std::size_t compressedCount = 0;
+  for (const auto& part : parts)
+  {
+    CHECK(part.offset() == partsText.size());
+    partsText += part.read(buffer);
+    if (part.isCompressed())
+    {
+      ++compressedCount;
+    }
+  }
+
+  CHECK(partsText == text);
+
+  // All but the newest chunks, and the text that isn't part of a chunk
+  // yet, end up compressed
+  CHECK(compressedCount + 3 >= parts.size());
+  CHECK(compressedCount > 0);
+}
+
+
+void testScrollback()
+{
+  Scrollback scrollback;
+  std::vector<std::string> lines;
+  Random random;
+
+  const auto append = [&](std::string line)
+  {
+    scrollback.append(line.data(), line.data() + line.size());
+    scrollback.update();
+    lines.push_back(std::move(line));
+  };
+
+  for (auto i = 0; i < 100000; ++i)
+  {
+    append(
+      "line " + std::to_string(i) + " of " +
+      std::to_string(random.next() % 100000) + "\n");
+
+    // Output that gets replaced, like a progress bar's
+    if (i % 1000 == 0)
+    {
+      const auto size = scrollback.size();
+      const std::string progress = "50%\n";
+      scrollback.append(progress.data(), progress.data() + progress.size());
+      scrollback.truncate(size);
+    }
+  }
+
+  scrollback.waitForCompression();
+  checkLines(scrollback, lines);
+
+  // Removing text that isn't part of a chunk yet leaves the compressed
+  // text alone
+  const auto size = scrollback.size();
+  append("replaced\n");
+  scrollback.truncate(size);
+  lines.pop_back();
+  append("last line");
+
+  scrollback.waitForCompression();
+  checkLines(scrollback, lines);
+
+  // Reading chunks in random order, more of them than are cached
+  std::vector<std::uint64_t> offsets;
+  std::uint64_t offset = 0;
+  for (const auto& line : lines)
+  {
+    offsets.push_back(offset);
+    offset += line.size();
+  }
+
+  for (auto i = 0; i < 1000; ++i)
+  {
+    const auto index = random.next() % lines.size();
+    CHECK(scrollback.read(offsets[index], lines[index].size()) == lines[index]);
+  }
+}
+
+}
+
+
+int main()
+{
+  testRoundTrips();
+  testOverlappingMatch();
+  testDamagedBlocks();
+  testScrollback();
+
+  std::printf("Compression tests passed\n");
+  return 0;
+}
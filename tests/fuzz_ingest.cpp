@@ -0,0 +1,246 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+// Fuzz target for the ways text gets into a document: escape processing
+// for --message, and script output arriving in pieces of arbitrary size,
+// which is split into lines and optionally collapsed (--collapse). The
+// document's text can be moved into tiny chunks, which are compressed
+// right away, so that reading lines from compressed chunks is covered
+// even by short inputs.
+//
+// Built for libFuzzer with FUZZER=libfuzzer (see Makefile). Otherwise,
+// fuzz_main.cpp provides a standalone driver.
+
+#include "check.hpp"
+
+#include "../chunked_input.hpp"
+#include "../document.hpp"
+#include "../escape_sequences.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace
+{
+
+// Input layout: A byte of flags, a byte that determines the sizes of the
+// pieces the text arrives in, and the text. With SMALL_CHUNKS, the upper
+// bits of the flags determine the chunk size.
+constexpr std::size_t HEADER_SIZE = 2;
+
+constexpr std::uint8_t COLLAPSE_LINES = 1;
+constexpr std::uint8_t IGNORE_NUMBERS = 2;
+constexpr std::uint8_t SMALL_CHUNKS = 4;
+constexpr int CHUNK_SIZE_SHIFT = 3;
+
+// Like the viewer, but small, so that pieces often end within a character
+constexpr std::size_t MAX_PIECE_SIZE = 64;
+
+
+// Straightforward version of replaceEscapeSequences(), which walks
+// iterators by hand
+std::string replaceEscapeSequencesReference(const std::string& original)
+{
+  const std::string_view escapes = "fnrtv\\";
+  const std::string_view replacements = "\f\n\r\t\v\\";
+
+  std::string result;
+  for (std::size_t i = 0; i < original.size(); ++i)
+  {
+    if (original[i] == '\\' && i + 1 < original.size())
+    {
+      const auto escape = escapes.find(original[i + 1]);
+      if (escape != escapes.npos)
+      {
+        result.push_back(replacements[escape]);
+        ++i;
+        continue;
+      }
+    }
+
+    result.push_back(original[i]);
+  }
+
+  return result;
+}
+
+
+std::vector<std::string_view> splitLines(std::string_view text)
+{
+  std::vector<std::string_view> lines;
+  for (auto newline = text.find('\n'); newline != text.npos; newline = text.find('\n'))
+  {
+    lines.push_back(text.substr(0, newline));
+    text.remove_prefix(newline + 1);
+  }
+
+  lines.push_back(text);
+  return lines;
+}
+
+
+std::string documentText(const Document& document)
+{
+  return document.copyLines(0, document.lineCount() - 1);
+}
+
+
+// Every line, and ranges of lines crossing chunk boundaries
+void checkLines(
+  const Document& document,
+  const std::vector<std::string_view>& expectedLines)
+{
+  CHECK(document.lineCount() == expectedLines.size());
+  for (std::size_t i = 0; i < expectedLines.size(); ++i)
+  {
+    CHECK(document.line(i) == expectedLines[i]);
+
+    const auto last = std::min(i + 2, expectedLines.size() - 1);
+    std::string expectedText{expectedLines[i]};
+    for (auto j = i + 1; j <= last; ++j)
+    {
+      expectedText += '\n';
+      expectedText += expectedLines[j];
+    }
+
+    CHECK(document.copyLines(i, last) == expectedText);
+  }
+}
+
+
+void checkEscapeSequences(const std::string& text)
+{
+  const auto result = replaceEscapeSequences(text);
+  CHECK(result.size() <= text.size());
+  CHECK(result == replaceEscapeSequencesReference(text));
+}
+
+
+// Feeds the text to a document the way View::fetchScriptOutput() does,
+// with piece sizes derived from the given seed
+void checkChunkedIngest(const std::string& text, const std::uint8_t flags, std::uint8_t seed)
+{
+  const auto collapsesLines = (flags & COLLAPSE_LINES) != 0;
+
+  auto document = (flags & SMALL_CHUNKS)
+    ? Document::withChunkSize(1 + (flags >> CHUNK_SIZE_SHIFT) * 8)
+    : Document{};
+  if (collapsesLines)
+  {
+    document.hashLines((flags & IGNORE_NUMBERS) != 0);
+  }
+
+  ChunkedInput input{MAX_PIECE_SIZE};
+  std::size_t fedSize = 0;
+  while (fedSize < text.size())
+  {
+    // A simple LCG is enough to vary the sizes
+    seed = static_cast<std::uint8_t>(seed * 73 + 41);
+    const auto pieceSize =
+      std::min<std::size_t>(seed % MAX_PIECE_SIZE + 1, text.size() - fedSize);
+
+    std::memcpy(input.pieceBuffer(), text.data() + fedSize, pieceSize);
+    input.appendPiece(pieceSize, document);
+    fedSize += pieceSize;
+
+    // Text keeps being appended after older chunks were compressed
+    if (seed % 8 == 0)
+    {
+      document.waitForCompression();
+    }
+
+    // Only the start of a cut off character may be held back
+    if (!collapsesLines)
+    {
+      const auto heldBackSize = fedSize - document.textSize();
+      CHECK(heldBackSize <= 3);
+      CHECK(
+        heldBackSize ==
+          incompleteCharacterSize(text.data(), text.data() + fedSize));
+    }
+  }
+
+  input.finish(document);
+  document.waitForCompression();
+
+  const auto expectedLines = splitLines(text);
+  if (!collapsesLines)
+  {
+    CHECK(document.textSize() == text.size());
+    CHECK(documentText(document) == text);
+    checkLines(document, expectedLines);
+    return;
+  }
+
+  // Repeated lines are dropped, but counted
+  std::size_t lineCount = 0;
+  for (std::size_t i = 0; i < document.lineCount(); ++i)
+  {
+    lineCount += document.repeatCount(i);
+  }
+
+  CHECK(lineCount == expectedLines.size());
+
+  if (flags & IGNORE_NUMBERS)
+  {
+    return;
+  }
+
+  // Only exact repeats were dropped, so expanding them gives back the text
+  std::string expanded;
+  for (std::size_t i = 0; i < document.lineCount(); ++i)
+  {
+    for (std::size_t j = 0; j < document.repeatCount(i); ++j)
+    {
+      expanded += document.line(i);
+      expanded += '\n';
+    }
+  }
+
+  expanded.pop_back();
+  CHECK(expanded == text);
+}
+
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* pData, std::size_t size)
+{
+  if (size < HEADER_SIZE)
+  {
+    return 0;
+  }
+
+  const auto flags = pData[0];
+  const auto seed = pData[1];
+  const std::string text(
+    reinterpret_cast<const char*>(pData + HEADER_SIZE), size - HEADER_SIZE);
+
+  checkEscapeSequences(text);
+  checkChunkedIngest(text, flags, seed);
+  return 0;
+}
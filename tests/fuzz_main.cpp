@@ -0,0 +1,125 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+// Runs the fuzz target without libFuzzer. Inputs given on the command line
+// (files, e.g. crashes found by libFuzzer) are run as they are. Without
+// any, a fixed number of random inputs is generated. These are made up of
+// fragments that matter to the code under test, like linebreaks, escape
+// sequences, cut off UTF-8 characters and repeated lines, since uniformly
+// random bytes rarely hit any of them.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* pData, std::size_t size);
+
+
+namespace
+{
+
+constexpr int DEFAULT_RUN_COUNT = 20000;
+constexpr std::size_t MAX_FRAGMENT_COUNT = 200;
+
+const std::string_view FRAGMENTS[] = {
+  "\n", "\n", "\n\n", "a", "line", "12:34:56", "0x7f", " ", "\t",
+  "\\", "\\n", "\\t", "\\\\", "\\x", "\\r\\n",
+  "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80",
+  "\xC3", "\xE2\x82", "\xF0\x9F\x98", "\x80", "\xBF\xBF", "\xFF",
+  {"\0", 1}
+};
+
+
+std::string randomInput(std::mt19937& random)
+{
+  std::string input;
+  input.push_back(static_cast<char>(random()));
+  input.push_back(static_cast<char>(random()));
+
+  // Repeating the previous line is what --collapse is about
+  std::string line;
+  const auto fragmentCount = random() % MAX_FRAGMENT_COUNT;
+  for (std::size_t i = 0; i < fragmentCount; ++i)
+  {
+    if (random() % 8 == 0)
+    {
+      input += line + '\n';
+      continue;
+    }
+
+    const auto fragment = FRAGMENTS[random() % std::size(FRAGMENTS)];
+    input += fragment;
+    line = fragment == "\n" ? std::string{} : line + std::string{fragment};
+  }
+
+  return input;
+}
+
+
+void run(const std::string& input)
+{
+  LLVMFuzzerTestOneInput(
+    reinterpret_cast<const std::uint8_t*>(input.data()), input.size());
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+  {
+    for (auto i = 1; i < argc; ++i)
+    {
+      std::ifstream file(argv[i], std::ios::binary);
+      if (!file)
+      {
+        std::fprintf(stderr, "Can't read %s\n", argv[i]);
+        return 1;
+      }
+
+      run({std::istreambuf_iterator<char>(file), {}});
+    }
+
+    std::printf("Ran %d inputs\n", argc - 1);
+    return 0;
+  }
+
+  const auto pRunCount = std::getenv("FUZZ_RUNS");
+  const auto runCount = pRunCount ? std::atoi(pRunCount) : DEFAULT_RUN_COUNT;
+
+  std::mt19937 random;
+  for (auto i = 0; i < runCount; ++i)
+  {
+    run(randomInput(random));
+  }
+
+  std::printf("Ran %d random inputs\n", runCount);
+  return 0;
+}
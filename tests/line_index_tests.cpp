@@ -0,0 +1,181 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+// Tests for loading cached line indices, which must reject damaged cache
+// files instead of returning line offsets outside of the text.
+
+#include "check.hpp"
+
+#include "../line_index.hpp"
+#include "../position_store.hpp"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+constexpr std::size_t HEADER_SIZE = 80;
+constexpr std::size_t BLOCK_SIZE = 16;
+
+
+std::string readFile(const std::string& path)
+{
+  std::ifstream file{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file}, {}};
+}
+
+
+void writeFile(const std::string& path, const std::string& content)
+{
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  file.write(content.data(), content.size());
+}
+
+
+void checkLineStarts(const LineIndex& index, const std::uint64_t textSize)
+{
+  CHECK(index.lineStart(0) == 0);
+  for (std::size_t line = 1; line < index.lineCount(); ++line)
+  {
+    const auto start = index.lineStart(line);
+    CHECK(start > index.lineStart(line - 1));
+    CHECK(start <= textSize);
+    CHECK(index.lineContaining(start) == line);
+  }
+}
+
+
+std::string overwrite(
+  std::string data,
+  const std::size_t offset,
+  const std::string& bytes)
+{
+  data.replace(offset, bytes.size(), bytes);
+  return data;
+}
+
+}
+
+
+int main()
+{
+  char directory[] = "/tmp/line_index_tests.XXXXXX";
+  CHECK(mkdtemp(directory));
+  const auto path = std::string{directory} + "/index";
+
+  // Lines of various lengths, some needing multi-byte deltas
+  LineIndex original;
+  std::uint64_t textSize = 0;
+  std::vector<std::uint64_t> lineStarts{0};
+  for (auto i = 0; i < 1000; ++i)
+  {
+    textSize += 1 + (i * 7919) % (i % 10 == 0 ? 100000 : 100);
+    original.addLineStart(textSize);
+    lineStarts.push_back(textSize);
+  }
+
+  textSize += 10;
+  const auto source = FileIdentity{1, 2, textSize, 3, 4};
+  CHECK(original.save(path, source));
+  const auto saved = readFile(path);
+
+  {
+    const auto loaded = LineIndex::load(path, source);
+    CHECK(loaded);
+    CHECK(loaded->lineCount() == lineStarts.size());
+    for (std::size_t line = 0; line < lineStarts.size(); ++line)
+    {
+      CHECK(loaded->lineStart(line) == lineStarts[line]);
+    }
+  }
+
+  // For a different version of the text
+  auto otherSource = source;
+  otherSource.size = lineStarts.back();
+  CHECK(!LineIndex::load(path, otherSource));
+
+  const auto blocksOffset = HEADER_SIZE;
+  const auto deltasOffset = HEADER_SIZE + (lineStarts.size() + 63) / 64 * BLOCK_SIZE;
+  const std::vector<std::string> damagedFiles{
+    // Truncated, or with extra bytes
+    saved.substr(0, saved.size() - 1),
+    saved + '\0',
+
+    // A block starting beyond the text, or before the previous one
+    overwrite(saved, blocksOffset + BLOCK_SIZE + 7, "\x01"),
+    overwrite(saved, blocksOffset + BLOCK_SIZE, std::string(8, '\0')),
+
+    // Deltas starting beyond the end of the deltas
+    overwrite(saved, blocksOffset + BLOCK_SIZE + 8 + 6, "\x01"),
+
+    // A varint that doesn't end, or a line that is empty
+    overwrite(saved, saved.size() - 1, "\xFF"),
+    overwrite(saved, deltasOffset, std::string(1, '\0')),
+  };
+
+  for (const auto& damaged : damagedFiles)
+  {
+    writeFile(path, damaged);
+    CHECK(!LineIndex::load(path, source));
+  }
+
+  // Random damage is either rejected, or results in lines that are
+  // still within the text
+  std::uint32_t random = 12345;
+  auto nextRandom = [&]()
+  {
+    random = random * 1664525u + 1013904223u;
+    return random >> 8;
+  };
+
+  for (auto i = 0; i < 2000; ++i)
+  {
+    auto damaged = saved;
+    for (auto j = 0u; j < 1 + nextRandom() % 3; ++j)
+    {
+      const auto offset = blocksOffset + nextRandom() % (saved.size() - blocksOffset);
+      damaged[offset] = static_cast<char>(nextRandom());
+    }
+
+    writeFile(path, damaged);
+    if (const auto loaded = LineIndex::load(path, source))
+    {
+      checkLineStarts(*loaded, textSize);
+    }
+  }
+
+  std::remove(path.c_str());
+  std::remove((path + ".tmp").c_str());
+  rmdir(directory);
+
+  std::printf("Line index tests passed\n");
+  return 0;
+}
@@ -0,0 +1,151 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+// Tests for finding matching lines, both directly via RegexMatcher and
+// through DocumentSearch, which splits the document into parts.
+
+#include "check.hpp"
+
+#include "../document.hpp"
+#include "../regex.hpp"
+#include "../search.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+// Offsets of the lines in the text that contain a match
+std::vector<std::size_t> matchingLineOffsets(
+  const std::string_view pattern,
+  const std::string_view text)
+{
+  RegexMatcher matcher{std::make_shared<Regex>(pattern)};
+  std::vector<std::size_t> offsets;
+
+  const auto pEnd = text.data() + text.size();
+  auto pPosition = text.data();
+  while (const auto pLine = matcher.findMatchingLine(pPosition, pEnd, true))
+  {
+    offsets.push_back(pLine - text.data());
+    if (pLine == pEnd)
+    {
+      break;
+    }
+
+    const auto newline = text.find('\n', pLine - text.data());
+    pPosition = newline == text.npos ? pEnd : text.data() + newline + 1;
+  }
+
+  return offsets;
+}
+
+
+std::vector<std::size_t> searchDocument(
+  const std::string_view pattern,
+  const std::string& text)
+{
+  Document document{text};
+  DocumentSearch search{document, std::make_shared<Regex>(pattern), 0};
+
+  while (true)
+  {
+    if (auto lines = search.takeResults())
+    {
+      return *lines;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+
+using Offsets = std::vector<std::size_t>;
+
+
+void testEmptyLines()
+{
+  // The empty line after a trailing linebreak, or the one line of an
+  // empty text, is a line like any other
+  CHECK(matchingLineOffsets("^$", "a\n") == (Offsets{2}));
+  CHECK(matchingLineOffsets("^$", "") == (Offsets{0}));
+  CHECK(matchingLineOffsets("^$", "a\n\nb") == (Offsets{2}));
+  CHECK(matchingLineOffsets("^$", "a\n\n") == (Offsets{2, 3}));
+  CHECK(matchingLineOffsets("^$", "a") == (Offsets{}));
+  CHECK(matchingLineOffsets("x*", "a\n") == (Offsets{0, 2}));
+  CHECK(matchingLineOffsets("^\\s*$", " \n\t\n") == (Offsets{0, 2, 4}));
+  CHECK(matchingLineOffsets("a", "a\n") == (Offsets{0}));
+
+  // Without the end of the text, a trailing linebreak is followed by
+  // whatever comes next
+  RegexMatcher matcher{std::make_shared<Regex>("^$")};
+  const std::string_view text = "a\n";
+  CHECK(
+    matcher.findMatchingLine(text.data(), text.data() + text.size(), false) ==
+    nullptr);
+}
+
+
+void testSearchedDocument()
+{
+  CHECK(searchDocument("^$", "a\n") == (Offsets{1}));
+  CHECK(searchDocument("^$", "") == (Offsets{0}));
+  CHECK(searchDocument("^$", "a\n\nb\n") == (Offsets{1, 3}));
+  CHECK(searchDocument("b", "a\n\nb\n") == (Offsets{2}));
+
+  // Large enough to be split into several parts, none of which may report
+  // the line following it
+  std::string text;
+  for (auto i = 0; i < 100000; ++i)
+  {
+    text += i % 1000 == 0 ? "\n" : "some text to fill the line\n";
+  }
+
+  Offsets expected;
+  for (std::size_t i = 0; i < 100000; i += 1000)
+  {
+    expected.push_back(i);
+  }
+
+  expected.push_back(100000);
+  CHECK(searchDocument("^$", text) == expected);
+}
+
+}
+
+
+int main()
+{
+  testEmptyLines();
+  testSearchedDocument();
+
+  std::printf("Regex tests passed\n");
+  return 0;
+}
@@ -0,0 +1,362 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+// Feeds pathological input through the same path as script output (see
+// View::fetchScriptOutput()), and fails when a case takes longer or needs
+// more memory than its budget. The budgets are several times what the
+// cases take on a desktop machine, so they only catch performance cliffs,
+// like work that grows quadratically with the size of a line, rather
+// than small regressions.
+//
+// Each case runs in a child process of its own, so that its peak memory
+// usage can be measured separately.
+
+#include "check.hpp"
+
+#include "../chunked_input.hpp"
+#include "../document.hpp"
+#include "../escape_sequences.hpp"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+
+namespace
+{
+
+// Same as the viewer's
+constexpr std::size_t READ_SIZE = 64 * 1024;
+
+constexpr std::size_t MEGABYTE = 1024 * 1024;
+
+
+// Appends the text in pieces of the given size, like reads from a pipe
+void feed(
+  Document& document,
+  ChunkedInput& input,
+  const std::string_view text,
+  const std::size_t pieceSize)
+{
+  for (std::size_t offset = 0; offset < text.size(); offset += pieceSize)
+  {
+    const auto piece = text.substr(offset, pieceSize);
+    std::memcpy(input.pieceBuffer(), piece.data(), piece.size());
+    input.appendPiece(piece.size(), document);
+  }
+}
+
+
+// Returns a piece of a full read's size made up of the given text. The
+// piece ends within a character, so that each one is completed by the
+// next piece.
+std::string repeatedPiece(const std::string_view text)
+{
+  std::string piece;
+  while (piece.size() < READ_SIZE)
+  {
+    piece += text;
+  }
+
+  piece.resize(READ_SIZE);
+  CHECK(incompleteCharacterSize(piece.data(), piece.data() + piece.size()) > 0);
+  return piece;
+}
+
+
+// The input is generated piece by piece, so that the memory used is the
+// document's
+void singleHugeLine()
+{
+  constexpr std::size_t PIECE_COUNT = 100 * MEGABYTE / READ_SIZE;
+  const auto piece = repeatedPiece("1234 \xE2\x82\xAC ");
+
+  Document document;
+  ChunkedInput input{READ_SIZE};
+  for (std::size_t i = 0; i < PIECE_COUNT; ++i)
+  {
+    feed(document, input, piece, READ_SIZE);
+  }
+
+  input.finish(document);
+
+  CHECK(document.lineCount() == 1);
+  const auto line = document.line(0);
+  CHECK(line.size() == PIECE_COUNT * READ_SIZE);
+  for (std::size_t i = 0; i < PIECE_COUNT; i += 97)
+  {
+    CHECK(line.substr(i * READ_SIZE, READ_SIZE) == piece);
+  }
+}
+
+
+void millionsOfEmptyLines()
+{
+  constexpr std::size_t PIECE_COUNT = 10'000'000 / READ_SIZE;
+  const std::string piece(READ_SIZE, '\n');
+
+  Document document;
+  ChunkedInput input{READ_SIZE};
+  for (std::size_t i = 0; i < PIECE_COUNT; ++i)
+  {
+    feed(document, input, piece, READ_SIZE);
+  }
+
+  const auto lineCount = PIECE_COUNT * READ_SIZE;
+  CHECK(document.lineCount() == lineCount + 1);
+  for (std::size_t i = 0; i < lineCount; i += 9973)
+  {
+    CHECK(document.line(i).empty());
+    CHECK(document.lineContaining(i) == i);
+  }
+}
+
+
+void millionsOfRepeatedLines()
+{
+  constexpr std::string_view LINE = "12:00:00 waiting for device\n";
+  constexpr std::size_t LINE_COUNT = 5'000'000;
+  constexpr std::size_t LINES_PER_PIECE = 1000;
+
+  std::string piece;
+  for (std::size_t i = 0; i < LINES_PER_PIECE; ++i)
+  {
+    piece += LINE;
+  }
+
+  // As with --collapse, all but the first copy are dropped
+  Document document;
+  document.hashLines(false);
+  ChunkedInput input{piece.size()};
+  for (std::size_t i = 0; i < LINE_COUNT / LINES_PER_PIECE; ++i)
+  {
+    feed(document, input, piece, piece.size());
+  }
+
+  CHECK(document.lineCount() == 2);
+  CHECK(document.repeatCount(0) == LINE_COUNT);
+}
+
+
+void bytesSplitAtEveryBoundary()
+{
+  const std::string_view text =
+    "a\xC3\xA9\n\xE2\x82\xAC\xF0\x9F\x98\x80\n\n\xC3\xE2\x82x\xF0\x9F\n"
+    "\x80\xBF\xFF tail \xF0\x9F\x98";
+
+  // Every way of splitting the text into up to three pieces
+  for (std::size_t first = 0; first <= text.size(); ++first)
+  {
+    for (auto second = first; second <= text.size(); ++second)
+    {
+      Document document;
+      ChunkedInput input{READ_SIZE};
+      feed(document, input, text.substr(0, first), READ_SIZE);
+      feed(document, input, text.substr(first, second - first), READ_SIZE);
+      feed(document, input, text.substr(second), READ_SIZE);
+
+      CHECK(
+        document.textSize() ==
+          text.size() - incompleteCharacterSize(text.data(), text.data() + text.size()));
+
+      input.finish(document);
+      CHECK(document.copyLines(0, document.lineCount() - 1) == text);
+    }
+  }
+
+  // A script writing byte by byte must not be slower per byte than one
+  // writing in large blocks
+  std::string largeText;
+  while (largeText.size() < 16 * MEGABYTE)
+  {
+    largeText += "\xC3\xA9t\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80\n";
+  }
+
+  Document document;
+  ChunkedInput input{READ_SIZE};
+  feed(document, input, largeText, 1);
+  input.finish(document);
+  CHECK(document.textSize() == largeText.size());
+}
+
+
+// Lines that can be generated again for comparison, instead of keeping
+// a copy of the text around
+std::string numberedLine(const std::size_t index)
+{
+  return
+    "[" + std::to_string(index) + "] worker " + std::to_string(index % 7) +
+    " processed item " + std::to_string(index * 2654435761u % 100000) + "\n";
+}
+
+
+void outputReadFromCompressedChunks()
+{
+  constexpr std::size_t TEXT_SIZE = 32 * MEGABYTE;
+
+  Document document;
+  ChunkedInput input{READ_SIZE};
+  std::string piece;
+  std::size_t lineCount = 0;
+  std::uint64_t textSize = 0;
+  while (textSize < TEXT_SIZE)
+  {
+    piece += numberedLine(lineCount++);
+    if (piece.size() >= READ_SIZE)
+    {
+      feed(document, input, piece, READ_SIZE);
+      textSize += piece.size();
+      piece.clear();
+    }
+  }
+
+  feed(document, input, piece, READ_SIZE);
+  document.waitForCompression();
+
+  // Every line, including the empty one at the end. Ranges of lines
+  // cross chunk boundaries, and spread across many chunks.
+  CHECK(document.lineCount() == lineCount + 1);
+  CHECK(document.line(lineCount).empty());
+  for (std::size_t i = 0; i < lineCount; ++i)
+  {
+    auto expected = numberedLine(i);
+    expected.pop_back();
+    CHECK(document.line(i) == expected);
+  }
+
+  constexpr std::size_t LINES_PER_RANGE = 1000;
+  for (std::size_t first = 0; first < lineCount; first += LINES_PER_RANGE)
+  {
+    const auto last = std::min(first + LINES_PER_RANGE, lineCount);
+    std::string expected;
+    for (auto i = first; i <= last && i < lineCount; ++i)
+    {
+      expected += numberedLine(i);
+    }
+
+    // Without the last line's linebreak
+    if (last < lineCount)
+    {
+      expected.pop_back();
+    }
+
+    CHECK(document.copyLines(first, last) == expected);
+  }
+}
+
+
+void hugeMessageWithEscapes()
+{
+  constexpr std::string_view PATTERN = "col\\tcol\\\\n\\x\\nnext line\\";
+
+  // Like a command line argument, it's built once and kept around
+  std::string message;
+  message.reserve(100 * MEGABYTE + PATTERN.size());
+  while (message.size() < 100 * MEGABYTE)
+  {
+    message += PATTERN;
+  }
+
+  const auto text = replaceEscapeSequences(message);
+  CHECK(text.size() < message.size());
+
+  Document document{text};
+  CHECK(document.lineCount() > 1);
+}
+
+
+struct StressCase
+{
+  const char* name;
+  void (*run)();
+  double maxSeconds;
+  std::size_t maxMegabytes;
+};
+
+
+const StressCase STRESS_CASES[] = {
+  {"single 100 MB line", singleHugeLine, 3.0, 256},
+  {"10 million empty lines", millionsOfEmptyLines, 2.0, 64},
+  {"5 million repeated lines, collapsed", millionsOfRepeatedLines, 3.0, 32},
+  {"bytes split at every boundary", bytesSplitAtEveryBoundary, 4.0, 96},
+  {"32 MB read from compressed chunks", outputReadFromCompressedChunks, 4.0, 32},
+  {"100 MB message with escapes", hugeMessageWithEscapes, 5.0, 768},
+};
+
+
+bool runCase(const StressCase& stressCase)
+{
+  const auto startTime = std::chrono::steady_clock::now();
+
+  const auto pid = fork();
+  CHECK(pid != -1);
+  if (pid == 0)
+  {
+    stressCase.run();
+    std::_Exit(0);
+  }
+
+  int status = 0;
+  rusage usage{};
+  CHECK(wait4(pid, &status, 0, &usage) == pid);
+
+  const auto seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  const auto megabytes = static_cast<std::size_t>(usage.ru_maxrss) / 1024;
+
+  const auto hasPassed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  const auto isInBudget =
+    seconds <= stressCase.maxSeconds && megabytes <= stressCase.maxMegabytes;
+
+  std::printf(
+    "%-40s %6.2f s (budget %5.1f) %5zu MB (budget %5zu)  %s\n",
+    stressCase.name,
+    seconds,
+    stressCase.maxSeconds,
+    megabytes,
+    stressCase.maxMegabytes,
+    !hasPassed ? "FAILED" : !isInBudget ? "OVER BUDGET" : "ok");
+
+  return hasPassed && isInBudget;
+}
+
+}
+
+
+int main()
+{
+  auto hasPassed = true;
+  for (const auto& stressCase : STRESS_CASES)
+  {
+    hasPassed = runCase(stressCase) && hasPassed;
+  }
+
+  return hasPassed ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "text_cache.hpp"
+
+#include "imgui_impl_opengl3.h"
+
+#include <GLES2/gl2.h>
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace
+{
+
+// Draw lists use 16-bit indices, and the OpenGL ES 2 renderer can't offset
+// them. We therefore start a new draw list well before running out of
+// indices. The remaining room is enough for a line with 4096 visible
+// glyphs, at 4 vertices each.
+constexpr int MAX_VERTICES_PER_DRAW_LIST = 0xFFFF - 4 * 4096;
+
+}
+
+
+bool TextCache::Appearance::operator==(const Appearance& other) const
+{
+  return
+    pFont == other.pFont &&
+    fontSize == other.fontSize &&
+    fontTexture == other.fontTexture &&
+    textColor == other.textColor &&
+    backgroundColor == other.backgroundColor;
+}
+
+
+TextCache::TextCache() = default;
+
+
+TextCache::~TextCache()
+{
+  if (mFramebuffer)
+  {
+    glDeleteFramebuffers(1, &mFramebuffer);
+  }
+
+  if (mTexture)
+  {
+    glDeleteTextures(1, &mTexture);
+  }
+}
+
+
+bool TextCache::contains(
+  const Appearance& appearance,
+  const std::size_t firstLine,
+  const std::size_t endLine,
+  const double left,
+  const double right) const
+{
+  return
+    mIsValid &&
+    appearance == mAppearance &&
+    firstLine >= mFirstLine &&
+    endLine <= mEndLine &&
+    left >= mLeft &&
+    right <= mLeft + mSize.x;
+}
+
+
+bool TextCache::begin(
+  const Appearance& appearance,
+  const std::size_t firstLine,
+  const std::size_t endLine,
+  const double left,
+  const double right)
+{
+  mIsValid = false;
+  mPendingDrawLists.clear();
+
+  mSize = {
+    static_cast<float>(right - left),
+    (endLine - firstLine) * appearance.fontSize};
+
+  const auto& framebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+  const auto textureWidth =
+    static_cast<int>(std::ceil(mSize.x * framebufferScale.x));
+  const auto textureHeight =
+    static_cast<int>(std::ceil(mSize.y * framebufferScale.y));
+  if (
+    (textureWidth != mTextureWidth || textureHeight != mTextureHeight) &&
+    !resizeTexture(textureWidth, textureHeight))
+  {
+    return false;
+  }
+
+  mAppearance = appearance;
+  mFirstLine = firstLine;
+  mEndLine = endLine;
+  mLeft = left;
+  mIsValid = true;
+  return true;
+}
+
+
+void TextCache::addLine(const std::size_t line, const std::string_view text)
+{
+  addLine(line, text, 0.0);
+}
+
+
+void TextCache::addLine(
+  const std::size_t line,
+  const std::string_view text,
+  const double x)
+{
+  if (
+    mPendingDrawLists.empty() ||
+    mPendingDrawLists.back()->VtxBuffer.Size > MAX_VERTICES_PER_DRAW_LIST)
+  {
+    auto pDrawList =
+      std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData());
+
+    // A freshly constructed draw list doesn't have a command yet that the
+    // clip rect and texture could be applied to
+    pDrawList->AddDrawCmd();
+    pDrawList->PushClipRect({0.0f, 0.0f}, mSize);
+    pDrawList->PushTextureID(mAppearance.fontTexture);
+    mPendingDrawLists.push_back(std::move(pDrawList));
+  }
+
+  mPendingDrawLists.back()->AddText(
+    mAppearance.pFont,
+    mAppearance.fontSize,
+    {static_cast<float>(x - mLeft), (line - mFirstLine) * mAppearance.fontSize},
+    mAppearance.textColor,
+    text.data(),
+    text.data() + text.size());
+}
+
+
+bool TextCache::render()
+{
+  if (!mIsValid || mPendingDrawLists.empty())
+  {
+    return false;
+  }
+
+  std::vector<ImDrawList*> drawLists;
+  ImDrawData drawData;
+  for (const auto& pDrawList : mPendingDrawLists)
+  {
+    drawLists.push_back(pDrawList.get());
+    drawData.TotalVtxCount += pDrawList->VtxBuffer.Size;
+    drawData.TotalIdxCount += pDrawList->IdxBuffer.Size;
+  }
+
+  drawData.Valid = true;
+  drawData.CmdLists = drawLists.data();
+  drawData.CmdListsCount = static_cast<int>(drawLists.size());
+  drawData.DisplayPos = {0.0f, 0.0f};
+  drawData.DisplaySize = mSize;
+  drawData.FramebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+
+  // The texture replaces the background that the text would otherwise be
+  // drawn on, so it needs to contain that background and be opaque. Alpha
+  // is masked out while drawing the text, since blending the glyphs'
+  // edges would make the texture partially transparent. The renderer sets
+  // up (and restores) everything else, including the viewport.
+  const auto background =
+    ImGui::ColorConvertU32ToFloat4(mAppearance.backgroundColor);
+  glViewport(0, 0, mTextureWidth, mTextureHeight);
+  glDisable(GL_SCISSOR_TEST);
+  glClearColor(background.x, background.y, background.z, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+  ImGui_ImplOpenGL3_RenderDrawData(&drawData);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+  mPendingDrawLists.clear();
+  return true;
+}
+
+
+void TextCache::draw(ImDrawList& drawList, const ImVec2& position) const
+{
+  // Rendering to a texture stores the image upside down, hence
+  // the flipped texture coordinates
+  drawList.AddImage(
+    reinterpret_cast<ImTextureID>(static_cast<std::intptr_t>(mTexture)),
+    position,
+    {position.x + mSize.x, position.y + mSize.y},
+    {0.0f, 1.0f},
+    {1.0f, 0.0f});
+}
+
+
+bool TextCache::resizeTexture(const int width, const int height)
+{
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  if (width <= 0 || height <= 0 || width > maxSize || height > maxSize)
+  {
+    return false;
+  }
+
+  if (!mTexture)
+  {
+    glGenTextures(1, &mTexture);
+    glGenFramebuffers(1, &mFramebuffer);
+  }
+
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  // The texture is shown at its original size, so nearest neighbour
+  // filtering keeps the text sharp
+  glBindTexture(GL_TEXTURE_2D, mTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(
+    GL_TEXTURE_2D,
+    0,
+    GL_RGBA,
+    width,
+    height,
+    0,
+    GL_RGBA,
+    GL_UNSIGNED_BYTE,
+    nullptr);
+  glBindTexture(GL_TEXTURE_2D, previousTexture);
+
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+  glFramebufferTexture2D(
+    GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexture, 0);
+  const auto isComplete =
+    glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+  if (!isComplete)
+  {
+    mTextureWidth = mTextureHeight = 0;
+    return false;
+  }
+
+  mTextureWidth = width;
+  mTextureHeight = height;
+  return true;
+}
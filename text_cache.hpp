@@ -0,0 +1,121 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+// Keeps a block of consecutive text lines rendered into an offscreen
+// texture. As long as neither the text nor its appearance change, showing
+// it only takes a single textured quad per frame, instead of one per glyph.
+//
+// The cache covers a horizontal range of the lines, given relative to
+// their start. Scrolling only moves the quad, as long as the visible part
+// stays within the cached range.
+//
+// Filling the cache is split into two steps: begin() and addLine() prepare
+// draw commands while building the ImGui frame, render() executes them
+// afterwards, before the frame itself is rendered.
+class TextCache {
+public:
+  // Everything that affects how the cached lines look. When any of this
+  // changes, the cache needs to be filled anew.
+  struct Appearance
+  {
+    bool operator==(const Appearance& other) const;
+    bool operator!=(const Appearance& other) const { return !(*this == other); }
+
+    ImFont* pFont;
+    float fontSize;
+    ImTextureID fontTexture;
+    ImU32 textColor;
+    ImU32 backgroundColor;
+  };
+
+  TextCache();
+  ~TextCache();
+
+  TextCache(const TextCache&) = delete;
+  TextCache& operator=(const TextCache&) = delete;
+
+  // Returns true if the lines in [firstLine, endLine) are cached with
+  // the given appearance, between the horizontal positions left and right.
+  // These are relative to the start of the lines, in pixels.
+  bool contains(
+    const Appearance& appearance,
+    std::size_t firstLine,
+    std::size_t endLine,
+    double left,
+    double right) const;
+
+  // Starts filling the cache with the lines in [firstLine, endLine), which
+  // must then be given to addLine(). Returns false if the cache can't be
+  // used, e.g. because the GPU doesn't support rendering to a texture
+  // of the required size.
+  bool begin(
+    const Appearance& appearance,
+    std::size_t firstLine,
+    std::size_t endLine,
+    double left,
+    double right);
+  void addLine(std::size_t line, std::string_view text);
+
+  // Adds part of a line, starting at the given position relative to the
+  // start of the line
+  void addLine(std::size_t line, std::string_view text, double x);
+
+  // Renders lines given to addLine() since the last call into the texture.
+  // Must be called between ImGui::Render() and rendering the frame.
+  // Returns false if there was nothing to render.
+  bool render();
+
+  // Draws the cached area with its top-left corner at the given position,
+  // i.e. the first cached line at left().
+  void draw(ImDrawList& drawList, const ImVec2& position) const;
+
+  std::size_t firstLine() const { return mFirstLine; }
+  double left() const { return mLeft; }
+
+  // Makes the next contains() call fail, for when the cached lines
+  // themselves changed instead of their appearance
+  void invalidate() { mIsValid = false; }
+
+private:
+  bool resizeTexture(int width, int height);
+
+  std::vector<std::unique_ptr<ImDrawList>> mPendingDrawLists;
+  Appearance mAppearance;
+  std::size_t mFirstLine = 0;
+  std::size_t mEndLine = 0;
+  double mLeft = 0.0;
+  ImVec2 mSize;
+  int mTextureWidth = 0;
+  int mTextureHeight = 0;
+  unsigned mTexture = 0;
+  unsigned mFramebuffer = 0;
+  bool mIsValid = false;
+};
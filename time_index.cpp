@@ -0,0 +1,450 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "time_index.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+
+namespace
+{
+
+constexpr std::int64_t MS_PER_SECOND = 1000;
+constexpr std::int64_t MS_PER_MINUTE = 60 * MS_PER_SECOND;
+constexpr std::int64_t MS_PER_HOUR = 60 * MS_PER_MINUTE;
+constexpr std::int64_t MS_PER_DAY = 24 * MS_PER_HOUR;
+
+// Distance between index entries, in lines
+constexpr std::size_t LINES_PER_ENTRY = 256;
+
+// If none of these first lines has a timestamp, the document is
+// most likely not a log, and we don't look any further
+constexpr std::size_t MAX_LINES_WITHOUT_TIMESTAMP = 1024;
+
+// Syslog timestamps don't include the year
+constexpr int SYSLOG_YEAR = 2000;
+
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar, see
+// http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+std::int64_t daysFromCivil(int year, const int month, const int day)
+{
+  year -= month <= 2;
+  const auto era = (year >= 0 ? year : year - 399) / 400;
+  const auto yearOfEra = year - era * 400;
+  const auto dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const auto dayOfEra =
+    yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return static_cast<std::int64_t>(era) * 146097 + dayOfEra - 719468;
+}
+
+
+// Reads characters from the start of a line or user input
+class TimeParser {
+public:
+  explicit TimeParser(const std::string_view text)
+    : mText(text)
+  {
+  }
+
+  bool atEnd() const
+  {
+    return mPosition == mText.size();
+  }
+
+  bool consume(const char c)
+  {
+    if (!atEnd() && mText[mPosition] == c)
+    {
+      ++mPosition;
+      return true;
+    }
+
+    return false;
+  }
+
+  void skipSpaces()
+  {
+    while (consume(' '))
+    {
+    }
+  }
+
+  // Reads a number with the given range of digits
+  std::optional<int> readNumber(const std::size_t minDigits, const std::size_t maxDigits)
+  {
+    auto value = 0;
+    auto digits = std::size_t{0};
+    while (
+      digits < maxDigits &&
+      !atEnd() &&
+      mText[mPosition] >= '0' &&
+      mText[mPosition] <= '9')
+    {
+      value = value * 10 + (mText[mPosition++] - '0');
+      ++digits;
+    }
+
+    if (digits < minDigits)
+    {
+      return {};
+    }
+
+    return value;
+  }
+
+  // YYYY-MM-DD or YYYY/MM/DD, returned as days since 1970-01-01
+  std::optional<std::int64_t> readDate()
+  {
+    const auto start = mPosition;
+    const auto year = readNumber(4, 4);
+    const auto separator = atEnd() ? '\0' : mText[mPosition];
+    if (!year || (separator != '-' && separator != '/'))
+    {
+      mPosition = start;
+      return {};
+    }
+
+    ++mPosition;
+    const auto month = readNumber(2, 2);
+    if (!month || !consume(separator))
+    {
+      mPosition = start;
+      return {};
+    }
+
+    const auto day = readNumber(2, 2);
+    if (!day || !isValidDate(*month, *day))
+    {
+      mPosition = start;
+      return {};
+    }
+
+    return daysFromCivil(*year, *month, *day);
+  }
+
+  // "Oct 18", as used by syslog
+  std::optional<std::int64_t> readSyslogDate()
+  {
+    static constexpr std::array<const char*, 12> MONTH_NAMES{
+      "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    if (mText.size() - mPosition < 3)
+    {
+      return {};
+    }
+
+    const auto start = mPosition;
+    for (std::size_t i = 0; i < MONTH_NAMES.size(); ++i)
+    {
+      if (mText.compare(mPosition, 3, MONTH_NAMES[i]) != 0)
+      {
+        continue;
+      }
+
+      mPosition += 3;
+      if (!consume(' '))
+      {
+        break;
+      }
+
+      // Single digit days are padded with a space
+      skipSpaces();
+      const auto month = static_cast<int>(i) + 1;
+      const auto day = readNumber(1, 2);
+      if (!day || !isValidDate(month, *day))
+      {
+        break;
+      }
+
+      return daysFromCivil(SYSLOG_YEAR, month, *day);
+    }
+
+    mPosition = start;
+    return {};
+  }
+
+  // HH:MM:SS with optional fraction, returned as milliseconds since
+  // midnight. Seconds can be made optional.
+  std::optional<std::int64_t> readTimeOfDay(const bool requireSeconds)
+  {
+    const auto start = mPosition;
+    const auto hours = readNumber(2, 2);
+    if (!hours || *hours > 23 || !consume(':'))
+    {
+      mPosition = start;
+      return {};
+    }
+
+    const auto minutes = readNumber(2, 2);
+    if (!minutes || *minutes > 59)
+    {
+      mPosition = start;
+      return {};
+    }
+
+    auto time = *hours * MS_PER_HOUR + *minutes * MS_PER_MINUTE;
+
+    if (!consume(':'))
+    {
+      if (requireSeconds)
+      {
+        mPosition = start;
+        return {};
+      }
+
+      return time;
+    }
+
+    // Allowing 60 for leap seconds
+    const auto seconds = readNumber(2, 2);
+    if (!seconds || *seconds > 60)
+    {
+      mPosition = start;
+      return {};
+    }
+
+    time += *seconds * MS_PER_SECOND;
+
+    if (consume('.') || consume(','))
+    {
+      // Only the first three digits matter, but there can be up to nine
+      auto scale = 100;
+      auto digits = 0;
+      while (!atEnd() && mText[mPosition] >= '0' && mText[mPosition] <= '9')
+      {
+        time += (mText[mPosition++] - '0') * scale;
+        scale /= 10;
+        ++digits;
+      }
+
+      if (digits == 0)
+      {
+        mPosition = start;
+        return {};
+      }
+    }
+
+    return time;
+  }
+
+private:
+  static bool isValidDate(const int month, const int day)
+  {
+    return month >= 1 && month <= 12 && day >= 1 && day <= 31;
+  }
+
+  std::string_view mText;
+  std::size_t mPosition = 0;
+};
+
+
+// Turns a timestamp into a time that continues the previous one. Logs that
+// only have the time of day continue on the day of the previous time, or
+// the next day if the time jumped back by more than 12 hours. Times never
+// decrease, so that the index can be searched.
+std::int64_t continueTime(const std::int64_t previous, const std::int64_t timestamp)
+{
+  auto time = timestamp;
+  if (timestamp < MS_PER_DAY)
+  {
+    time += previous - previous % MS_PER_DAY;
+    if (time + 12 * MS_PER_HOUR < previous)
+    {
+      time += MS_PER_DAY;
+    }
+  }
+
+  return std::max(time, previous);
+}
+
+}
+
+
+std::optional<std::int64_t> parseLineTimestamp(const std::string_view line)
+{
+  TimeParser parser{line};
+  parser.consume('[');
+
+  if (const auto days = parser.readDate())
+  {
+    if (!parser.consume(' ') && !parser.consume('T'))
+    {
+      return {};
+    }
+
+    const auto time = parser.readTimeOfDay(true);
+    return time ? std::optional{*days * MS_PER_DAY + *time} : std::nullopt;
+  }
+
+  if (const auto days = parser.readSyslogDate())
+  {
+    if (!parser.consume(' '))
+    {
+      return {};
+    }
+
+    const auto time = parser.readTimeOfDay(true);
+    return time ? std::optional{*days * MS_PER_DAY + *time} : std::nullopt;
+  }
+
+  return parser.readTimeOfDay(true);
+}
+
+
+std::optional<std::int64_t> parseTimeInput(
+  const std::string_view input,
+  const std::int64_t referenceTime)
+{
+  TimeParser parser{input};
+  parser.skipSpaces();
+
+  const auto days = parser.readDate();
+  std::optional<std::int64_t> time;
+  if (days)
+  {
+    // The time is optional when giving a date
+    parser.consume('T');
+    parser.skipSpaces();
+    time = parser.atEnd() ? 0 : parser.readTimeOfDay(false);
+  }
+  else
+  {
+    time = parser.readTimeOfDay(false);
+  }
+
+  parser.skipSpaces();
+  if (!time || !parser.atEnd())
+  {
+    return {};
+  }
+
+  const auto day = days
+    ? *days * MS_PER_DAY
+    : referenceTime - referenceTime % MS_PER_DAY;
+  return day + *time;
+}
+
+
+TimeIndex::TimeIndex(const Document& document)
+  : mDocument(document)
+  , mThread([this]() { build(); })
+{
+}
+
+
+TimeIndex::~TimeIndex()
+{
+  mIsCancelled = true;
+  mThread.join();
+}
+
+
+bool TimeIndex::hasTimestamps() const
+{
+  return mIsBuilt && !mEntries.empty();
+}
+
+
+std::int64_t TimeIndex::startTime() const
+{
+  return mEntries.front().time;
+}
+
+
+std::optional<std::size_t> TimeIndex::findLine(const std::int64_t time) const
+{
+  // Find the first entry at or after the given time. The line we're looking
+  // for is somewhere between the entry before it and that entry.
+  const auto iEntry = std::lower_bound(
+    mEntries.begin(),
+    mEntries.end(),
+    time,
+    [](const Entry& entry, const std::int64_t value)
+    {
+      return entry.time < value;
+    });
+
+  if (iEntry == mEntries.begin())
+  {
+    return iEntry->line;
+  }
+
+  const auto& previousEntry = *(iEntry - 1);
+  const auto endLine = iEntry != mEntries.end()
+    ? iEntry->line
+    : mDocument.lineCount();
+
+  auto previousTime = previousEntry.time;
+  for (auto line = previousEntry.line + 1; line < endLine; ++line)
+  {
+    if (const auto timestamp = parseLineTimestamp(mDocument.line(line)))
+    {
+      previousTime = continueTime(previousTime, *timestamp);
+      if (previousTime >= time)
+      {
+        return line;
+      }
+    }
+  }
+
+  if (iEntry != mEntries.end())
+  {
+    return iEntry->line;
+  }
+
+  return {};
+}
+
+
+void TimeIndex::build()
+{
+  // For each block of lines, the first line with a timestamp is indexed
+  const auto lineCount = mDocument.lineCount();
+  for (
+    std::size_t blockStart = 0;
+    blockStart < lineCount && !mIsCancelled;
+    blockStart += LINES_PER_ENTRY)
+  {
+    if (mEntries.empty() && blockStart >= MAX_LINES_WITHOUT_TIMESTAMP)
+    {
+      break;
+    }
+
+    const auto blockEnd = std::min(blockStart + LINES_PER_ENTRY, lineCount);
+    for (auto line = blockStart; line < blockEnd; ++line)
+    {
+      if (const auto timestamp = parseLineTimestamp(mDocument.line(line)))
+      {
+        const auto time = mEntries.empty()
+          ? *timestamp
+          : continueTime(mEntries.back().time, *timestamp);
+        mEntries.push_back({line, time});
+        break;
+      }
+    }
+  }
+
+  mIsBuilt = true;
+}
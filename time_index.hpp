@@ -0,0 +1,100 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "document.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+// Timestamps are given in milliseconds. Those that include a date count
+// from 1970-01-01, those that only give the time of day from midnight.
+// Time zones are ignored: Times are compared as they appear in the log,
+// which is also how the user will type them in.
+//
+// Recognized formats, at the start of a line (optionally after a '['):
+//   2024-10-18 14:32:01.123   (also with 'T' or '/', fraction optional)
+//   Oct 18 14:32:01           (syslog, taken to be in the year 2000)
+//   14:32:01.123              (fraction optional)
+std::optional<std::int64_t> parseLineTimestamp(std::string_view line);
+
+// Parses a time typed in by the user, like "14:32" or "2024-10-18 14:32".
+// When no date is given, it's taken from the reference time.
+std::optional<std::int64_t> parseTimeInput(
+  std::string_view input,
+  std::int64_t referenceTime);
+
+
+// A sparse index of the timestamps in a document, built on a background
+// thread. Only every 256th line is looked at, so the index takes a tiny
+// fraction of the document's size, and building it is quick even for huge
+// files. Finding the line for a given time does a binary search in the
+// index, followed by a scan of the lines between two index entries.
+//
+// Times in the index never decrease, even if the log's timestamps do.
+// Logs that only contain the time of day are assumed to continue on the
+// next day when the time jumps back by more than 12 hours.
+//
+// The document must not be modified while the index exists.
+class TimeIndex {
+public:
+  explicit TimeIndex(const Document& document);
+  ~TimeIndex();
+
+  TimeIndex(const TimeIndex&) = delete;
+  TimeIndex& operator=(const TimeIndex&) = delete;
+
+  // True once the index is built, and found timestamps in the document.
+  // The functions below must only be used if this returns true.
+  bool hasTimestamps() const;
+
+  // Time of the first line with a timestamp
+  std::int64_t startTime() const;
+
+  // Returns the first line with a time at or after the given one, or an
+  // empty optional if there is none.
+  std::optional<std::size_t> findLine(std::int64_t time) const;
+
+private:
+  struct Entry
+  {
+    std::size_t line;
+    std::int64_t time;
+  };
+
+  void build();
+
+  const Document& mDocument;
+  std::vector<Entry> mEntries;
+  std::atomic<bool> mIsBuilt{false};
+  std::atomic<bool> mIsCancelled{false};
+
+  // Declared last, so that everything the thread uses is initialized
+  // before it starts
+  std::thread mThread;
+};
@@ -21,50 +21,164 @@
 
 #include "view.hpp"
 
+#include "font_manager.hpp"
+
 #include "imgui_internal.h"
 
 #include <poll.h>
 #include <unistd.h>
 
-#include <sstream>
+#include <cerrno>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
 #include <stdexcept>
 
 
+namespace
+{
+
+// How long status messages (like "Copied 3 lines") are shown
+constexpr auto STATUS_MESSAGE_DURATION = std::chrono::seconds(3);
+
+// Script output is read in chunks of this size, for as long as there is
+// more available, but for no longer than the budget per frame
+constexpr std::size_t READ_BUFFER_SIZE = 64 * 1024;
+constexpr auto READ_BUDGET_PER_FRAME = std::chrono::milliseconds(4);
+
+// How often the throughput of script output is measured, and how much
+// each measurement contributes to the value shown
+constexpr auto THROUGHPUT_UPDATE_INTERVAL = std::chrono::milliseconds(250);
+constexpr auto THROUGHPUT_SMOOTHING = 0.5;
+
+
+// Number of lines whose JSON fields are kept around. Only a screenful
+// is needed at a time, the rest makes scrolling back and forth cheap.
+constexpr std::size_t JSON_FIELD_CACHE_LINES = 4096;
+
+
+// Used to give exported files unique names
+std::string currentTimestamp()
+{
+  char timestamp[32];
+  const auto now = std::time(nullptr);
+  std::strftime(
+    timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+  return timestamp;
+}
+
+
+// Writes the lines from first to last (inclusive) to a file, followed by
+// a linebreak. The text is written part by part straight from the
+// document, so that saving even a very large selection only needs memory
+// for a single part, e.g. a decompressed chunk of script output.
+bool writeTextFile(
+  const std::string& path,
+  const Document& document,
+  const std::size_t first,
+  const std::size_t last)
+{
+  constexpr std::size_t PART_SIZE = 1024 * 1024;
+
+  const auto pFile = std::fopen(path.c_str(), "wb");
+  if (!pFile)
+  {
+    return false;
+  }
+
+  auto success = true;
+  std::string buffer;
+  for (const auto& part : document.textParts(first, last, PART_SIZE))
+  {
+    const auto text = part.read(buffer);
+    success = std::fwrite(text.data(), 1, text.size(), pFile) == text.size();
+    if (!success)
+    {
+      break;
+    }
+  }
+
+  success = success && std::fputc('\n', pFile) != EOF;
+  return std::fclose(pFile) == 0 && success;
+}
+
+
+std::string formatThroughput(const double bytesPerSecond)
+{
+  char text[32];
+  if (bytesPerSecond >= 1024.0 * 1024.0)
+  {
+    std::snprintf(text, sizeof(text), "%.1f MB/s", bytesPerSecond / (1024.0 * 1024.0));
+  }
+  else if (bytesPerSecond >= 1024.0)
+  {
+    std::snprintf(text, sizeof(text), "%.1f KB/s", bytesPerSecond / 1024.0);
+  }
+  else
+  {
+    std::snprintf(text, sizeof(text), "%.0f B/s", bytesPerSecond);
+  }
+
+  return text;
+}
+
+
+// The color that the text window's content is drawn on: its own
+// background over that of the main window, which in turn is drawn over
+// the clear color (black, see main.cpp).
+ImU32 textBackgroundColor()
+{
+  const auto& windowBg = ImGui::GetStyleColorVec4(ImGuiCol_WindowBg);
+  const auto& childBg = ImGui::GetStyleColorVec4(ImGuiCol_ChildBg);
+
+  auto blend = [](const float below, const float above, const float alpha)
+  {
+    return above * alpha + below * (1.0f - alpha);
+  };
+
+  return ImGui::GetColorU32({
+    blend(windowBg.x * windowBg.w, childBg.x, childBg.w),
+    blend(windowBg.y * windowBg.w, childBg.y, childBg.w),
+    blend(windowBg.z * windowBg.w, childBg.z, childBg.w),
+    1.0f});
+}
+
+}
+
+
 View::View(
   std::string windowTitle,
-  std::string inputTextOrScriptFile,
+  Document document,
+  const std::optional<std::string>& scriptFile,
   const bool showYesNoButtons,
   const bool wrapLines,
-  const bool inputTextIsScriptFile)
+  std::string exportDirectory,
+  FontManager& fontManager)
   : mTitle(std::move(windowTitle))
-  , mText([&]() -> decltype(mText) {
-      // When executing a script, mText is gradually filled up
-      // with the script's output. We need to initialize it
-      // to either an empty string, or an empty list of lines
-      // depending on if word wrapping is enabled or not.
-      if (inputTextIsScriptFile)
-      {
-        if (wrapLines)
-        {
-          return std::vector<std::string>{};
-        }
-        else
-        {
-          return "";
-        }
-      }
-
-      return std::move(inputTextOrScriptFile);
-    }())
+  , mDocument(std::move(document))
+  , mFontManager(fontManager)
   , mpScriptPipe(nullptr)
   , mScriptPipeFd(-1)
+  , mShowsScriptOutput(scriptFile.has_value())
+  , mpTextWindow(nullptr)
+  , mMaxLineWidth(0.0f)
+  , mLastFontSize(0.0f)
+  , mTopLine(0.0f)
+  , mScriptOutputPending(false)
+  , mExportDirectory(std::move(exportDirectory))
   , mShowYesNoButtons(showYesNoButtons)
+  , mWrapLines(wrapLines)
 {
   // We are executing a script instead of showing some text.
   // Start executing it, and grab the file descriptor for polling.
-  if (inputTextIsScriptFile)
+  // The document is gradually filled up with the script's output.
+  if (scriptFile)
   {
-    mpScriptPipe = popen((inputTextOrScriptFile + " 2>&1 ").c_str(), "r");
+    mpScriptPipe = popen((*scriptFile + " 2>&1 ").c_str(), "r");
     if (!mpScriptPipe)
     {
       throw std::runtime_error("Failed to execute script");
@@ -76,17 +190,15 @@ View::View(
       pclose(mpScriptPipe);
       throw std::runtime_error("Failed to execute script");
     }
+
+    mScriptInput.emplace(READ_BUFFER_SIZE);
+    mLastThroughputUpdate = std::chrono::steady_clock::now();
   }
-  else if (wrapLines)
-  {
-    std::stringstream stream{std::get<std::string>(mText)};
-    std::vector<std::string> lines;
-    for (std::string line; std::getline(stream, line); )
-    {
-      lines.push_back(line);
-    }
 
-    mText = std::move(lines);
+  if (mDocument.hasLineHashes())
+  {
+    mFolding.emplace();
+    mFolding->update(mDocument);
   }
 }
 
@@ -97,10 +209,10 @@ View::~View()
 }
 
 
-std::optional<int> View::draw(const ImVec2& windowSize)
+std::optional<int> View::draw(const ImVec2& windowPos, const ImVec2& windowSize)
 {
   ImGui::SetNextWindowSize(windowSize);
-  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowPos(windowPos);
 
   bool scroll = false;
   auto running = true;
@@ -119,9 +231,10 @@ std::optional<int> View::draw(const ImVec2& windowSize)
   const auto buttonSpaceRequired =
     ImGui::CalcTextSize("Close", nullptr, true).y +
     ImGui::GetStyle().FramePadding.y * 2.0f;
+  // The search bar, if shown, takes up another row of the same height.
+  const auto buttonRowCount = mShowsSearchBar ? 2 : 1;
   const auto maxTextHeight = ImGui::GetContentRegionAvail().y -
-    ImGui::GetStyle().ItemSpacing.y -
-    buttonSpaceRequired;
+    (ImGui::GetStyle().ItemSpacing.y + buttonSpaceRequired) * buttonRowCount;
 
   // On the first frame (indicated by IsWindowAppearing), focus
   // the text so that the user can immediately scroll it without
@@ -133,41 +246,98 @@ std::optional<int> View::draw(const ImVec2& windowSize)
     ImGui::SetNextWindowFocus();
   }
 
+  // When zooming, keep the same line at the top of the screen
+  if (ImGui::GetFontSize() != mLastFontSize)
+  {
+    handleFontSizeChange();
+  }
+
+  // JSON columns are drawn as a table, which scrolls on its own
+  const auto showsColumns = showsJsonColumns();
+
+  // Jump to the requested line, if any. Without wrapping, we can scroll
+  // the text window before it begins, so that the new position already
+  // applies to the current frame.
+  if (mPendingTopLine && !mWrapLines && mpTextWindow)
+  {
+    ImGui::SetScrollY(
+      mpTextWindow,
+      rowPosition(*mPendingTopLine) * ImGui::GetTextLineHeight());
+    mPendingTopLine.reset();
+  }
+
+  // Without wrapping, we know the exact size of the text up front. Giving
+  // it to ImGui makes the scroll range correct right away, even on frames
+  // where the line height or number of lines just changed.
+  if (!mWrapLines && !showsColumns)
+  {
+    ImGui::SetNextWindowContentSize({
+      mMaxLineWidth,
+      rowCount() * ImGui::GetTextLineHeight()});
+  }
+
   // Draw the scrollable region containing the text
   ImGui::BeginChild(
     "#scroll_area",
     {0, maxTextHeight},
     true,
-    ImGuiWindowFlags_HorizontalScrollbar);
+    showsColumns
+      ? ImGuiWindowFlags_NoScrollbar
+      : ImGuiWindowFlags_HorizontalScrollbar);
+
+  updateSearch();
+
+  if (!mpTimeIndex && !mpScriptPipe)
+  {
+    mpTimeIndex = std::make_unique<TimeIndex>(mDocument);
+  }
 
   // We are executing a script instead of showing some text.
   // Fetch output from the script and append it to our text buffer.
-  if (mpScriptPipe)
+  if (mpScriptPipe && !mpSearch)
   {
-    scroll = fetchScriptOutput();
+    scroll = fetchScriptOutput(READ_BUDGET_PER_FRAME);
   }
 
-  // Draw the text buffer.
-  if (const auto pText = std::get_if<std::string>(&mText))
+  // Older output keeps being compressed after the script stops writing
+  mDocument.update();
+
+  // Also scroll to output that arrived while we weren't drawn
+  scroll = scroll || mScriptOutputPending;
+  mScriptOutputPending = false;
+
+  if (mFolding)
   {
-    ImGui::TextUnformatted(pText->c_str());
+    mFolding->update(mDocument);
   }
-  else if (const auto pLines = std::get_if<std::vector<std::string>>(&mText))
+
+  drawText();
+
+  if (mSelectionMode == SelectionMode::Gamepad)
   {
-    for (const auto& line : *pLines)
-    {
-      ImGui::TextWrapped(line.c_str());
-    }
+    mSelection->end = currentLine();
   }
 
   // Handle scrolling automatically as we receive output from the script
-  if (scroll)
+  if (scroll && showsColumns)
+  {
+    // Clamped to the end of the table
+    ImGui::SetScrollY(mpTextWindow, FLT_MAX);
+  }
+  else if (scroll)
   {
     ImGui::SetScrollHere(1.0);
   }
 
+  const auto textIsScrollable = mpTextWindow->ScrollMax.y > 0.0f;
+
   ImGui::EndChild();
 
+  if (mShowsSearchBar)
+  {
+    drawSearchBar(windowSize.x);
+  }
+
   // Draw the button(s)
   if (mShowYesNoButtons) {
     // For the yes/no button case, we need to layout the buttons so that
@@ -207,6 +377,98 @@ std::optional<int> View::draw(const ImVec2& windowSize)
     {
       running = false;
     }
+
+    // Bookmarks are only useful when there is something to scroll.
+    // They can also be used via the X and Y buttons, see main.cpp.
+    if (textIsScrollable)
+    {
+      ImGui::SameLine();
+      if (ImGui::Button("Bookmark"))
+      {
+        toggleBookmark();
+      }
+
+      ImGui::SameLine();
+      if (ImGui::Button("Next bookmark"))
+      {
+        jumpToNextBookmark();
+      }
+    }
+  }
+
+  // Acts on the repeated lines at the top of the screen. Double clicking
+  // a row does the same.
+  const auto isExpanded =
+    mFolding ? mFolding->isExpanded(currentLine()) : std::nullopt;
+  if (isExpanded)
+  {
+    // The ID stays the same with either label, so that the button
+    // keeps gamepad focus after pressing it
+    ImGui::SameLine();
+    if (ImGui::Button(*isExpanded ? "Collapse###repeats" : "Expand###repeats"))
+    {
+      toggleRepeatedLines(currentLine());
+    }
+  }
+
+  if (!mShowsSearchBar)
+  {
+    ImGui::SameLine();
+    if (ImGui::Button("Search"))
+    {
+      mShowsSearchBar = true;
+    }
+  }
+
+  if (mpTimeIndex && mpTimeIndex->hasTimestamps())
+  {
+    ImGui::SameLine();
+    if (ImGui::Button("Go to time"))
+    {
+      ImGui::OpenPopup("Go to time");
+    }
+
+    drawTimeDialog();
+  }
+
+  if (mShowsScriptOutput && !mpOutputWriter)
+  {
+    ImGui::SameLine();
+    if (ImGui::Button("Save output"))
+    {
+      saveOutput();
+    }
+  }
+
+  if (mSelection)
+  {
+    drawSelectionButtons();
+  }
+
+  if (mpOutputWriter && mpOutputWriter->hasFailed())
+  {
+    showStatus("Failed to save output");
+    mpOutputWriter.reset();
+  }
+
+  // Tells whether the script or the viewer is slowing things down
+  if (mpScriptPipe && mThroughput >= 1.0)
+  {
+    const auto throughput = formatThroughput(mThroughput) +
+      (mIsFloodedWithOutput ? " (catching up)" : "");
+
+    ImGui::SameLine();
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextDisabled("%s", throughput.c_str());
+  }
+
+  const auto statusMessageAge =
+    std::chrono::steady_clock::now() - mStatusMessageTime;
+  if (!mStatusMessage.empty() && statusMessageAge < STATUS_MESSAGE_DURATION)
+  {
+    ImGui::SameLine();
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextUnformatted(mStatusMessage.c_str());
   }
 
   ImGui::End();
@@ -223,76 +485,1195 @@ std::optional<int> View::draw(const ImVec2& windowSize)
 }
 
 
-bool View::fetchScriptOutput()
+void View::pollScriptOutput()
 {
-  bool gotNewData = false;
+  readScriptOutput(READ_BUDGET_PER_FRAME);
+}
 
-  // Check if there is new data available from the script's output
-  struct pollfd pollData{mScriptPipeFd, POLLIN, 0};
-  const auto result = poll(&pollData, 1, 0);
 
-  if (result > 0)
+bool View::isFloodedWithOutput() const
+{
+  // Output isn't read during a search
+  return mpScriptPipe && !mpSearch && mIsFloodedWithOutput;
+}
+
+
+void View::readScriptOutput(const std::chrono::steady_clock::duration duration)
+{
+  updateSearch();
+
+  if (mpScriptPipe && !mpSearch && fetchScriptOutput(duration))
   {
-    if (pollData.revents & POLLIN)
-    {
-      // Data is available.
-      char bytes[1024];
-      const auto bytesRead = read(mScriptPipeFd, bytes, sizeof(bytes));
-      if (bytesRead == -1)
-      {
-        // Error reading the pipe
-        throw std::runtime_error("Error read()-ing script fd");
-      }
+    mScriptOutputPending = true;
+  }
 
-      if (bytesRead > 0)
-      {
-        gotNewData = true;
+  mDocument.update();
+}
 
-        // We read some output bytes, append them to our message,
-        // taking word-wrapping into account as needed.
-        if (const auto pText = std::get_if<std::string>(&mText))
-        {
-          // Word-wrapping is disabled, simply append the bytes we read to our
-          // string.
-          pText->insert(pText->end(), bytes, bytes + bytesRead);
-        }
-        else if (const auto pLines = std::get_if<std::vector<std::string>>(&mText))
-        {
-          // Word-wrapping is enabled, look for linebreaks and move on to
-          // the next line in the list of lines when we encouter one.
-          if (pLines->empty())
-          {
-            pLines->emplace_back(bytes, bytes + bytesRead);
-          }
-          else
-          {
-            for (auto pChar = bytes; pChar != bytes + bytesRead; ++pChar)
-            {
-              pLines->back().push_back(*pChar);
-
-              if (*pChar == '\n')
-              {
-                pLines->emplace_back();
-              }
-            }
-          }
-        }
-      }
-    }
 
-    if (pollData.revents & POLLHUP || pollData.revents & POLLERR)
+void View::setReadingPosition(const ReadingPosition& position)
+{
+  mBookmarks.clear();
+  for (const auto bookmark : position.bookmarks)
+  {
+    if (bookmark < mDocument.lineCount())
     {
-      // The script is done, or an error occured - close the pipe
-      closeScriptPipe();
+      mBookmarks.insert(bookmark);
     }
   }
-  else if (result < 0)
+
+  if (position.topLine < mDocument.lineCount())
   {
-    // Error polling the pipe
-    throw std::runtime_error("Error poll()-ing script fd");
+    mTopLine = static_cast<float>(position.topLine);
+    jumpToLine(position.topLine);
   }
+}
 
-  return gotNewData;
+
+ReadingPosition View::readingPosition() const
+{
+  return {
+    currentLine(),
+    std::vector<std::size_t>(mBookmarks.begin(), mBookmarks.end())};
+}
+
+
+void View::toggleBookmark()
+{
+  const auto line = currentLine();
+  if (!mBookmarks.erase(line))
+  {
+    mBookmarks.insert(line);
+  }
+}
+
+
+void View::jumpToNextBookmark()
+{
+  if (mBookmarks.empty())
+  {
+    return;
+  }
+
+  // Wrap around to the first bookmark after reaching the last one
+  auto iNext = mBookmarks.upper_bound(currentLine());
+  if (iNext == mBookmarks.end())
+  {
+    iNext = mBookmarks.begin();
+  }
+
+  jumpToLine(*iNext);
+}
+
+
+void View::markSelection()
+{
+  if (mSelectionMode == SelectionMode::Gamepad)
+  {
+    mSelectionMode = SelectionMode::None;
+    return;
+  }
+
+  const auto line = currentLine();
+  mSelection = Selection{line, line};
+  mSelectionMode = SelectionMode::Gamepad;
+}
+
+
+void View::startSearch(const std::string& pattern)
+{
+  mShowsSearchBar = true;
+
+  const auto inputSize = std::min(pattern.size(), mSearchInput.size() - 1);
+  std::copy_n(pattern.begin(), inputSize, mSearchInput.begin());
+  mSearchInput[inputSize] = '\0';
+
+  mpSearch.reset();
+  mpSearchRegex.reset();
+  mMatches.clear();
+  mSearchMessage.clear();
+
+  if (pattern.empty())
+  {
+    return;
+  }
+
+  try
+  {
+    mpSearchRegex = std::make_shared<const Regex>(pattern);
+  }
+  catch (const std::invalid_argument& error)
+  {
+    mSearchMessage = std::string{"Invalid pattern: "} + error.what();
+    return;
+  }
+
+  searchFrom(0);
+}
+
+
+void View::jumpToNextMatch()
+{
+  if (mMatches.empty())
+  {
+    return;
+  }
+
+  // Wrap around to the first match after reaching the last one
+  auto iNext =
+    std::upper_bound(mMatches.begin(), mMatches.end(), currentLine());
+  if (iNext == mMatches.end())
+  {
+    iNext = mMatches.begin();
+  }
+
+  jumpToLine(*iNext);
+}
+
+
+void View::jumpToPreviousMatch()
+{
+  if (mMatches.empty())
+  {
+    return;
+  }
+
+  const auto iCurrent =
+    std::lower_bound(mMatches.begin(), mMatches.end(), currentLine());
+  const auto iPrevious =
+    iCurrent == mMatches.begin() ? mMatches.end() - 1 : iCurrent - 1;
+
+  jumpToLine(*iPrevious);
+}
+
+
+void View::setJsonColumns(std::vector<std::string> fieldNames)
+{
+  mJsonFields.emplace(std::move(fieldNames), JSON_FIELD_CACHE_LINES);
+  mIsJsonDocument.reset();
+}
+
+
+bool View::renderCachedText()
+{
+  return mTextCache.render();
+}
+
+
+std::size_t View::currentLine() const
+{
+  return static_cast<std::size_t>(mPendingTopLine.value_or(mTopLine));
+}
+
+
+void View::jumpToLine(const std::size_t line)
+{
+  // Otherwise, the top line would be the first line of the run, and
+  // jumping to the next match or bookmark would end up here again
+  if (mFolding && mFolding->isHidden(line))
+  {
+    mFolding->toggle(line);
+    mTextCache.invalidate();
+  }
+
+  mPendingTopLine = static_cast<float>(line);
+}
+
+
+void View::handleFontSizeChange()
+{
+  // The widest line depends on the font, and needs to be determined anew
+  mMaxLineWidth = 0.0f;
+  mColumnWidths.clear();
+
+  if (mLastFontSize != 0.0f && !mPendingTopLine)
+  {
+    mPendingTopLine = mTopLine;
+  }
+
+  mLastFontSize = ImGui::GetFontSize();
+}
+
+
+void View::drawLineMarkers(
+  const std::size_t line,
+  const float top,
+  const float bottom)
+{
+  // Highlight the entire width of the line, not just the text
+  const auto windowPos = ImGui::GetWindowPos();
+  const auto windowWidth = ImGui::GetWindowSize().x;
+
+  if (mBookmarks.count(line))
+  {
+    ImGui::GetWindowDrawList()->AddRectFilled(
+      {windowPos.x, top},
+      {windowPos.x + windowWidth, bottom},
+      ImGui::GetColorU32(ImGuiCol_PlotHistogram, 0.35f));
+  }
+
+  if (std::binary_search(mMatches.begin(), mMatches.end(), line))
+  {
+    ImGui::GetWindowDrawList()->AddRectFilled(
+      {windowPos.x, top},
+      {windowPos.x + windowWidth, bottom},
+      ImGui::GetColorU32(ImGuiCol_PlotLinesHovered, 0.35f));
+  }
+
+  if (mSelection && line >= mSelection->first() && line <= mSelection->last())
+  {
+    ImGui::GetWindowDrawList()->AddRectFilled(
+      {windowPos.x, top},
+      {windowPos.x + windowWidth, bottom},
+      ImGui::GetColorU32(ImGuiCol_TextSelectedBg));
+  }
+
+  // Repeated lines show how often they occurred at the right edge of the
+  // text window, covering the end of the line if necessary
+  const auto repeatCount =
+    mFolding ? mFolding->repeatCount(mDocument, line) : 1;
+  if (repeatCount > 1)
+  {
+    const auto label = "\xc3\x97" + std::to_string(repeatCount);
+    const auto labelWidth = ImGui::CalcTextSize(label.c_str()).x;
+    const auto right =
+      mpTextWindow->InnerClipRect.Max.x - ImGui::GetStyle().ItemSpacing.x;
+    const auto left = right - labelWidth - ImGui::GetStyle().ItemSpacing.x;
+
+    ImGui::GetWindowDrawList()->AddRectFilled(
+      {left, top},
+      {right, bottom},
+      ImGui::GetColorU32(ImGuiCol_FrameBg));
+    ImGui::GetWindowDrawList()->AddText(
+      {right - labelWidth, top},
+      ImGui::GetColorU32(ImGuiCol_Text),
+      label.c_str());
+    mFontManager.requestGlyphs(label);
+  }
+}
+
+
+void View::toggleRepeatedLines(const std::size_t line)
+{
+  mFolding->toggle(line);
+  mTextCache.invalidate();
+
+  // Keep the top line in place while the rows above it change
+  if (!mPendingTopLine)
+  {
+    mPendingTopLine = mTopLine;
+  }
+}
+
+
+std::size_t View::rowCount() const
+{
+  return mFolding ? mFolding->rowCount() : mDocument.lineCount();
+}
+
+
+std::size_t View::lineAtRow(const std::size_t row) const
+{
+  return mFolding ? mFolding->lineAtRow(row) : row;
+}
+
+
+float View::rowPosition(const float linePosition) const
+{
+  // Like mTopLine, positions can be fractional. The fraction is kept
+  // as is, since both lines and rows are one line height high.
+  if (!mFolding)
+  {
+    return linePosition;
+  }
+
+  const auto line = static_cast<std::size_t>(linePosition);
+  return mFolding->rowOfLine(line) + (linePosition - line);
+}
+
+
+float View::linePosition(const float rowPosition) const
+{
+  if (!mFolding)
+  {
+    return rowPosition;
+  }
+
+  const auto row = static_cast<std::size_t>(rowPosition);
+  return mFolding->lineAtRow(row) + (rowPosition - row);
+}
+
+
+std::optional<ImU32> View::rowHighlightColor(const std::size_t line) const
+{
+  // Table rows have a single background color, so the selection takes
+  // precedence over matches, which take precedence over bookmarks
+  if (mSelection && line >= mSelection->first() && line <= mSelection->last())
+  {
+    return ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
+  }
+
+  if (std::binary_search(mMatches.begin(), mMatches.end(), line))
+  {
+    return ImGui::GetColorU32(ImGuiCol_PlotLinesHovered, 0.35f);
+  }
+
+  if (mBookmarks.count(line))
+  {
+    return ImGui::GetColorU32(ImGuiCol_PlotHistogram, 0.35f);
+  }
+
+  return {};
+}
+
+
+bool View::showsJsonColumns()
+{
+  if (!mJsonFields)
+  {
+    return false;
+  }
+
+  // Script output is only checked once its first line is complete
+  if (!mIsJsonDocument && (!mpScriptPipe || mDocument.lineCount() > 1))
+  {
+    mIsJsonDocument = looksLikeJsonLines(mDocument);
+    mFocusJsonColumns = *mIsJsonDocument && !mShowYesNoButtons;
+  }
+
+  return mIsJsonDocument.value_or(false);
+}
+
+
+void View::drawJsonColumns()
+{
+  const auto& fieldNames = mJsonFields->fieldNames();
+  const auto lineHeight = ImGui::GetTextLineHeight();
+
+  if (mColumnWidths.size() != fieldNames.size())
+  {
+    mColumnWidths.assign(fieldNames.size(), 0.0f);
+  }
+
+  for (std::size_t i = 0; i < fieldNames.size(); ++i)
+  {
+    mColumnWidths[i] =
+      std::max(mColumnWidths[i], ImGui::CalcTextSize(fieldNames[i].c_str()).x);
+  }
+
+  // Scrolling with the gamepad applies to the focused window, which needs
+  // to be the table's own scrolling region instead of the surrounding one
+  if (mFocusJsonColumns)
+  {
+    ImGui::SetNextWindowFocus();
+    mFocusJsonColumns = false;
+  }
+
+  // Without vertical cell padding, each row is exactly one line high,
+  // which allows using the same line <-> scroll position mapping as
+  // for plain text
+  ImGui::PushStyleVar(
+    ImGuiStyleVar_CellPadding, {ImGui::GetStyle().CellPadding.x, 0.0f});
+
+  if (!ImGui::BeginTable(
+    "##json_columns",
+    static_cast<int>(fieldNames.size()),
+    ImGuiTableFlags_ScrollX |
+    ImGuiTableFlags_ScrollY |
+    ImGuiTableFlags_BordersInnerV))
+  {
+    ImGui::PopStyleVar();
+    return;
+  }
+
+  mpTextWindow = ImGui::GetCurrentWindow();
+
+  // Fixed columns that can't be resized take the larger of the given
+  // width and that of the visible content. Since we give them the widest
+  // content seen so far, they don't change while scrolling.
+  ImGui::TableSetupScrollFreeze(0, 1);
+  for (std::size_t i = 0; i < fieldNames.size(); ++i)
+  {
+    ImGui::TableSetupColumn(
+      fieldNames[i].c_str(),
+      ImGuiTableColumnFlags_WidthFixed,
+      mColumnWidths[i]);
+  }
+  ImGui::TableHeadersRow();
+
+  // The header row stays at the top, and covers whatever row
+  // is scrolled below it
+  const auto rowsTop = mpTextWindow->InnerClipRect.Min.y + lineHeight;
+  const auto mouseY = ImGui::GetIO().MousePos.y;
+  std::optional<std::size_t> lineAtMouse;
+
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(rowCount()), lineHeight);
+  while (clipper.Step())
+  {
+    for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+    {
+      const auto i = lineAtRow(row);
+      ImGui::TableNextRow(ImGuiTableRowFlags_None, lineHeight);
+
+      if (const auto color = rowHighlightColor(i))
+      {
+        ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, *color);
+      }
+
+      // Fields are only parsed for lines that are actually shown
+      const auto& fields = mJsonFields->fields(i, mDocument.line(i));
+      for (std::size_t column = 0; column < fields.size(); ++column)
+      {
+        ImGui::TableNextColumn();
+
+        const auto& field = fields[column];
+        ImGui::TextUnformatted(field.data(), field.data() + field.size());
+        mFontManager.requestGlyphs(field);
+
+        mColumnWidths[column] =
+          std::max(mColumnWidths[column], ImGui::GetItemRectSize().x);
+      }
+
+      const auto top = ImGui::GetItemRectMin().y;
+      if (mouseY >= std::max(top, rowsTop) && mouseY < top + lineHeight)
+      {
+        lineAtMouse = i;
+      }
+    }
+  }
+  clipper.End();
+
+  if (mPendingTopLine)
+  {
+    ImGui::SetScrollY(rowPosition(*mPendingTopLine) * lineHeight);
+    mPendingTopLine.reset();
+  }
+
+  mTopLine = linePosition(ImGui::GetScrollY() / lineHeight);
+
+  updateMouseSelection(lineAtMouse);
+
+  ImGui::EndTable();
+  ImGui::PopStyleVar();
+}
+
+
+void View::drawText()
+{
+  mpTextWindow = ImGui::GetCurrentWindow();
+
+  if (showsJsonColumns())
+  {
+    drawJsonColumns();
+    return;
+  }
+
+  if (mWrapLines)
+  {
+    // Wrapped lines can have different heights, so we can't easily tell
+    // which ones are visible without laying out all of them.
+    auto topLineFound = false;
+    std::optional<std::size_t> lineAtMouse;
+    const auto mouseY = ImGui::GetIO().MousePos.y;
+
+    const auto pendingTopRow = mPendingTopLine
+      ? std::optional<std::size_t>{
+          static_cast<std::size_t>(rowPosition(*mPendingTopLine))}
+      : std::nullopt;
+
+    ImGui::PushTextWrapPos(0.0f);
+    for (std::size_t row = 0; row < rowCount(); ++row)
+    {
+      const auto i = lineAtRow(row);
+      if (row == pendingTopRow)
+      {
+        ImGui::SetScrollHereY(0.0f);
+        mPendingTopLine.reset();
+      }
+
+      const auto line = mDocument.line(i);
+      ImGui::TextUnformatted(line.data(), line.data() + line.size());
+
+      const auto top = ImGui::GetItemRectMin().y;
+      const auto bottom = ImGui::GetItemRectMax().y;
+      drawLineMarkers(i, top, bottom);
+
+      if (mouseY >= top && mouseY < bottom)
+      {
+        lineAtMouse = i;
+      }
+
+      if (ImGui::IsItemVisible())
+      {
+        mFontManager.requestGlyphs(line);
+
+        if (!topLineFound && !mPendingTopLine)
+        {
+          mTopLine = static_cast<float>(i);
+          topLineFound = true;
+        }
+      }
+    }
+    ImGui::PopTextWrapPos();
+
+    updateMouseSelection(lineAtMouse);
+    return;
+  }
+
+  // Once the text can't change anymore, it's drawn from a texture that is
+  // only updated when scrolling past the cached lines, or zooming.
+  if (mpScriptPipe || !drawCachedText())
+  {
+    drawVisibleLines();
+  }
+
+  // On the very first frame, the text window didn't exist yet when
+  // draw() looked at the pending line. The jump will be visible
+  // on the next frame.
+  if (mPendingTopLine)
+  {
+    ImGui::SetScrollY(
+      rowPosition(*mPendingTopLine) * ImGui::GetTextLineHeight());
+    mPendingTopLine.reset();
+  }
+
+  // Only the visible lines contribute to the content width, so the
+  // horizontal scroll range would change while scrolling vertically.
+  // That's why we keep track of the widest line we've seen so far, and
+  // use that as content width (see draw()).
+  mTopLine = linePosition(ImGui::GetScrollY() / ImGui::GetTextLineHeight());
+
+  updateMouseSelection(lineAtMouse());
+}
+
+
+void View::drawVisibleLines()
+{
+  // Without wrapping, all lines have the same height. This allows us to
+  // only submit the lines that are currently visible, which keeps the
+  // per-frame cost independent of the document's size.
+  // Lines are drawn without spacing in between, same as ImGui
+  // does when drawing a multi-line text.
+  ImGui::PushStyleVar(
+    ImGuiStyleVar_ItemSpacing, {ImGui::GetStyle().ItemSpacing.x, 0.0f});
+
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(rowCount()), ImGui::GetTextLineHeight());
+  while (clipper.Step())
+  {
+    for (auto row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+    {
+      const auto i = lineAtRow(row);
+      const auto line = mDocument.line(i);
+      if (line.size() > LongLineLayout::MIN_LINE_SIZE)
+      {
+        drawLongLine(i, line);
+        continue;
+      }
+
+      ImGui::TextUnformatted(line.data(), line.data() + line.size());
+      mFontManager.requestGlyphs(line);
+      drawLineMarkers(i, ImGui::GetItemRectMin().y, ImGui::GetItemRectMax().y);
+
+      mMaxLineWidth = std::max(mMaxLineWidth, ImGui::GetItemRectSize().x);
+    }
+  }
+  clipper.End();
+
+  ImGui::PopStyleVar();
+}
+
+
+void View::drawLongLine(const std::size_t line, const std::string_view text)
+{
+  const auto& clipRect = mpTextWindow->InnerClipRect;
+  const auto originX = textOriginX();
+  const auto top = ImGui::GetCursorScreenPos().y;
+
+  const auto span = mLongLines.visibleSpan(
+    line, text, clipRect.Min.x - originX, clipRect.Max.x - originX);
+  ImGui::GetWindowDrawList()->AddText(
+    {static_cast<float>(originX + span.x), top},
+    ImGui::GetColorU32(ImGuiCol_Text),
+    span.text.data(),
+    span.text.data() + span.text.size());
+  mFontManager.requestGlyphs(span.text);
+
+  // Take up the space of the entire line, so that the horizontal
+  // scroll range covers all of it
+  const auto width = static_cast<float>(mLongLines.width(line, text));
+  ImGui::Dummy({width, ImGui::GetTextLineHeight()});
+  drawLineMarkers(line, top, top + ImGui::GetTextLineHeight());
+
+  mMaxLineWidth = std::max(mMaxLineWidth, width);
+}
+
+
+double View::textOriginX() const
+{
+  // ImGui's cursor positions are floats, which can be several pixels off
+  // when scrolled far into a long line. We only need whole pixels
+  // on screen, so doing the math in double precision avoids that.
+  return
+    static_cast<double>(mpTextWindow->Pos.x) +
+    mpTextWindow->WindowPadding.x -
+    mpTextWindow->Scroll.x;
+}
+
+
+bool View::drawCachedText()
+{
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  const auto& clipRect = mpTextWindow->InnerClipRect;
+  const auto contentStart = mpTextWindow->DC.CursorStartPos;
+
+  // All rows have the same height, so the visible ones follow directly
+  // from the scroll position. The cache holds rows as well, which are
+  // the same as lines unless repeated lines are collapsed.
+  const auto rows = rowCount();
+  const auto visibleTop = std::max(clipRect.Min.y - contentStart.y, 0.0f);
+  const auto visibleBottom = std::max(clipRect.Max.y - contentStart.y, 0.0f);
+  const auto firstVisibleRow = std::min(
+    static_cast<std::size_t>(visibleTop / lineHeight), rows - 1);
+  const auto endVisibleRow = std::min(
+    static_cast<std::size_t>(visibleBottom / lineHeight) + 1, rows);
+
+  // Relative to the start of the lines
+  const auto originX = textOriginX();
+  const auto visibleLeft = clipRect.Min.x - originX;
+  const auto visibleRight = clipRect.Max.x - originX;
+
+  const auto appearance = TextCache::Appearance{
+    ImGui::GetFont(),
+    ImGui::GetFontSize(),
+    ImGui::GetFont()->ContainerAtlas->TexID,
+    ImGui::GetColorU32(ImGuiCol_Text),
+    textBackgroundColor()};
+
+  if (!mTextCache.contains(
+    appearance, firstVisibleRow, endVisibleRow, visibleLeft, visibleRight))
+  {
+    // Cache some lines above and below the visible ones as well, so
+    // that scrolling doesn't require updating the cache on every line
+    const auto margin =
+      std::max<std::size_t>((endVisibleRow - firstVisibleRow) / 4, 1);
+    const auto firstRow =
+      firstVisibleRow > margin ? firstVisibleRow - margin : 0;
+    const auto endRow = std::min(endVisibleRow + margin, rows);
+
+    // The same goes for scrolling sideways, as far as there is text. Whole
+    // pixels keep the cached text aligned with the screen's.
+    const auto marginX = clipRect.GetWidth() / 4.0;
+    const auto left = std::floor(
+      std::max(visibleLeft - marginX, std::min(visibleLeft, 0.0)));
+    const auto right = std::ceil(
+      std::min(
+        visibleRight + marginX,
+        std::max(visibleRight, static_cast<double>(mMaxLineWidth))));
+
+    if (!mTextCache.begin(appearance, firstRow, endRow, left, right))
+    {
+      return false;
+    }
+
+    for (auto row = firstRow; row < endRow; ++row)
+    {
+      const auto i = lineAtRow(row);
+      const auto line = mDocument.line(i);
+      if (line.size() > LongLineLayout::MIN_LINE_SIZE)
+      {
+        // Only the part of the line that is within the cache is added
+        const auto span = mLongLines.visibleSpan(i, line, left, right);
+        mTextCache.addLine(row, span.text, span.x);
+        mFontManager.requestGlyphs(span.text);
+
+        mMaxLineWidth = std::max(
+          mMaxLineWidth, static_cast<float>(mLongLines.width(i, line)));
+        continue;
+      }
+
+      mTextCache.addLine(row, line);
+      mFontManager.requestGlyphs(line);
+
+      mMaxLineWidth = std::max(
+        mMaxLineWidth,
+        ImGui::CalcTextSize(line.data(), line.data() + line.size()).x);
+    }
+  }
+
+  // Text rendering snaps each line to whole pixels, so we do the same
+  // with the texture to keep it sharp. The parts of it outside of the
+  // visible area are clipped.
+  mTextCache.draw(
+    *ImGui::GetWindowDrawList(),
+    {
+      static_cast<float>(std::floor(originX + mTextCache.left())),
+      std::floor(contentStart.y + mTextCache.firstLine() * lineHeight)
+    });
+
+  for (auto row = firstVisibleRow; row < endVisibleRow; ++row)
+  {
+    const auto top = contentStart.y + row * lineHeight;
+    drawLineMarkers(lineAtRow(row), top, top + lineHeight);
+  }
+
+  return true;
+}
+
+
+std::optional<std::size_t> View::lineAtMouse() const
+{
+  // Without wrapping, all lines have the same height, so we can tell
+  // directly which line is at the mouse position. Positions above or
+  // below the text are clamped to the first and last line.
+  const auto mouseY =
+    ImGui::GetIO().MousePos.y - mpTextWindow->DC.CursorStartPos.y;
+  const auto row = static_cast<std::size_t>(
+    std::max(mouseY, 0.0f) / ImGui::GetTextLineHeight());
+  return lineAtRow(std::min(row, rowCount() - 1));
+}
+
+
+void View::updateMouseSelection(const std::optional<std::size_t> lineAtMouse)
+{
+  const auto& clipRect = mpTextWindow->InnerClipRect;
+  const auto isTextClicked =
+    lineAtMouse &&
+    ImGui::IsMouseClicked(ImGuiMouseButton_Left) &&
+    ImGui::IsWindowHovered() &&
+    ImGui::IsMouseHoveringRect(clipRect.Min, clipRect.Max) &&
+    !ImGui::IsAnyItemHovered();
+
+  // Double clicking repeated lines expands or collapses them
+  if (
+    isTextClicked &&
+    mFolding &&
+    mFolding->isExpanded(*lineAtMouse) &&
+    ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+  {
+    toggleRepeatedLines(*lineAtMouse);
+  }
+
+  // Pressing the mouse button on the text starts a new selection. Dragging
+  // extends it, until the button is released. Clicks on the scrollbars
+  // are ignored.
+  if (isTextClicked)
+  {
+    mSelection = Selection{*lineAtMouse, *lineAtMouse};
+    mSelectionMode = SelectionMode::Mouse;
+    return;
+  }
+
+  if (mSelectionMode != SelectionMode::Mouse)
+  {
+    return;
+  }
+
+  if (!ImGui::IsMouseDown(ImGuiMouseButton_Left))
+  {
+    mSelectionMode = SelectionMode::None;
+    return;
+  }
+
+  if (lineAtMouse)
+  {
+    mSelection->end = *lineAtMouse;
+  }
+
+  // Scroll along when dragging past the top or bottom of the text
+  const auto mouseY = ImGui::GetIO().MousePos.y;
+  if (mouseY < clipRect.Min.y)
+  {
+    ImGui::SetScrollY(ImGui::GetScrollY() - ImGui::GetTextLineHeight());
+  }
+  else if (mouseY > clipRect.Max.y)
+  {
+    ImGui::SetScrollY(ImGui::GetScrollY() + ImGui::GetTextLineHeight());
+  }
+}
+
+
+void View::drawSelectionButtons()
+{
+  ImGui::SameLine();
+  if (ImGui::Button("Copy"))
+  {
+    copySelection();
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Save"))
+  {
+    saveSelection();
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Deselect"))
+  {
+    mSelection.reset();
+    mSelectionMode = SelectionMode::None;
+  }
+}
+
+
+void View::copySelection()
+{
+  const auto text =
+    mDocument.copyLines(mSelection->first(), mSelection->last());
+  ImGui::SetClipboardText(text.c_str());
+
+  showStatus(
+    "Copied " +
+    std::to_string(mSelection->last() - mSelection->first() + 1) +
+    " line(s)");
+}
+
+
+void View::saveSelection()
+{
+  const auto path =
+    mExportDirectory + "/selection-" + currentTimestamp() + ".txt";
+
+  if (writeTextFile(path, mDocument, mSelection->first(), mSelection->last()))
+  {
+    showStatus("Saved to " + path);
+  }
+  else
+  {
+    showStatus("Failed to save " + path);
+  }
+}
+
+
+void View::saveOutput()
+{
+  const auto path =
+    mExportDirectory + "/output-" + currentTimestamp() + ".txt";
+  if (startSavingOutput(path))
+  {
+    showStatus(
+      "Saving output to " + path +
+      (mDocument.hasLineHashes() ? ", with repeated lines written out" : ""));
+  }
+  else
+  {
+    showStatus("Failed to save " + path);
+  }
+}
+
+
+bool View::startSavingOutput(const std::string& path)
+{
+  auto pWriter = OutputWriter::create(path);
+  if (!pWriter)
+  {
+    return false;
+  }
+
+  // Output that arrived so far comes first, everything else is added
+  // as it arrives (see fetchScriptOutput). With --collapse, the document
+  // dropped repeated lines, and only counted them. These are written out
+  // again, so that the file has the script's output as it was.
+  std::string buffer;
+  for (const auto& part :
+    mDocument.textParts(0, mDocument.lineCount() - 1, SIZE_MAX))
+  {
+    const auto text = part.read(buffer);
+    const auto pEnd = text.data() + text.size();
+    auto pUnwritten = text.data();
+
+    if (mDocument.hasLineHashes())
+    {
+      auto line = mDocument.lineContaining(part.offset());
+      auto pLineStart = text.data();
+      while (const auto pNewline = static_cast<const char*>(
+        std::memchr(pLineStart, '\n', pEnd - pLineStart)))
+      {
+        // Everything up to and including the line is written, and then
+        // the line on its own for each further copy, except for the last
+        // one, which is written together with what follows
+        const auto pLineEnd = pNewline + 1;
+        for (auto copies = mDocument.repeatCount(line); copies > 1; --copies)
+        {
+          pWriter->append(pUnwritten, pLineEnd);
+          pUnwritten = pLineStart;
+        }
+
+        pLineStart = pLineEnd;
+        ++line;
+      }
+    }
+
+    pWriter->append(pUnwritten, pEnd);
+  }
+
+  mpOutputWriter = std::move(pWriter);
+  return true;
+}
+
+
+void View::showStatus(std::string message)
+{
+  mStatusMessage = std::move(message);
+  mStatusMessageTime = std::chrono::steady_clock::now();
+}
+
+
+void View::drawSearchBar(const float width)
+{
+  ImGui::SetNextItemWidth(width / 3.0f);
+  if (ImGui::InputTextWithHint(
+    "##search",
+    "Regular expression",
+    mSearchInput.data(),
+    mSearchInput.size(),
+    ImGuiInputTextFlags_EnterReturnsTrue))
+  {
+    startSearch(mSearchInput.data());
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Previous"))
+  {
+    jumpToPreviousMatch();
+  }
+
+  // Next match can also be reached by clicking the right stick,
+  // see main.cpp
+  ImGui::SameLine();
+  if (ImGui::Button("Next"))
+  {
+    jumpToNextMatch();
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Hide"))
+  {
+    startSearch({});
+    mShowsSearchBar = false;
+  }
+
+  if (!mSearchMessage.empty())
+  {
+    ImGui::SameLine();
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextUnformatted(mSearchMessage.c_str());
+  }
+}
+
+
+void View::drawTimeDialog()
+{
+  if (!ImGui::BeginPopupModal(
+    "Go to time", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+  {
+    return;
+  }
+
+  if (ImGui::IsWindowAppearing())
+  {
+    ImGui::SetKeyboardFocusHere();
+  }
+
+  // Without a date, the day of the log's first timestamp is used
+  ImGui::SetNextItemWidth(ImGui::CalcTextSize("2024-10-18 14:32:00").x * 1.5f);
+  const auto confirmed = ImGui::InputTextWithHint(
+    "##time",
+    "14:32 or 2024-10-18 14:32",
+    mTimeInput.data(),
+    mTimeInput.size(),
+    ImGuiInputTextFlags_EnterReturnsTrue);
+
+  if (ImGui::Button("Go") || confirmed)
+  {
+    jumpToTime();
+    ImGui::CloseCurrentPopup();
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Cancel"))
+  {
+    ImGui::CloseCurrentPopup();
+  }
+
+  ImGui::EndPopup();
+}
+
+
+void View::jumpToTime()
+{
+  const auto time =
+    parseTimeInput(mTimeInput.data(), mpTimeIndex->startTime());
+  if (!time)
+  {
+    showStatus("Invalid time, use HH:MM[:SS] or YYYY-MM-DD HH:MM[:SS]");
+    return;
+  }
+
+  if (const auto line = mpTimeIndex->findLine(*time))
+  {
+    jumpToLine(*line);
+  }
+  else
+  {
+    showStatus(std::string{"No lines at or after "} + mTimeInput.data());
+  }
+}
+
+
+void View::searchFrom(const std::size_t firstLine)
+{
+  mSearchFirstLine = firstLine;
+  mSearchedLineCount = mDocument.lineCount();
+  mSearchedTextSize = mDocument.textSize();
+  mpSearch = std::make_unique<DocumentSearch>(
+    mDocument, mpSearchRegex, firstLine);
+
+  if (firstLine == 0)
+  {
+    mSearchMessage = "Searching...";
+  }
+}
+
+
+void View::updateSearch()
+{
+  if (mpSearch)
+  {
+    auto lines = mpSearch->takeResults();
+    if (!lines)
+    {
+      return;
+    }
+
+    // When searching new output, the previously last line was searched
+    // again, since more text might have been added to it
+    mMatches.erase(
+      std::lower_bound(mMatches.begin(), mMatches.end(), mSearchFirstLine),
+      mMatches.end());
+    mMatches.insert(mMatches.end(), lines->begin(), lines->end());
+    mpSearch.reset();
+
+    mSearchMessage = mMatches.size() == 1
+      ? "1 match"
+      : std::to_string(mMatches.size()) + " matches";
+  }
+
+  if (mpSearchRegex && mShowsScriptOutput && mDocument.textSize() != mSearchedTextSize)
+  {
+    searchFrom(mSearchedLineCount - 1);
+  }
+}
+
+
+bool View::fetchScriptOutput(const std::chrono::steady_clock::duration budget)
+{
+  bool gotNewData = false;
+  std::size_t bytesReceived = 0;
+  const auto startTime = std::chrono::steady_clock::now();
+
+  // Read as much as is available, but not for longer than the budget. When
+  // there's more to read after that, the script is producing output faster
+  // than we can show it.
+  mIsFloodedWithOutput = false;
+  while (mpScriptPipe)
+  {
+    // Check if there is new data available from the script's output
+    struct pollfd pollData{mScriptPipeFd, POLLIN, 0};
+    const auto result = poll(&pollData, 1, 0);
+
+    if (result < 0 && errno != EINTR)
+    {
+      // Error polling the pipe
+      throw std::runtime_error("Error poll()-ing script fd");
+    }
+
+    if (result <= 0)
+    {
+      break;
+    }
+
+    bool readBytes = false;
+    if (pollData.revents & POLLIN)
+    {
+      // Data is available
+      const auto pNewBytes = mScriptInput->pieceBuffer();
+      const auto bytesRead = read(
+        mScriptPipeFd, pNewBytes, mScriptInput->maxPieceSize());
+      if (bytesRead == -1 && errno != EINTR && errno != EAGAIN)
+      {
+        // Error reading the pipe
+        throw std::runtime_error("Error read()-ing script fd");
+      }
+
+      if (bytesRead > 0)
+      {
+        readBytes = true;
+        bytesReceived += bytesRead;
+        const auto pEnd = pNewBytes + bytesRead;
+
+        // The output file gets everything right away
+        if (mpOutputWriter)
+        {
+          mpOutputWriter->append(pNewBytes, pEnd);
+        }
+
+        // We read some output bytes, append them to our document.
+        // Characters split across reads are held back until complete.
+        if (mScriptInput->appendPiece(bytesRead, mDocument))
+        {
+          gotNewData = true;
+        }
+      }
+    }
+
+    // The script is done, or an error occured - close the pipe. A script
+    // that exits right after writing a lot of output signals the hangup
+    // while there's still data in the pipe, so we only close it once
+    // everything has been read.
+    if ((pollData.revents & POLLHUP || pollData.revents & POLLERR) && !readBytes)
+    {
+      // Whatever is left of a cut off character won't be completed
+      if (mScriptInput->finish(mDocument))
+      {
+        gotNewData = true;
+      }
+
+      closeScriptPipe();
+      break;
+    }
+
+    if (std::chrono::steady_clock::now() - startTime >= budget)
+    {
+      mIsFloodedWithOutput = true;
+      break;
+    }
+  }
+
+  updateThroughput(bytesReceived);
+  return gotNewData;
+}
+
+
+void View::updateThroughput(const std::size_t bytesReceived)
+{
+  mBytesSinceThroughputUpdate += bytesReceived;
+
+  const auto now = std::chrono::steady_clock::now();
+  const auto elapsed = std::chrono::duration<double>(now - mLastThroughputUpdate);
+  if (elapsed < THROUGHPUT_UPDATE_INTERVAL)
+  {
+    return;
+  }
+
+  // Smoothed, so that the indicator doesn't flicker
+  const auto currentThroughput = mBytesSinceThroughputUpdate / elapsed.count();
+  mThroughput = mThroughput * (1.0 - THROUGHPUT_SMOOTHING) +
+    currentThroughput * THROUGHPUT_SMOOTHING;
+
+  mBytesSinceThroughputUpdate = 0;
+  mLastThroughputUpdate = now;
 }
 
 
@@ -21,36 +21,224 @@
 
 #pragma once
 
+#include "chunked_input.hpp"
+#include "document.hpp"
+#include "json_lines.hpp"
+#include "line_folding.hpp"
+#include "long_line_layout.hpp"
+#include "output_writer.hpp"
+#include "position_store.hpp"
+#include "regex.hpp"
+#include "search.hpp"
+#include "text_cache.hpp"
+#include "time_index.hpp"
+
 #include "imgui.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <memory>
 #include <string>
 #include <optional>
-#include <variant>
+#include <set>
 #include <vector>
 
 
+class FontManager;
+struct ImGuiWindow;
+
+
 class View {
 public:
+  // When a script file is given, the script is executed and its output
+  // appended to the document as it arrives.
   View(
     std::string windowTitle,
-    std::string inputTextOrScriptFile,
+    Document document,
+    const std::optional<std::string>& scriptFile,
     bool showYesNoButtons,
     bool wrapLines,
-    bool inpuTextIsScriptFile);
+    std::string exportDirectory,
+    FontManager& fontManager);
   ~View();
 
-  std::optional<int> draw(const ImVec2& windowSize);
+  std::optional<int> draw(const ImVec2& windowPos, const ImVec2& windowSize);
+
+  // Fetches output from the script while the view is not being drawn,
+  // e.g. because another tab is active. Otherwise, the script could
+  // block once the pipe is full.
+  void pollScriptOutput();
+
+  // True while the script produces output faster than it can be read
+  // in the time we allow for that per frame. Frames should be drawn less
+  // often then, calling readScriptOutput() in between (see main.cpp).
+  bool isFloodedWithOutput() const;
+
+  // Reads output from the script for at most the given duration
+  void readScriptOutput(std::chrono::steady_clock::duration duration);
+
+  void setReadingPosition(const ReadingPosition& position);
+  ReadingPosition readingPosition() const;
+
+  // Adds or removes a bookmark for the line at the top of the screen
+  void toggleBookmark();
+  void jumpToNextBookmark();
+
+  // Starts selecting lines at the top of the screen, or finishes the
+  // selection. While selecting, the selection follows the top line.
+  void markSelection();
+
+  // Writes the script's output to the given file, starting with what has
+  // been received so far. Returns false if the file can't be created.
+  bool startSavingOutput(const std::string& path);
+
+  // Shows the search bar and highlights all lines matching the given
+  // regular expression. Output arriving from a script is searched as well.
+  void startSearch(const std::string& pattern);
+  void jumpToNextMatch();
+  void jumpToPreviousMatch();
+
+  // Shows the given fields as columns, if the document consists of JSON
+  // objects (one per line). Otherwise, the text is shown as usual.
+  void setJsonColumns(std::vector<std::string> fieldNames);
+
+  // Updates the cached text texture, if needed. Must be called after
+  // ImGui::Render(), before rendering the frame. Returns true if the
+  // texture was updated.
+  bool renderCachedText();
 
 private:
-  bool fetchScriptOutput();
+  bool fetchScriptOutput(std::chrono::steady_clock::duration budget);
+  void updateThroughput(std::size_t bytesReceived);
   void closeScriptPipe();
+  std::size_t currentLine() const;
+  void jumpToLine(std::size_t line);
+  void handleFontSizeChange();
+  void drawLineMarkers(std::size_t line, float top, float bottom);
+  void toggleRepeatedLines(std::size_t line);
+  std::size_t rowCount() const;
+  std::size_t lineAtRow(std::size_t row) const;
+  float rowPosition(float linePosition) const;
+  float linePosition(float rowPosition) const;
+  void updateMouseSelection(std::optional<std::size_t> lineAtMouse);
+  std::optional<std::size_t> lineAtMouse() const;
+  void drawSelectionButtons();
+  void copySelection();
+  void saveSelection();
+  void saveOutput();
+  void showStatus(std::string message);
+  void drawSearchBar(float width);
+  void drawTimeDialog();
+  void jumpToTime();
+  void searchFrom(std::size_t firstLine);
+  void updateSearch();
+  std::optional<ImU32> rowHighlightColor(std::size_t line) const;
+  bool showsJsonColumns();
+  void drawJsonColumns();
+  void drawText();
+  void drawVisibleLines();
+  void drawLongLine(std::size_t line, std::string_view text);
+  double textOriginX() const;
+  bool drawCachedText();
 
   std::string mTitle;
-  std::variant<std::string, std::vector<std::string>> mText;
+  Document mDocument;
+  FontManager& mFontManager;
   FILE* mpScriptPipe;
   int mScriptPipeFd;
+  bool mShowsScriptOutput;
+  std::unique_ptr<OutputWriter> mpOutputWriter;
+
+  std::optional<ChunkedInput> mScriptInput;
+
+  // Bytes per second received from the script, shown next to the buttons
+  double mThroughput = 0.0;
+  std::size_t mBytesSinceThroughputUpdate = 0;
+  std::chrono::steady_clock::time_point mLastThroughputUpdate;
+  bool mIsFloodedWithOutput = false;
 
   std::optional<int> mExitCode;
+  ImGuiWindow* mpTextWindow;
+  float mMaxLineWidth;
+  float mLastFontSize;
+
+  // Index of the line at the top of the text window. Fractional when
+  // the top line is only partially visible.
+  float mTopLine;
+
+  // Line that should be scrolled to the top of the text window
+  std::optional<float> mPendingTopLine;
+  bool mScriptOutputPending;
+  std::set<std::size_t> mBookmarks;
+
+  // Regex search. While a search is running, output from the script
+  // isn't read, since the search works on the document's text directly.
+  bool mShowsSearchBar = false;
+  std::array<char, 256> mSearchInput{};
+  std::shared_ptr<const Regex> mpSearchRegex;
+  std::unique_ptr<DocumentSearch> mpSearch;
+  std::vector<std::size_t> mMatches;
+  std::string mSearchMessage;
+
+  // Where the running search started, and how much text there was at
+  // that point. Used to only search new output later on.
+  std::size_t mSearchFirstLine = 0;
+  std::size_t mSearchedLineCount = 0;
+  std::uint64_t mSearchedTextSize = 0;
+
+  // Selected lines, from the line where selecting started to the one where
+  // it ended. Only the end moves while selecting.
+  struct Selection
+  {
+    std::size_t first() const { return std::min(anchor, end); }
+    std::size_t last() const { return std::max(anchor, end); }
+
+    std::size_t anchor;
+    std::size_t end;
+  };
+
+  enum class SelectionMode
+  {
+    None,
+    Gamepad,
+    Mouse
+  };
+
+  std::optional<Selection> mSelection;
+  SelectionMode mSelectionMode = SelectionMode::None;
+  std::string mExportDirectory;
+
+  // Shown next to the buttons for a few seconds, e.g. after saving
+  std::string mStatusMessage;
+  std::chrono::steady_clock::time_point mStatusMessageTime;
+
+  // Built once the document doesn't change anymore, i.e. right away for
+  // files, and once the script has finished for script output
+  std::unique_ptr<TimeIndex> mpTimeIndex;
+  std::array<char, 64> mTimeInput{};
+
+  // Set when showing JSON lines as columns. Whether the document
+  // actually consists of JSON lines is only known once the first line
+  // is complete, which takes a while for script output.
+  std::optional<JsonFieldCache> mJsonFields;
+  std::optional<bool> mIsJsonDocument;
+  bool mFocusJsonColumns = false;
+
+  // Like mMaxLineWidth, column widths only ever grow, so that they don't
+  // change while scrolling
+  std::vector<float> mColumnWidths;
+
+  // Very long lines are only drawn where they're visible
+  LongLineLayout mLongLines;
+
+  // Set when the document hashes its lines, i.e. when repeated lines
+  // are collapsed. Text is laid out in rows instead of lines then.
+  std::optional<LineFolding> mFolding;
+
+  TextCache mTextCache;
   bool mShowYesNoButtons;
+  bool mWrapLines;
 };